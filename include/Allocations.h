@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Heap allocation counting for checking that steady state frames don't allocate. Builds configured
+ * with VULKAN_CUBE_COUNT_ALLOCATIONS replace the global operator new with one that counts per thread,
+ * other builds report nothing.
+ */
+namespace allocations {
+
+    [[nodiscard]]
+    bool counting();
+
+    // allocations made through operator new by the calling thread so far
+    [[nodiscard]]
+    uint64_t count();
+
+    // allocations made by the calling thread while the scope was alive
+    class Scope{
+    public:
+        Scope()
+        : start(count())
+        {}
+
+        [[nodiscard]]
+        uint64_t allocations() const {
+            return count() - start;
+        }
+
+    private:
+        uint64_t start;
+    };
+}
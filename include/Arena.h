@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump allocator for memory that only lives for one frame. Allocation is a pointer increment and
+ * nothing is freed individually, the owning frame resets the arena once its fence has signalled.
+ * A frame that overflows the arena chains extra blocks, the next reset merges them into one block
+ * big enough for that frame so steady state frames never touch the heap.
+ */
+class FrameArena{
+public:
+    explicit FrameArena(size_t blockSize = 64 * 1024){
+        blocks.push_back(Block{ blockSize });
+    }
+
+    FrameArena(const FrameArena&) = delete;
+
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // a moved from arena would have no block to allocate from, frames own theirs for the whole run
+    FrameArena(FrameArena&&) = delete;
+
+    FrameArena& operator=(FrameArena&&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)){
+        for(;;){
+            auto& block = blocks[current];
+            auto address = reinterpret_cast<uintptr_t>(block.data.get()) + offset;
+            auto aligned = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+            auto end = aligned - reinterpret_cast<uintptr_t>(block.data.get()) + size;
+            if(end <= block.size){
+                offset = end;
+                used += size;
+                return reinterpret_cast<void*>(aligned);
+            }
+            if(++current == blocks.size()){
+                blocks.push_back(Block{ std::max(block.size * 2, size + alignment) });
+            }
+            offset = 0;
+        }
+    }
+
+    // storage for count objects, they are never destroyed so only trivially destructible types are allowed
+    template<typename T>
+    T* allocate(size_t count){
+        static_assert(std::is_trivially_destructible_v<T>, "frame arena objects are never destroyed");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    void reset(){
+        highWater = std::max(highWater, used);
+        if(blocks.size() > 1){
+            size_t size = 0;
+            for(auto& block : blocks) size += block.size;
+            blocks.clear();
+            blocks.push_back(Block{ size });
+        }
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    // bytes handed out since the last reset
+    [[nodiscard]]
+    size_t size() const {
+        return used;
+    }
+
+    [[nodiscard]]
+    size_t capacity() const {
+        size_t size = 0;
+        for(auto& block : blocks) size += block.size;
+        return size;
+    }
+
+    // most bytes any frame has used so far
+    [[nodiscard]]
+    size_t peak() const {
+        return std::max(highWater, used);
+    }
+
+private:
+    struct Block{
+        explicit Block(size_t size)
+        : data(new std::byte[size])
+        , size(size)
+        {}
+
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    size_t highWater = 0;
+};
+
+// lets standard containers live in a frame arena, deallocation is a no op
+template<typename T>
+struct ArenaAllocator{
+    using value_type = T;
+
+    ArenaAllocator(FrameArena& arena)
+    : arena(&arena)
+    {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+    : arena(other.arena)
+    {}
+
+    T* allocate(size_t count){
+        return static_cast<T*>(arena->allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    void deallocate(T*, size_t){}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+
+    FrameArena* arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * Vector that keeps up to N elements inline and only goes to the heap beyond that, for the short
+ * lists Vulkan create infos and queries take
+ */
+template<typename T, size_t N>
+class SmallVector{
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() = default;
+
+    explicit SmallVector(size_t count){
+        resize(count);
+    }
+
+    SmallVector(std::initializer_list<T> values){
+        append(values.begin(), values.end());
+    }
+
+    template<typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+    SmallVector(Iterator first, Iterator last){
+        append(first, last);
+    }
+
+    SmallVector(const SmallVector& source){
+        append(source.begin(), source.end());
+    }
+
+    SmallVector(SmallVector&& source) noexcept {
+        operator=(static_cast<SmallVector&&>(source));
+    }
+
+    ~SmallVector(){
+        clear();
+        release();
+    }
+
+    SmallVector& operator=(const SmallVector& source){
+        if(&source != this){
+            clear();
+            append(source.begin(), source.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& source) noexcept {
+        if(&source == this) return *this;
+        clear();
+        if(!source.isInline()){
+            release();
+            items = source.items;
+            capacity_ = source.capacity_;
+            count = source.count;
+            source.items = source.inlineItems();
+            source.capacity_ = N;
+            source.count = 0;
+        }else{
+            reserve(source.count);
+            for(size_t i = 0; i < source.count; i++){
+                new (items + i) T(std::move(source.items[i]));
+            }
+            count = source.count;
+            source.clear();
+        }
+        return *this;
+    }
+
+    void push_back(const T& value){
+        emplace_back(value);
+    }
+
+    void push_back(T&& value){
+        emplace_back(std::move(value));
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args){
+        if(count == capacity_){
+            // the argument may live in this vector, construct it before growing
+            T value(std::forward<Args>(args)...);
+            grow(capacity_ * 2);
+            return *new (items + count++) T(std::move(value));
+        }
+        return *new (items + count++) T(std::forward<Args>(args)...);
+    }
+
+    void pop_back(){
+        items[--count].~T();
+    }
+
+    void resize(size_t size){
+        reserve(size);
+        while(count < size) new (items + count++) T();
+        while(count > size) pop_back();
+    }
+
+    void reserve(size_t size){
+        if(size > capacity_) grow(std::max(size, capacity_ * 2));
+    }
+
+    void clear(){
+        while(count > 0) pop_back();
+    }
+
+    T* data() { return items; }
+
+    const T* data() const { return items; }
+
+    [[nodiscard]]
+    size_t size() const { return count; }
+
+    [[nodiscard]]
+    size_t capacity() const { return capacity_; }
+
+    [[nodiscard]]
+    bool empty() const { return count == 0; }
+
+    // true while the elements live in the inline storage
+    [[nodiscard]]
+    bool isInline() const { return items == inlineItems(); }
+
+    T& operator[](size_t index) { return items[index]; }
+
+    const T& operator[](size_t index) const { return items[index]; }
+
+    T& front() { return items[0]; }
+
+    const T& front() const { return items[0]; }
+
+    T& back() { return items[count - 1]; }
+
+    const T& back() const { return items[count - 1]; }
+
+    iterator begin() { return items; }
+
+    iterator end() { return items + count; }
+
+    const_iterator begin() const { return items; }
+
+    const_iterator end() const { return items + count; }
+
+private:
+    template<typename Iterator>
+    void append(Iterator first, Iterator last){
+        for(; first != last; ++first){
+            emplace_back(*first);
+        }
+    }
+
+    void grow(size_t size){
+        auto grown = static_cast<T*>(::operator new(sizeof(T) * size, std::align_val_t{ alignof(T) }));
+        for(size_t i = 0; i < count; i++){
+            new (grown + i) T(std::move(items[i]));
+            items[i].~T();
+        }
+        release();
+        items = grown;
+        capacity_ = size;
+    }
+
+    void release(){
+        if(!isInline()){
+            ::operator delete(items, std::align_val_t{ alignof(T) });
+            items = inlineItems();
+            capacity_ = N;
+        }
+    }
+
+    T* inlineItems() { return reinterpret_cast<T*>(storage); }
+
+    const T* inlineItems() const { return reinterpret_cast<const T*>(storage); }
+
+    alignas(T) std::byte storage[sizeof(T) * N];
+    T* items = inlineItems();
+    size_t count = 0;
+    size_t capacity_ = N;
+};
+
+/**
+ * Non owning view of contiguous elements (vector, array, SmallVector, braced list), the elements
+ * must outlive every create info the span's pointer ends up in
+ */
+template<typename T>
+class Span{
+public:
+    using value_type = std::remove_const_t<T>;
+
+    Span() = default;
+
+    Span(T* items, size_t count)
+    : items(items)
+    , count(count)
+    {}
+
+    template<typename Container, typename = std::enable_if_t<std::is_convertible_v<decltype(std::data(std::declval<Container&>())), T*>>>
+    Span(Container&& container)
+    : items(std::data(container))
+    , count(std::size(container))
+    {}
+
+    Span(std::initializer_list<value_type> values)
+    : items(values.begin())
+    , count(values.size())
+    {}
+
+    T* data() const { return items; }
+
+    [[nodiscard]]
+    size_t size() const { return count; }
+
+    [[nodiscard]]
+    bool empty() const { return count == 0; }
+
+    T& operator[](size_t index) const { return items[index]; }
+
+    T* begin() const { return items; }
+
+    T* end() const { return items + count; }
+
+private:
+    T* items = nullptr;
+    size_t count = 0;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "io.h"
+
+namespace io {
+
+    /**
+     * Free list of read buffers, released buffers keep their capacity so steady state reads do not allocate
+     */
+    class BufferPool{
+    public:
+        byte_string acquire(){
+            std::lock_guard<std::mutex> lock{ mutex };
+            if(buffers.empty()) return {};
+            auto buffer = std::move(buffers.back());
+            buffers.pop_back();
+            return buffer;
+        }
+
+        void release(byte_string&& buffer){
+            if(buffer.capacity() == 0) return;
+            buffer.clear();
+            std::lock_guard<std::mutex> lock{ mutex };
+            buffers.push_back(std::move(buffer));
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<byte_string> buffers;
+    };
+
+    namespace detail {
+
+        struct ReadState{
+            fs::path path;
+            byte_string* destination = nullptr;
+            byte_string pooled;
+            std::shared_ptr<BufferPool> pool;
+            std::exception_ptr error;
+
+            std::mutex mutex;
+            std::condition_variable completed;
+            std::atomic_bool done = false;
+
+#ifndef _WIN32
+            int fd = -1;
+            size_t offset = 0;
+#endif
+
+            ~ReadState(){
+                if(pool) pool->release(std::move(pooled));
+            }
+
+            byte_string& buffer(){
+                return destination ? *destination : pooled;
+            }
+
+            void complete(std::exception_ptr exception = nullptr){
+                {
+                    std::lock_guard<std::mutex> lock{ mutex };
+                    error = exception;
+                    done = true;
+                }
+                completed.notify_all();
+            }
+        };
+    }
+
+    struct ReadRequest{
+        fs::path path;
+        byte_string* destination = nullptr;  // when null the file is read into a pooled buffer
+    };
+
+    class ReadHandle{
+    public:
+        ReadHandle() = default;
+
+        explicit ReadHandle(std::shared_ptr<detail::ReadState> state)
+        : state(std::move(state))
+        {}
+
+        [[nodiscard]]
+        bool ready() const {
+            return state->done;
+        }
+
+        void wait() const {
+            if(state->done) return;
+            std::unique_lock<std::mutex> lock{ state->mutex };
+            state->completed.wait(lock, [&]{ return state->done.load(); });
+        }
+
+        /**
+         * Blocks until the read completes, rethrows any I/O error, the returned buffer
+         * is either the caller supplied destination or a pooled buffer owned by this handle
+         */
+        const byte_string& get() const {
+            wait();
+            if(state->error) std::rethrow_exception(state->error);
+            return state->buffer();
+        }
+
+        const fs::path& path() const {
+            return state->path;
+        }
+
+    private:
+        std::shared_ptr<detail::ReadState> state;
+    };
+
+    class ReadBatch{
+    public:
+        ReadBatch() = default;
+
+        explicit ReadBatch(std::vector<ReadHandle> reads)
+        : reads(std::move(reads))
+        {}
+
+        void wait() const {
+            for(auto& read : reads){
+                read.wait();
+            }
+        }
+
+        [[nodiscard]]
+        bool ready() const {
+            return std::all_of(begin(reads), end(reads), [](auto& read){ return read.ready(); });
+        }
+
+        const ReadHandle& operator[](size_t index) const {
+            return reads[index];
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return reads.size();
+        }
+
+    private:
+        std::vector<ReadHandle> reads;
+    };
+
+    /**
+     * Batched asynchronous file reader, requests complete through io_uring when the build has it
+     * (VULKAN_CUBE_IO_URING) and the kernel allows it, otherwise on a pool of worker threads
+     */
+    class AsyncReader{
+    public:
+        explicit AsyncReader(uint32_t workerCount = std::max(2u, std::thread::hardware_concurrency() / 2));
+
+        AsyncReader(const AsyncReader&) = delete;
+
+        AsyncReader& operator=(const AsyncReader&) = delete;
+
+        ~AsyncReader();
+
+        ReadHandle read(const fs::path& path, byte_string* destination = nullptr);
+
+        ReadBatch read(const std::vector<ReadRequest>& requests);
+
+        [[nodiscard]]
+        bool usingIoUring() const {
+            return ring != nullptr;
+        }
+
+    private:
+        std::shared_ptr<detail::ReadState> createState(const ReadRequest& request);
+
+        void submit(const std::vector<std::shared_ptr<detail::ReadState>>& states);
+
+        void work();
+
+#ifdef VULKAN_CUBE_IO_URING
+        void submitToRing(const std::shared_ptr<detail::ReadState>& state);
+
+        void queueRead(detail::ReadState* state);
+
+        void reap();
+
+        std::mutex ringMutex;
+        std::unordered_map<detail::ReadState*, std::shared_ptr<detail::ReadState>> inFlight;
+        std::string ringError;      // set when waiting for completions failed, later reads fail with it
+        std::thread completionThread;
+#endif
+        void* ring = nullptr;
+
+        std::shared_ptr<BufferPool> pool = std::make_shared<BufferPool>();
+        std::mutex queueMutex;
+        std::condition_variable queueSignal;
+        std::deque<std::shared_ptr<detail::ReadState>> queue;
+        std::vector<std::thread> workers;
+        bool running = true;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <limits>
+#include "common.h"
+#include "Arena.h"
+#include "Culling.h"
+#include "Jobs.h"
+#include "Scene.h"
+
+/**
+ * Bounding volume hierarchy over axis aligned boxes (typically Scene::worldBoxes) for culling and
+ * picking scenes too large to test object by object. It is built top down with binned SAH, large
+ * nodes are split on the scheduler's workers, and moving objects are handled by refitting the
+ * boxes along their leaves' paths to the root instead of rebuilding.
+ *
+ * Nodes are 32 bytes and stored in depth first order: an internal node's left child directly
+ * follows it, and the objects of any subtree are one contiguous range of the leaf order. A subtree
+ * the frustum or query box fully contains is therefore accepted with a single copy.
+ */
+class Bvh{
+public:
+    using Bounds = Scene::Bounds;
+
+    static constexpr uint32_t INVALID = ~0u;
+
+    struct Ray{
+        glm::vec3 origin{0};
+        glm::vec3 direction{0, 0, -1};
+        float maxDistance = std::numeric_limits<float>::max();
+    };
+
+    struct Hit{
+        uint32_t object = INVALID;
+        float distance = std::numeric_limits<float>::max();
+
+        [[nodiscard]]
+        bool valid() const {
+            return object != INVALID;
+        }
+    };
+
+    // builds over bounds, objects are identified by their index in it
+    void build(Span<const Bounds> bounds);
+
+    void build(jobs::Scheduler& scheduler, Span<const Bounds> bounds);
+
+    // recomputes every node from bounds, which must have the size the hierarchy was built with
+    void refit(Span<const Bounds> bounds);
+
+    // recomputes only the nodes above the moved objects, cheaper than a full refit while few objects move
+    void refit(Span<const Bounds> bounds, Span<const uint32_t> moved);
+
+    // appends the objects whose boxes intersect the frustum
+    void cull(const culling::Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+    // nearest object whose box the ray hits, distance is where the ray enters that box
+    [[nodiscard]]
+    Hit raycast(const Ray& ray) const;
+
+    // appends the objects whose boxes overlap box
+    void query(const Bounds& box, std::vector<uint32_t>& objects) const;
+
+    [[nodiscard]]
+    size_t size() const {
+        return objects.size();
+    }
+
+    [[nodiscard]]
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+
+    [[nodiscard]]
+    Bounds bounds() const {
+        return nodes.empty() ? Bounds{} : Bounds{ nodes[0].min, nodes[0].max };
+    }
+
+private:
+    struct Node{
+        glm::vec3 min;
+        uint32_t offset;    // leaf: first object in leaf order, internal: right child
+        glm::vec3 max;
+        uint32_t count;     // objects in the subtree, INTERNAL is set on internal nodes
+
+        [[nodiscard]]
+        bool leaf() const {
+            return (count & INTERNAL) == 0;
+        }
+
+        [[nodiscard]]
+        uint32_t objectCount() const {
+            return count & ~INTERNAL;
+        }
+    };
+    static_assert(sizeof(Node) == 32);
+
+    static constexpr uint32_t INTERNAL = 1u << 31;
+
+    struct Builder;
+
+    void build(jobs::Scheduler* scheduler, Span<const Bounds> bounds);
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> objects;      // object indices in leaf order
+    std::vector<Bounds> boxes;          // object boxes in leaf order
+    std::vector<uint32_t> parents;      // per node
+    std::vector<uint32_t> leafOf;       // per object, the leaf holding it
+    std::vector<uint32_t> slotOf;       // per object, its position in leaf order
+    std::vector<uint8_t> dirty;         // per node, refit scratch
+    std::vector<uint32_t> dirtyNodes;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <type_traits>
+#include "common.h"
+#include "VulkanCommandBuffer.h"
+
+// FNV-1a over the values a recording depends on: handles, counts, versions, push constant data
+class StateHash{
+public:
+    StateHash() = default;
+
+    explicit StateHash(uint64_t seed)
+    : hash(seed)
+    {}
+
+    template<typename T>
+    StateHash& add(const T& value){
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values can be hashed byte wise");
+        return add(&value, sizeof(T));
+    }
+
+    StateHash& add(const void* data, size_t size){
+        auto bytes = static_cast<const uint8_t*>(data);
+        for(size_t i = 0; i < size; i++){
+            hash = (hash ^ bytes[i]) * PRIME;
+        }
+        return *this;
+    }
+
+    [[nodiscard]]
+    uint64_t value() const {
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t PRIME = 1099511628211ull;
+
+    uint64_t hash = 14695981039346656037ull;
+};
+
+/**
+ * Command buffers kept between frames and recorded again only when the state that fed them
+ * changes. Recordings are addressed by slot and bucket: a slot is one of the submissions that can
+ * be in flight at once (a frame in flight, a swapchain image), a bucket one part of what a slot
+ * records, a group of draws say. Each carries a key hashing everything its commands depend on,
+ * get() hands back the last recording while the key stays the same and re-records it otherwise.
+ * A static scene records each bucket once per slot and then only submits.
+ *
+ * A slot's command buffers must not be pending when get() is called for it, the previous
+ * submission using the slot has to have been waited for. Secondary command buffers recorded for a
+ * render pass have the render pass, subpass and framebuffer folded into their key, with dynamic
+ * rendering the attachment formats chained to the inheritance info have to be part of the key.
+ */
+class CommandCache{
+public:
+    struct Stats{
+        uint32_t recorded = 0;
+        uint32_t reused = 0;
+    };
+
+    CommandCache() = default;
+
+    CommandCache(VkDevice device, uint32_t queueFamilyIndex, uint32_t slots, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+    template<typename Record>
+    VkCommandBuffer get(uint32_t slot, uint32_t bucket, uint64_t key, Record&& record, const VkCommandBufferInheritanceInfo* inheritance = nullptr){
+        if(inheritance){
+            key = StateHash{ key }.add(inheritance->renderPass).add(inheritance->subpass).add(inheritance->framebuffer).value();
+        }
+
+        auto& entry = find(slot, bucket);
+        if(entry.recorded && entry.key == key){
+            frameStats.reused++;
+            return entry.commandBuffer;
+        }
+
+        entry.recorded = false;
+        begin(entry.commandBuffer, inheritance);
+        record(entry.commandBuffer);
+        ASSERT(vkEndCommandBuffer(entry.commandBuffer));
+        entry.key = key;
+        entry.recorded = true;
+        frameStats.recorded++;
+        return entry.commandBuffer;
+    }
+
+    // everything is recorded again on next use, after what the recordings reference was recreated
+    void invalidate();
+
+    // publishes the last frame's counts as metrics and starts counting the next
+    void beginFrame();
+
+    [[nodiscard]]
+    const Stats& stats() const {
+        return lastStats;
+    }
+
+private:
+    struct Entry{
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t key = 0;
+        bool recorded = false;
+    };
+
+    Entry& find(uint32_t slot, uint32_t bucket);
+
+    void begin(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo* inheritance) const;
+
+    VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    VulkanCommandPool commandPool;
+    std::vector<std::vector<Entry>> slots;      // entries per slot, indexed by bucket
+    Stats frameStats;
+    Stats lastStats;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "Jobs.h"
+#include "Transform.h"
+
+/**
+ * Frustum culling of bounding volumes kept as structure of arrays, the AVX2 kernel tests eight
+ * volumes against a plane per instruction and left packs the survivors with one permute, so the
+ * output is a compact list of visible indices in ascending order ready for draw recording.
+ * The instruction set is picked like transform's kernels.
+ */
+namespace culling {
+
+    // normalized planes pointing inwards, p is on the inner side of plane when dot(plane.xyz, p) + plane.w >= 0
+    struct Frustum{
+        std::array<glm::vec4, 6> planes;
+
+        // left, right, bottom, top, near and far planes of a view projection (or model view projection) matrix
+        static Frustum extract(const glm::mat4& viewProjection);
+    };
+
+    struct Spheres{
+        std::vector<float> x, y, z;     // center
+        std::vector<float> radius;
+
+        void resize(size_t count){
+            for(auto component : { &x, &y, &z, &radius }){
+                component->resize(count);
+            }
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return x.size();
+        }
+    };
+
+    // axis aligned boxes as center and half extent
+    struct Boxes{
+        std::vector<float> x, y, z;     // center
+        std::vector<float> ex, ey, ez;  // half extent
+
+        void resize(size_t count){
+            for(auto component : { &x, &y, &z, &ex, &ey, &ez }){
+                component->resize(count);
+            }
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return x.size();
+        }
+    };
+
+    /**
+     * Writes the indices of the volumes intersecting the frustum to visible in ascending order and
+     * returns how many there are. visible must have room for one index per volume, the vector kernels
+     * store whole registers past the visible count.
+     */
+    size_t cull(const Frustum& frustum, const Spheres& spheres, uint32_t* visible);
+
+    size_t cull(transform::Isa isa, const Frustum& frustum, const Spheres& spheres, uint32_t* visible);
+
+    size_t cull(const Frustum& frustum, const Boxes& boxes, uint32_t* visible);
+
+    size_t cull(transform::Isa isa, const Frustum& frustum, const Boxes& boxes, uint32_t* visible);
+
+    // culls chunks on the scheduler's workers and compacts them into visible, which ends up holding only the visible indices
+    void cull(jobs::Scheduler& scheduler, const Frustum& frustum, const Spheres& spheres, std::vector<uint32_t>& visible);
+
+    void cull(jobs::Scheduler& scheduler, const Frustum& frustum, const Boxes& boxes, std::vector<uint32_t>& visible);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.h"
+#include "Jobs.h"
+
+/**
+ * Draws recorded as packets carrying a 64 bit sort key, most significant field first: pipeline,
+ * descriptor set, geometry and depth bucket. Sorting by key groups the draws that share state and
+ * submit() walks them in that order, binding the pipeline, descriptor set or vertex and index
+ * buffers only when their part of the key changes. Draws sharing all state are ordered front to
+ * back so early depth testing rejects as much as it can.
+ *
+ * Keys are sorted with an LSD radix sort over 8 bit digits, each digit's histograms and scatter are
+ * split across the job system. Digits every key has in common are skipped, with a handful of
+ * pipelines and materials that is most of the upper ones.
+ *
+ * Pipelines sharing a descriptor set must have compatible pipeline layouts, the set isn't bound
+ * again when only the pipeline changes.
+ */
+class DrawList{
+public:
+    static constexpr uint32_t PIPELINE_BITS = 10;
+    static constexpr uint32_t DESCRIPTOR_SET_BITS = 14;
+    static constexpr uint32_t GEOMETRY_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 24;
+
+    using Id = uint32_t;
+
+    // a set of VK_NULL_HANDLE binds nothing, for pipelines that only use push constants
+    struct DescriptorSet{
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        uint32_t firstSet = 0;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+    };
+
+    struct Geometry{
+        std::vector<VkBuffer> vertexBuffers;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    };
+
+    struct Draw{
+        uint32_t indexCount = 0;
+        uint32_t instanceCount = 1;
+        uint32_t firstIndex = 0;
+        int32_t vertexOffset = 0;
+        uint32_t firstInstance = 0;
+    };
+
+    // binds the last submit() recorded, and the ones binding everything for every draw would have on top
+    struct Counters{
+        uint32_t draws = 0;
+        uint32_t pipelineBinds = 0;
+        uint32_t descriptorSetBinds = 0;
+        uint32_t geometryBinds = 0;
+        uint32_t bindsAvoided = 0;
+    };
+
+    Id addPipeline(VkPipeline pipeline);
+
+    Id addDescriptorSet(const DescriptorSet& descriptorSet);
+
+    Id addGeometry(Geometry geometry);
+
+    // depth in [0, 1], nearer draws go first among draws with the same state
+    void add(Id pipeline, Id descriptorSet, Id geometry, float depth, const Draw& draw);
+
+    void sort(jobs::Scheduler& scheduler);
+
+    const Counters& submit(VkCommandBuffer commandBuffer);
+
+    // drops the draws, registered pipelines, descriptor sets and geometry stay
+    void clear();
+
+    [[nodiscard]]
+    static uint64_t key(Id pipeline, Id descriptorSet, Id geometry, float depth);
+
+    [[nodiscard]]
+    size_t size() const {
+        return packets.size();
+    }
+
+    [[nodiscard]]
+    const Counters& counters() const {
+        return lastCounters;
+    }
+
+private:
+    static constexpr uint32_t RADIX_BITS = 8;
+    static constexpr uint32_t RADIX = 1u << RADIX_BITS;
+
+    struct Packet{
+        uint64_t key;
+        uint32_t draw;
+    };
+
+    std::vector<VkPipeline> pipelines;
+    std::vector<DescriptorSet> descriptorSets;
+    std::vector<Geometry> geometries;
+    std::vector<Draw> draws;
+    std::vector<Packet> packets;
+    std::vector<Packet> scratch;
+    std::vector<std::array<uint32_t, RADIX>> offsets;     // per chunk digit histograms, then scatter offsets
+    Counters lastCounters;
+};
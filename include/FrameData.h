@@ -1,8 +1,16 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeleters.h"
+#include "Arena.h"
 
+/**
+ * Synchronisation and scratch memory owned by one of the MAX_FRAMES_IN_FLIGHT frames the CPU may
+ * record ahead of the GPU, the arena is reset once inFlight has signalled
+ */
 struct FrameData{
-
-
-};
\ No newline at end of file
+    VulkanFence inFlight;
+    VulkanSemaphore imageAcquired;
+    VulkanSemaphore renderingFinished;
+    FrameArena arena;
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <map>
+#include "common.h"
+#include "VulkanDevice.h"
+#include "VulkanDeleters.h"
+#include "io.h"
+#include "Trace.h"
+#include "Metrics.h"
+
+/**
+ * Fixed window of samples for one scope, min / avg / p99 are computed over the last WINDOW samples
+ */
+struct RollingStats{
+    static constexpr size_t WINDOW = 256;
+
+    void add(double sample){
+        if(samples.empty()){
+            samples.reserve(WINDOW);
+        }
+        if(samples.size() < WINDOW){
+            samples.push_back(sample);
+        }else{
+            samples[next] = sample;
+        }
+        next = (next + 1) % WINDOW;
+        count++;
+    }
+
+    [[nodiscard]]
+    double min() const {
+        return samples.empty() ? 0 : *std::min_element(begin(samples), end(samples));
+    }
+
+    [[nodiscard]]
+    double average() const {
+        if(samples.empty()) return 0;
+        double sum = 0;
+        for(auto sample : samples) sum += sample;
+        return sum / static_cast<double>(samples.size());
+    }
+
+    [[nodiscard]]
+    double percentile(double p) const {
+        if(samples.empty()) return 0;
+        auto sorted = samples;
+        auto nth = begin(sorted) + static_cast<std::ptrdiff_t>(p * static_cast<double>(sorted.size() - 1));
+        std::nth_element(begin(sorted), nth, end(sorted));
+        return *nth;
+    }
+
+    std::vector<double> samples;
+    size_t next = 0;
+    uint64_t count = 0;
+};
+
+/**
+ * GPU timestamp profiler. Each query pool belongs to one command buffer, scopes recorded into it
+ * write a timestamp pair, and results are collected without waiting: call collect(pool) once the
+ * command buffer's last submission is known to have finished (its fence has signalled), which
+ * makes the numbers a few frames late but never stalls. Durations are kept in milliseconds.
+ *
+ * When VK_EXT_calibrated_timestamps is enabled collected scopes are also recorded on the GPU
+ * track of the trace, converted onto the host steady clock.
+ *
+ * Passes opened with pass() additionally count pipeline statistics when the device has the
+ * pipelineStatisticsQuery feature enabled, the latest counts are published to the metrics
+ * registry as gpu.<pass>.<counter>. Statistics queries can not nest, passes must not overlap.
+ */
+class GpuProfiler{
+public:
+#ifdef _WIN32
+    static constexpr VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+    static constexpr VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+    class Scope{
+    public:
+        DISABLE_COPY(Scope)
+
+        Scope(GpuProfiler* profiler, VkCommandBuffer commandBuffer, uint32_t pool, uint32_t query, std::optional<uint32_t> statisticsQuery = {})
+        : profiler(profiler)
+        , commandBuffer(commandBuffer)
+        , pool(pool)
+        , query(query)
+        , statisticsQuery(statisticsQuery)
+        {}
+
+        Scope(Scope&& source) noexcept
+        : profiler(std::exchange(source.profiler, nullptr))
+        , commandBuffer(source.commandBuffer)
+        , pool(source.pool)
+        , query(source.query)
+        , statisticsQuery(source.statisticsQuery)
+        {}
+
+        Scope& operator=(Scope&&) = delete;
+
+        ~Scope(){
+            if(profiler){
+                profiler->end(commandBuffer, pool, query, statisticsQuery);
+            }
+        }
+
+    private:
+        GpuProfiler* profiler;
+        VkCommandBuffer commandBuffer;
+        uint32_t pool;
+        uint32_t query;
+        std::optional<uint32_t> statisticsQuery;
+    };
+
+    struct PipelineStatistics{
+        uint64_t inputAssemblyVertices = 0;
+        uint64_t inputAssemblyPrimitives = 0;
+        uint64_t vertexShaderInvocations = 0;
+        uint64_t clippingPrimitives = 0;
+        uint64_t fragmentShaderInvocations = 0;
+        uint64_t computeShaderInvocations = 0;
+    };
+
+    GpuProfiler() = default;
+
+    GpuProfiler(VulkanDevice& device, uint32_t poolCount, uint32_t queueFamily, uint32_t maxScopes = 32);
+
+    // records the pool reset, must be called outside a render pass before any scope
+    void begin(VkCommandBuffer commandBuffer, uint32_t pool);
+
+    // name is kept as is and must outlive the profiler, a literal or a TRACE_NAME
+    [[nodiscard]]
+    Scope scope(VkCommandBuffer commandBuffer, uint32_t pool, const char* name);
+
+    // a scope that also counts pipeline statistics when they are supported
+    [[nodiscard]]
+    Scope pass(VkCommandBuffer commandBuffer, uint32_t pool, const char* name);
+
+    // reads back the last finished submission of pool, results that are not available yet are skipped
+    void collect(uint32_t pool);
+
+    [[nodiscard]]
+    const std::map<std::string, RollingStats, std::less<>>& stats() const {
+        return scopeStats;
+    }
+
+    [[nodiscard]]
+    const std::map<std::string, PipelineStatistics, std::less<>>& pipelineStatistics() const {
+        return passStatistics;
+    }
+
+    [[nodiscard]]
+    bool statisticsEnabled() const {
+        return statisticsSupported;
+    }
+
+    void report() const;
+
+    void write(const io::fs::path& path) const;
+
+    [[nodiscard]]
+    bool enabled() const {
+        return !pools.empty();
+    }
+
+private:
+    struct Pool{
+        VulkanQueryPool queries;
+        VulkanQueryPool statistics;
+        std::vector<const char*> scopes;
+        std::vector<const char*> passes;
+        bool recorded = false;
+    };
+
+    void end(VkCommandBuffer commandBuffer, uint32_t pool, uint32_t query, std::optional<uint32_t> statisticsQuery);
+
+    void collectStatistics(Pool& source);
+
+    void calibrate();
+
+    [[nodiscard]]
+    uint64_t toHostTime(uint64_t ticks) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    double timestampPeriod = 1;         // nanoseconds per tick
+    uint64_t timestampMask = ~0ull;
+    uint32_t maxScopes = 0;
+    std::vector<Pool> pools;
+    std::vector<uint64_t> results;
+    // keyed by the recorded names without building a std::string, collect runs every frame
+    std::map<std::string, RollingStats, std::less<>> scopeStats;
+    std::map<std::string, PipelineStatistics, std::less<>> passStatistics;
+    std::map<std::string, std::vector<std::string>, std::less<>> statisticNames;
+    bool statisticsSupported = false;
+
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+    uint64_t calibrationTicks = 0;
+    uint64_t calibrationHostTime = 0;
+    uint32_t collectsSinceCalibration = 0;
+};
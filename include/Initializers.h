@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "Arena.h"
 #include "VulkanShaderModule.h"
 
 namespace initializers{
@@ -11,8 +12,8 @@ namespace initializers{
         const char*  entry = "main";
     };
 
-    static inline std::vector<VkPipelineShaderStageCreateInfo> vertexShaderStages(VkDevice device, const std::vector<ShaderInfo>& shaderInfos){
-        std::vector<VkPipelineShaderStageCreateInfo> createInfos;
+    static inline SmallVector<VkPipelineShaderStageCreateInfo, 4> vertexShaderStages(VkDevice device, Span<const ShaderInfo> shaderInfos){
+        SmallVector<VkPipelineShaderStageCreateInfo, 4> createInfos;
 
         for(auto& shaderInfo : shaderInfos){
             VkPipelineShaderStageCreateInfo createInfo{};
@@ -27,7 +28,7 @@ namespace initializers{
         return createInfos;
     }
 
-    static inline VkPipelineVertexInputStateCreateInfo vertexInputState(const std::vector<VkVertexInputBindingDescription>& bindings = {}, const std::vector<VkVertexInputAttributeDescription>& attributes = {}){
+    static inline VkPipelineVertexInputStateCreateInfo vertexInputState(Span<const VkVertexInputBindingDescription> bindings = {}, Span<const VkVertexInputAttributeDescription> attributes = {}){
         VkPipelineVertexInputStateCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
         createInfo.vertexBindingDescriptionCount = COUNT(bindings);
@@ -47,7 +48,7 @@ namespace initializers{
         return createInfo;
     }
 
-    static inline VkPipelineViewportStateCreateInfo viewportState(const std::vector<VkViewport>& viewports, const std::vector<VkRect2D>& scissors){
+    static inline VkPipelineViewportStateCreateInfo viewportState(Span<const VkViewport> viewports, Span<const VkRect2D> scissors){
         VkPipelineViewportStateCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         createInfo.viewportCount = COUNT(viewports);
@@ -91,9 +92,16 @@ namespace initializers{
         return createInfo;
     }
 
-    static inline VkPipelineDepthStencilStateCreateInfo depthStencilState(){
+    // a less or equal test without writes is the colour pass after a depth pre-pass
+    static inline VkPipelineDepthStencilStateCreateInfo depthStencilState(VkBool32 depthTest = VK_TRUE, VkBool32 depthWrite = VK_TRUE
+                                                                          , VkCompareOp compareOp = VK_COMPARE_OP_LESS){
         VkPipelineDepthStencilStateCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        createInfo.depthTestEnable = depthTest;
+        createInfo.depthWriteEnable = depthWrite;
+        createInfo.depthCompareOp = compareOp;
+        createInfo.minDepthBounds = 0;
+        createInfo.maxDepthBounds = 1;
 
         return createInfo;
     }
@@ -114,7 +122,7 @@ namespace initializers{
         return createInfo;
     }
 
-    static inline VkPipelineDynamicStateCreateInfo dynamicState(std::vector<VkDynamicState> dynamicStates  = {}){
+    static inline VkPipelineDynamicStateCreateInfo dynamicState(Span<const VkDynamicState> dynamicStates = {}){
         VkPipelineDynamicStateCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         createInfo.dynamicStateCount = COUNT(dynamicStates);
@@ -123,6 +131,49 @@ namespace initializers{
         return createInfo;
     }
 
+    static inline VkImageMemoryBarrier imageMemoryBarrier(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout
+                                                          , VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask
+                                                          , VkImageSubresourceRange subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS}){
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = subresourceRange;
+
+        return barrier;
+    }
+
+    static inline VkImageViewCreateInfo imageViewCreateInfo(VkImage image, VkFormat format, VkImageSubresourceRange subresourceRange, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D){
+        VkImageViewCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = image;
+        createInfo.viewType = viewType;
+        createInfo.format = format;
+        createInfo.subresourceRange = subresourceRange;
+
+        return createInfo;
+    }
+
+    static inline VkSamplerCreateInfo samplerCreateInfo(float maxLod = VK_LOD_CLAMP_NONE, VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT){
+        VkSamplerCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        createInfo.magFilter = filter;
+        createInfo.minFilter = filter;
+        createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        createInfo.addressModeU = addressMode;
+        createInfo.addressModeV = addressMode;
+        createInfo.addressModeW = addressMode;
+        createInfo.maxLod = maxLod;
+        createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+        return createInfo;
+    }
+
     static inline VkViewport viewport(float width, float height, float x = 0, float y = 0, float minDepth = 0, float maxDepth = 1){
         return { x, y, width, height, minDepth, maxDepth };
     }
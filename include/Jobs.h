@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work stealing job system. Every worker owns a Chase-Lev deque, it pushes and pops jobs at the
+ * bottom while idle workers steal from the top, so most jobs run on the thread that spawned them
+ * without any locking. Threads that are not workers (the main thread, io workers) submit through
+ * a shared queue and help running jobs while they wait on a counter instead of blocking.
+ */
+namespace jobs {
+
+    class Scheduler;
+
+    struct Job;
+
+    /**
+     * Number of unfinished jobs in a group, jobs can be made to start only once another group has
+     * finished. The first exception thrown by a job of the group is rethrown by Scheduler::wait
+     */
+    class Counter{
+    public:
+        Counter() = default;
+
+        Counter(const Counter&) = delete;
+
+        Counter& operator=(const Counter&) = delete;
+
+        [[nodiscard]]
+        bool done() const {
+            return pending.load(std::memory_order_acquire) == 0;
+        }
+
+    private:
+        friend class Scheduler;
+
+        std::atomic<uint32_t> pending = 0;
+        std::mutex mutex;
+        std::vector<Job*> continuations;
+        std::exception_ptr error;
+    };
+
+    struct Job{
+        std::function<void()> task;
+        Counter* counter = nullptr;
+    };
+
+    namespace detail {
+
+        // Chase-Lev deque (Lê et al. 2013), push and pop are owner only, steal may be called from any thread
+        class Deque{
+        public:
+            explicit Deque(int64_t capacity = 1024);
+
+            Deque(const Deque&) = delete;
+
+            Deque& operator=(const Deque&) = delete;
+
+            void push(Job* job);
+
+            Job* pop();
+
+            Job* steal();
+
+        private:
+            struct Ring{
+                int64_t capacity;
+                std::unique_ptr<std::atomic<Job*>[]> jobs;
+
+                explicit Ring(int64_t capacity)
+                : capacity(capacity)
+                , jobs(new std::atomic<Job*>[capacity])
+                {}
+
+                Job* get(int64_t index) const {
+                    return jobs[index & (capacity - 1)].load(std::memory_order_acquire);
+                }
+
+                void put(int64_t index, Job* job){
+                    jobs[index & (capacity - 1)].store(job, std::memory_order_release);
+                }
+            };
+
+            Ring* grow(Ring* ring, int64_t top, int64_t bottom);
+
+            alignas(64) std::atomic<int64_t> top = 0;
+            alignas(64) std::atomic<int64_t> bottom = 0;
+            std::atomic<Ring*> ring;
+            std::vector<std::unique_ptr<Ring>> rings;  // thieves may still read retired rings
+        };
+    }
+
+    class Scheduler{
+    public:
+        explicit Scheduler(uint32_t workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1);
+
+        Scheduler(const Scheduler&) = delete;
+
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        ~Scheduler();
+
+        // runs task as part of counter's group
+        void run(std::function<void()> task, Counter& counter);
+
+        // runs task as part of counter's group once every job of dependency has finished
+        void run(std::function<void()> task, Counter& counter, Counter& dependency);
+
+        // runs other jobs until every job of counter's group has finished, then rethrows the group's first error
+        void wait(Counter& counter);
+
+        /**
+         * Calls body(first, last) over [begin, end) split into chunks of at most grain elements and
+         * returns once all chunks are done, the calling thread runs chunks too
+         */
+        template<typename Body>
+        void parallelFor(size_t begin, size_t end, size_t grain, Body&& body){
+            if(end <= begin) return;
+            grain = std::max<size_t>(1, grain);
+            if(end - begin <= grain){
+                body(begin, end);
+                return;
+            }
+            Counter counter;
+            for(auto first = begin; first < end; first += grain){
+                auto last = std::min(end, first + grain);
+                run([&body, first, last]{ body(first, last); }, counter);
+            }
+            wait(counter);
+        }
+
+        [[nodiscard]]
+        uint32_t workerCount() const {
+            return static_cast<uint32_t>(workers.size());
+        }
+
+    private:
+        void submit(Job* job);
+
+        Job* find();
+
+        void execute(Job* job);
+
+        void complete(Counter& counter, std::exception_ptr error);
+
+        void work(uint32_t index);
+
+        void idle();
+
+        std::vector<std::unique_ptr<detail::Deque>> deques;
+        std::vector<std::thread> workers;
+
+        std::mutex queueMutex;
+        std::deque<Job*> queue;  // jobs submitted from threads that are not workers
+        std::atomic<size_t> queueSize = 0;
+
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<int64_t> queued = 0;
+        std::atomic<uint32_t> sleepers = 0;
+        std::atomic_bool running = true;
+    };
+}
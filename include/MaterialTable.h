@@ -0,0 +1,110 @@
+#pragma once
+
+#include "common.h"
+#include "VulkanDevice.h"
+#include "VulkanDeleters.h"
+#include "VulkanDescriptorSet.h"
+#include "VulkanCommandBuffer.h"
+
+/**
+ * Material parameters of every object in one storage buffer and their textures as layers of one 2D
+ * array image, both behind a single descriptor set. Instances carry a material index instead of
+ * their own colours or textures, so objects that only look different share one mesh, one pipeline
+ * and one draw.
+ *
+ * Edits are kept on the CPU and update() records the range that changed with vkCmdUpdateBuffer
+ * ahead of the frame's render pass, recolouring an object is a few bytes in the command buffer
+ * rather than a new upload of its geometry. The barriers around the update order it against the
+ * frames still reading the buffer on the same queue.
+ *
+ * Texture layers all have the table's extent and get a full mip chain. Layer 0 is white, materials
+ * without a texture sample it.
+ */
+class MaterialTable{
+public:
+    using Id = uint32_t;
+
+    static constexpr VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+    static constexpr uint32_t WHITE_LAYER = 0;
+
+    // std430 layout, has to match struct Material in material.frag.glsl
+    struct Material{
+        glm::vec4 baseColor{ 1 };
+        uint32_t albedoLayer = WHITE_LAYER;
+        float roughness = 1.0f;
+        float metallic = 0.0f;
+        uint32_t padding = 0;
+    };
+    static_assert(sizeof(Material) == 32, "Material has to keep its std430 size");
+
+    MaterialTable() = default;
+
+    MaterialTable(VulkanDevice& device, uint32_t maxMaterials, VkExtent2D textureExtent, uint32_t textureLayers);
+
+    Id add(const Material& material);
+
+    void set(Id id, const Material& material);
+
+    [[nodiscard]]
+    const Material& get(Id id) const {
+        return materials.at(id);
+    }
+
+    // uploads width * height RGBA8 texels of the table's extent into the next free layer and returns it
+    uint32_t addTexture(Span<const uint8_t> texels);
+
+    // blits a level of a sampled image, in shader read only layout, into the next free layer and returns it
+    uint32_t addTexture(const VulkanImage& source, uint32_t level);
+
+    // records the changed materials, outside of a render pass, before the draws reading them
+    void update(VkCommandBuffer commandBuffer);
+
+    [[nodiscard]]
+    VkDescriptorSetLayout descriptorSetLayout() const {
+        return setLayout;
+    }
+
+    [[nodiscard]]
+    VkDescriptorSet descriptorSet() const {
+        return descriptors;
+    }
+
+    [[nodiscard]]
+    uint32_t size() const {
+        return COUNT(materials);
+    }
+
+    [[nodiscard]]
+    uint32_t textureCount() const {
+        return usedLayers;
+    }
+
+private:
+    void createTextureArray(VulkanDevice& device);
+
+    void createDescriptorSet(VkDevice device);
+
+    void generateMips(VkCommandBuffer commandBuffer, uint32_t layer);
+
+    void markDirty(Id id);
+
+    VulkanDevice* device = nullptr;
+    uint32_t maxMaterials = 0;
+    VkExtent2D textureExtent{ 0, 0 };
+    uint32_t textureLayers = 0;
+    uint32_t usedLayers = 0;
+
+    std::vector<Material> materials;
+    uint32_t dirtyBegin = 0;
+    uint32_t dirtyEnd = 0;
+
+    VulkanBuffer buffer;
+    VulkanImage textures;
+    VulkanImageView texturesView;
+    VulkanSampler sampler;
+    VulkanCommandPool commandPool;
+
+    VulkanDescriptorSetLayout setLayout;
+    VulkanDescriptorPool descriptorPool;
+    VulkanDescriptorSet descriptors;
+};
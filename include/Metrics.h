@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <spdlog/spdlog.h>
+
+/**
+ * In process metrics, named values published by subsystems (GPU pass statistics, budgets ...)
+ * that tools and the periodic stats dump can read without knowing who produced them
+ */
+namespace metrics {
+
+    class Registry{
+    public:
+        void set(const std::string& name, double value){
+            std::lock_guard<std::mutex> lock{ mutex };
+            values[name] = value;
+        }
+
+        void add(const std::string& name, double delta){
+            std::lock_guard<std::mutex> lock{ mutex };
+            values[name] += delta;
+        }
+
+        [[nodiscard]]
+        std::optional<double> get(const std::string& name) const {
+            std::lock_guard<std::mutex> lock{ mutex };
+            auto itr = values.find(name);
+            if(itr == values.end()) return {};
+            return itr->second;
+        }
+
+        [[nodiscard]]
+        std::map<std::string, double> snapshot() const {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return values;
+        }
+
+        void report() const {
+            for(auto& [name, value] : snapshot()){
+                spdlog::info("{}: {}", name, value);
+            }
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::map<std::string, double> values;
+    };
+
+    inline Registry& registry(){
+        static Registry instance;
+        return instance;
+    }
+}
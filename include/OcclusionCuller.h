@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include "common.h"
+#include "io.h"
+#include "Arena.h"
+#include "VulkanDevice.h"
+#include "VulkanDeleters.h"
+#include "VulkanDescriptorSet.h"
+#include "VulkanPipelineLayout.h"
+#include "VulkanPipeline.h"
+
+/**
+ * Two phase occlusion culling on the GPU against a hierarchical depth buffer (Hi-Z pyramid). Each
+ * mip of the pyramid keeps the farthest depth of the texels below it, an object whose nearest
+ * depth lies behind the farthest depth under its screen rectangle is hidden.
+ *
+ * Per frame, outside a render pass:
+ *  1. cullFirst tests every object against the pyramid of the previous frame, the survivors are
+ *     drawn with draw(commandBuffer, 0), which renders most of the occluders.
+ *  2. once that depth is written buildPyramid reduces it into the pyramid,
+ *  3. cullSecond tests the objects phase 1 rejected against the new pyramid, draw(commandBuffer, 1)
+ *     renders the ones that became visible this frame, so nothing pops in from using stale depth.
+ *
+ * Objects are bounding spheres, the draw lists are VkDrawIndexedIndirectCommand with firstInstance
+ * set to the object index, and the counts come from the GPU through vkCmdDrawIndexedIndirectCount,
+ * which requires the drawIndirectCount and drawIndirectFirstInstance features. All frames share
+ * the buffers and the pyramid, the barriers recorded order them across frames on one queue.
+ */
+class OcclusionCuller{
+public:
+    static constexpr uint32_t PHASES = 2;
+
+    OcclusionCuller() = default;
+
+    // depthViews are the depth attachments buildPyramid can reduce from, they must have extent depthExtent
+    OcclusionCuller(VulkanDevice& device, const io::fs::path& shaderDir, VkExtent2D depthExtent
+                    , Span<const VkImageView> depthViews, uint32_t maxObjects, uint32_t indexCount);
+
+    // world space bounding spheres, center in xyz and radius in w, indexed like the instances they bound
+    void setObjects(Span<const glm::vec4> spheres);
+
+    void cullFirst(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection);
+
+    // depth views[depth] has to be in DEPTH_STENCIL_READ_ONLY_OPTIMAL with its writes visible to compute shaders
+    void buildPyramid(VkCommandBuffer commandBuffer, uint32_t depth);
+
+    void cullSecond(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection);
+
+    // must be recorded in a render pass with the graphics pipeline and geometry bound
+    void draw(VkCommandBuffer commandBuffer, uint32_t phase) const;
+
+    // objects drawn by each phase of the last finished frame
+    [[nodiscard]]
+    std::array<uint32_t, PHASES> drawCounts() const;
+
+    [[nodiscard]]
+    uint32_t levels() const {
+        return pyramidLevels;
+    }
+
+private:
+    struct CullConstants{
+        glm::mat4 viewProjection;
+        uint32_t objectCount;
+        uint32_t phase;
+        uint32_t indexCount;
+        uint32_t levels;
+        glm::vec2 depthSize;
+    };
+
+    struct PyramidConstants{
+        glm::ivec2 sourceSize;
+        glm::ivec2 size;
+    };
+
+    void createPyramid(VulkanDevice& device);
+
+    void createPipelines(VkDevice device, const io::fs::path& shaderDir);
+
+    void createDescriptorSets(VkDevice device, Span<const VkImageView> depthViews);
+
+    void cull(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection, uint32_t phase);
+
+    [[nodiscard]]
+    VkExtent2D levelExtent(uint32_t level) const {
+        return { std::max(pyramidExtent.width >> level, 1u), std::max(pyramidExtent.height >> level, 1u) };
+    }
+
+    VkExtent2D depthExtent{};
+    VkExtent2D pyramidExtent{};
+    uint32_t pyramidLevels = 0;
+    uint32_t maxObjects = 0;
+    uint32_t objectCount = 0;
+    uint32_t indexCount = 0;
+
+    VulkanBuffer objects;
+    VulkanBuffer drawn;
+    VulkanBuffer counts;
+    VulkanBuffer draws;
+    VulkanImage pyramid;
+    VulkanImageView pyramidView;
+    std::vector<VulkanImageView> levelViews;
+    VulkanSampler sampler;
+
+    VulkanDescriptorSetLayout pyramidSetLayout;
+    VulkanDescriptorSetLayout cullSetLayout;
+    VulkanDescriptorPool descriptorPool;
+    std::vector<VulkanDescriptorSet> depthSets;     // per depth view, reduces it into level 0
+    std::vector<VulkanDescriptorSet> levelSets;     // reduces level i into level i + 1
+    VulkanDescriptorSet cullSet;
+
+    VulkanPipelineLayout pyramidLayout;
+    VulkanPipeline pyramidPipeline;
+    VulkanPipelineLayout cullLayout;
+    VulkanPipeline cullPipeline;
+};
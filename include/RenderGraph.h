@@ -0,0 +1,276 @@
+#pragma once
+
+#include <functional>
+#include "common.h"
+#include "VulkanDevice.h"
+#include "VulkanDeleters.h"
+#include "VulkanRenderPass.h"
+#include "VulkanFramebuffer.h"
+
+/**
+ * Frame described as passes that declare which images and buffers they read and write. compile()
+ * works out everything that used to be written by hand around them:
+ *  - passes whose results nobody reads are culled, outputs are imported resources given a final
+ *    layout (the swapchain image) and passes marked as having side effects,
+ *  - one batched pipeline barrier before each pass with just the layout transitions and memory
+ *    dependencies its accesses need, reads of a resource in the same layout share one barrier,
+ *  - render passes and framebuffers for the graphics passes, consecutive graphics passes that only
+ *    depend on each other through their attachments become subpasses of one render pass so tiled
+ *    GPUs keep those attachments on chip. Load and store ops follow from what comes before and
+ *    after, contents nobody reads are never loaded or stored,
+ *  - memory for the transient images the graph creates: attachment only images go into lazily
+ *    allocated memory where the device has it, the rest share allocations with transients whose
+ *    lifetimes don't overlap.
+ *
+ * With dynamic rendering (VK_KHR_dynamic_rendering, enabled on the device) graphics passes are
+ * recorded with vkCmdBeginRenderingKHR straight against their attachments' views, no render pass
+ * or framebuffer objects are created and pipelines are created from renderingInfo(). Every pass
+ * then begins its own rendering, so passes aren't merged into subpasses.
+ *
+ * Passes run in the order they were added. A compiled graph is recorded with execute() and can be
+ * recorded again every frame as long as its imported resources stay valid, transient images are
+ * reused by each recording so two recordings of one graph must not execute at the same time.
+ */
+class RenderGraph{
+public:
+    using Resource = uint32_t;
+
+    // how a pass uses a resource, each maps onto the pipeline stages, access and layout of that use
+    enum class Usage{
+        ColorAttachment,
+        DepthAttachment,
+        DepthRead,          // depth tested without writes
+        Sampled,            // fragment or compute shaders through a sampler
+        StorageRead,        // compute shaders
+        StorageWrite,       // compute shaders
+        Indirect,           // indirect draw or dispatch arguments
+        TransferSrc,
+        TransferDst
+    };
+
+    // graphics passes are recorded in a render pass over the attachments they use
+    enum class Queue{ Graphics, Compute };
+
+    // what an imported resource was last used for before the graph runs
+    struct State{
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+    };
+
+    struct ImageInfo{
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent{ 0, 0 };
+    };
+
+    class PassBuilder{
+    public:
+        PassBuilder& read(Resource resource, Usage usage);
+
+        // attachments that are written without clear() load what earlier passes left in them
+        PassBuilder& write(Resource resource, Usage usage);
+
+        PassBuilder& clear(Resource resource, VkClearValue value);
+
+        // the pass is kept even when nothing reads what it writes (readbacks, queries ...)
+        PassBuilder& sideEffect();
+
+    private:
+        friend class RenderGraph;
+
+        PassBuilder(RenderGraph& graph, uint32_t pass)
+        : graph(graph)
+        , pass(pass)
+        {}
+
+        RenderGraph& graph;
+        uint32_t pass;
+    };
+
+    using Setup = std::function<void(PassBuilder&)>;
+    using Execute = std::function<void(VkCommandBuffer)>;
+
+    struct Stats{
+        uint32_t passes = 0;
+        uint32_t culledPasses = 0;
+        uint32_t barriers = 0;              // image and buffer barriers recorded per execution
+        VkDeviceSize transientBytes = 0;    // transient images would take without aliasing
+        VkDeviceSize allocatedBytes = 0;    // actually allocated, lazily allocated memory is not counted
+    };
+
+    RenderGraph() = default;
+
+    explicit RenderGraph(VulkanDevice& device, bool dynamicRendering = false)
+    : device(&device)
+    , dynamicRendering(dynamicRendering)
+    {}
+
+    // an image that only lives within the graph, created and allocated by compile()
+    Resource createImage(const std::string& name, const ImageInfo& info);
+
+    // finalLayout is what the image is left in after the graph, any but UNDEFINED makes it an output
+    Resource importImage(const std::string& name, VkImage image, VkImageView view, const ImageInfo& info
+                         , const State& initial, VkImageLayout finalLayout);
+
+    Resource importBuffer(const std::string& name, VkBuffer buffer, const State& initial, bool output = false);
+
+    void addPass(const std::string& name, Queue queue, const Setup& setup, Execute execute);
+
+    void compile();
+
+    void execute(VkCommandBuffer commandBuffer) const;
+
+    // render pass and subpass a graphics pass is recorded in, for creating its pipelines. Render passes
+    // of graphs built the same way are compatible, pipelines can be shared between them. VK_NULL_HANDLE
+    // and 0 with dynamic rendering
+    [[nodiscard]]
+    VkRenderPass renderPass(const std::string& pass) const;
+
+    [[nodiscard]]
+    uint32_t subpass(const std::string& pass) const;
+
+    // attachment formats to chain into a pipeline's create info with dynamic rendering, nullptr without
+    [[nodiscard]]
+    const VkPipelineRenderingCreateInfoKHR* renderingInfo(const std::string& pass) const;
+
+    [[nodiscard]]
+    bool culled(const std::string& pass) const;
+
+    [[nodiscard]]
+    const Stats& stats() const {
+        return statistics;
+    }
+
+private:
+    static constexpr uint32_t NONE = ~0u;
+
+    struct Access{
+        Resource resource;
+        Usage usage;
+        bool write;
+    };
+
+    // everything one pass does to one resource, its accesses combined
+    struct Use{
+        Resource resource;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool write = false;
+        bool attachment = false;
+        bool clear = false;
+        VkClearValue clearValue{};
+    };
+
+    // where a resource's last accesses left it, for deciding what the next access has to wait for
+    struct Tracked{
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;        // reads since the last write
+        VkPipelineStageFlags visibleStages = 0;     // stages and accesses the last write is visible to
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    struct ResourceData{
+        std::string name;
+        bool isImage = true;
+        bool imported = false;
+        bool output = false;
+        ImageInfo info;
+        VkImageUsageFlags usage = 0;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        State initial;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        uint32_t firstPass = NONE;
+        uint32_t lastPass = NONE;
+        uint32_t aliasOf = NONE;        // transient that used the memory before this one
+        VulkanImage owned;
+        VulkanImageView ownedView;
+    };
+
+    // what one resource waits for before a use, a barrier or a subpass dependency once grouped
+    struct Transition{
+        Resource resource;
+        VkPipelineStageFlags srcStages;
+        VkAccessFlags srcAccess;
+        VkPipelineStageFlags dstStages;
+        VkAccessFlags dstAccess;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+    };
+
+    struct Barriers{
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        std::vector<VkImageMemoryBarrier> images;
+        std::vector<VkBufferMemoryBarrier> buffers;
+
+        void record(VkCommandBuffer commandBuffer) const;
+    };
+
+    struct Pass{
+        std::string name;
+        Queue queue = Queue::Graphics;
+        Execute execute;
+        std::vector<Access> accesses;
+        std::vector<std::pair<Resource, VkClearValue>> clears;
+        bool sideEffect = false;
+        bool live = false;
+        std::vector<Use> uses;
+        std::vector<Transition> transitions;
+        Barriers barriers;
+        uint32_t renderPass = NONE;
+        uint32_t subpass = 0;
+    };
+
+    struct RenderPass{
+        uint32_t firstPass = NONE;
+        uint32_t lastPass = NONE;
+        std::vector<Resource> attachments;
+        std::vector<VkSubpassDependency> dependencies;
+        VulkanRenderPass renderPass;
+        VulkanFramebuffer framebuffer;
+        VkExtent2D extent{ 0, 0 };
+        std::vector<VkClearValue> clearValues;
+
+        // dynamic rendering
+        std::vector<VkRenderingAttachmentInfoKHR> colorAttachments;
+        VkRenderingAttachmentInfoKHR depthAttachment{};
+        std::vector<VkFormat> colorFormats;
+        VkPipelineRenderingCreateInfoKHR renderingInfo{};
+    };
+
+    void combineUses();
+
+    void cull();
+
+    void allocate();
+
+    void planBarriers();
+
+    void groupRenderPasses();
+
+    void createRenderPasses();
+
+    bool transition(const Use& use, Tracked& state, Transition& transition) const;
+
+    void addBarrier(Barriers& barriers, const Transition& transition) const;
+
+    [[nodiscard]]
+    const Pass& find(const std::string& pass) const;
+
+    VulkanDevice* device = nullptr;
+    bool dynamicRendering = false;
+    PFN_vkCmdBeginRenderingKHR beginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR endRendering = nullptr;
+    std::vector<ResourceData> resources;
+    std::vector<Pass> passes;
+    std::vector<RenderPass> renderPasses;
+    std::vector<VulkanDeviceMemory> memory;
+    std::vector<Transition> finalTransitions;
+    Barriers finalBarriers;
+    Stats statistics;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "common.h"
+
+/**
+ * Flat scene graph. Nodes live in contiguous arrays kept in depth first order, so a parent always
+ * comes before its children and every subtree is the range [node, subtreeEnd[node]). Moving a node
+ * only marks it dirty, update() then recomputes world transforms and bounds of the dirty subtrees in
+ * one forward pass, which costs time proportional to what changed rather than to the scene size.
+ *
+ * Handles are generational indices into a slot table, they stay valid while the dense arrays are
+ * reordered and go stale once their node is destroyed. Structural changes that can't keep the
+ * order (adding under a parent whose subtree is not the last one, reparenting, destroying) are
+ * resolved by an O(n) rebuild at the next update().
+ */
+class Scene{
+public:
+    static constexpr uint32_t INVALID = ~0u;
+    static constexpr uint32_t NO_MESH = ~0u;
+
+    struct Handle{
+        uint32_t slot = INVALID;
+        uint32_t generation = 0;
+
+        [[nodiscard]]
+        bool valid() const {
+            return slot != INVALID;
+        }
+
+        bool operator==(const Handle& other) const {
+            return slot == other.slot && generation == other.generation;
+        }
+
+        bool operator!=(const Handle& other) const {
+            return !(*this == other);
+        }
+    };
+
+    struct Bounds{
+        glm::vec3 min{0};
+        glm::vec3 max{0};
+    };
+
+    Handle create(Handle parent, const glm::mat4& local, uint32_t mesh, const Bounds& bounds);
+
+    Handle create(Handle parent, const glm::mat4& local){
+        return create(parent, local, NO_MESH, Bounds{});
+    }
+
+    Handle create(Handle parent){
+        return create(parent, glm::mat4(1));
+    }
+
+    Handle create(){
+        return create(Handle{});
+    }
+
+    // destroys node and its whole subtree
+    void destroy(Handle node);
+
+    void setParent(Handle node, Handle parent);
+
+    void setLocal(Handle node, const glm::mat4& local);
+
+    void setMesh(Handle node, uint32_t mesh, const Bounds& bounds);
+
+    // applies structural changes and propagates dirty transforms, world data is stale until then
+    void update();
+
+    [[nodiscard]]
+    bool alive(Handle node) const {
+        return node.slot < slots.size() && slots[node.slot].generation == node.generation && slots[node.slot].dense != INVALID;
+    }
+
+    [[nodiscard]]
+    Handle parent(Handle node) const {
+        auto p = parents[dense(node)];
+        return p == INVALID ? Handle{} : Handle{ slotOf[p], slots[slotOf[p]].generation };
+    }
+
+    [[nodiscard]]
+    const glm::mat4& local(Handle node) const {
+        return locals[dense(node)];
+    }
+
+    [[nodiscard]]
+    const glm::mat4& world(Handle node) const {
+        return worlds[dense(node)];
+    }
+
+    [[nodiscard]]
+    const Bounds& worldBounds(Handle node) const {
+        return worldBoxes[dense(node)];
+    }
+
+    [[nodiscard]]
+    uint32_t mesh(Handle node) const {
+        return meshes[dense(node)];
+    }
+
+    // number of entries in the dense arrays, destroyed nodes are only dropped at update()
+    [[nodiscard]]
+    size_t size() const {
+        return parents.size();
+    }
+
+    /**
+     * Dense arrays in depth first order for systems that walk the whole scene (culling, drawing),
+     * valid until the next structural change. Destroyed entries have mesh NO_MESH.
+     */
+    std::vector<uint32_t> parents;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint32_t> meshes;
+    std::vector<Bounds> localBoxes;
+    std::vector<Bounds> worldBoxes;
+
+private:
+    struct Slot{
+        uint32_t dense = INVALID;
+        uint32_t generation = 0;
+    };
+
+    [[nodiscard]]
+    uint32_t dense(Handle node) const {
+        if(!alive(node)) throw std::runtime_error{ "stale scene handle" };
+        return slots[node.slot].dense;
+    }
+
+    void markDirty(uint32_t node);
+
+    void rebuild();
+
+    void propagate(uint32_t begin, uint32_t end);
+
+    std::vector<uint32_t> subtreeEnd;
+    std::vector<uint32_t> slotOf;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> dirtyNodes;
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    bool structureChanged = false;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "io.h"
+
+/**
+ * Always on timeline tracing. Every thread records into its own chunked buffer that only it writes,
+ * publishing events with a release store so write() can read them without locks; recording costs a
+ * clock read and a couple of stores. Timestamps are steady_clock nanoseconds, GPU events are converted
+ * onto the same clock before they are recorded. write() produces Chrome trace JSON (chrome://tracing,
+ * ui.perfetto.dev).
+ */
+namespace trace {
+
+    enum class Track : uint8_t { Cpu, Gpu };
+
+    struct Event{
+        const char* name;
+        const char* category;
+        uint64_t start;
+        uint64_t duration;
+        Track track;
+        char phase;
+    };
+
+    inline uint64_t now(){
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void setEnabled(bool enabled);
+
+    bool enabled();
+
+    void record(const Event& event);
+
+    inline void complete(const char* name, const char* category, uint64_t start, uint64_t end, Track track = Track::Cpu){
+        record({ name, category, start, end - start, track, 'X' });
+    }
+
+    inline void instant(const char* name, const char* category = "cpu"){
+        record({ name, category, now(), 0, Track::Cpu, 'i' });
+    }
+
+    // names passed to record must outlive the trace, intern copies dynamic names once
+    const char* intern(const std::string& name);
+
+    void setThreadName(const char* name);
+
+    void write(const io::fs::path& path);
+
+    class Scope{
+    public:
+        explicit Scope(const char* name, const char* category = "cpu")
+        : name(name)
+        , category(category)
+        , start(now())
+        {}
+
+        Scope(const Scope&) = delete;
+
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope(){
+            complete(name, category, start, now());
+        }
+
+    private:
+        const char* name;
+        const char* category;
+        uint64_t start;
+    };
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// interns a name built at runtime once per call site, the first name seen there is kept
+#define TRACE_NAME(name) [&]{ static const char* const traceName = trace::intern(name); return traceName; }()
+#define TRACE_SCOPE(...) trace::Scope TRACE_CONCAT(traceScope, __LINE__){ __VA_ARGS__ }
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
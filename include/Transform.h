@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include "Jobs.h"
+
+/**
+ * Batch transforms for large instance sets. Instances are kept as structure of arrays so the
+ * kernels can load eight (AVX2) or four (SSE) instances per register, the widest kernel the CPU
+ * supports is picked at runtime. Results are written as column major mat4s, 64 bytes per instance,
+ * which can go straight into mapped per-instance GPU memory.
+ */
+namespace transform {
+
+    enum class Isa{ Scalar, Sse, Avx2 };
+
+    struct Instances{
+        std::vector<float> tx, ty, tz;          // translation
+        std::vector<float> qx, qy, qz, qw;      // rotation, unit quaternion
+        std::vector<float> sx, sy, sz;          // scale
+
+        void resize(size_t count){
+            for(auto component : { &tx, &ty, &tz, &qx, &qy, &qz, &sx, &sy, &sz }){
+                component->resize(count, component == &sx || component == &sy || component == &sz ? 1.0f : 0.0f);
+            }
+            qw.resize(count, 1.0f);
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            return tx.size();
+        }
+    };
+
+    // widest instruction set available on this CPU
+    Isa detect();
+
+    const char* name(Isa isa);
+
+    /**
+     * mvps[i] = viewProjection * T * R * S and models[i] = T * R * S for every instance, either output
+     * may be null. Output pointers need no particular alignment.
+     */
+    void compute(const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models = nullptr);
+
+    void compute(Isa isa, const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models = nullptr);
+
+    // splits the batch into chunks run on the scheduler's workers and the calling thread
+    void compute(jobs::Scheduler& scheduler, const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models = nullptr);
+}
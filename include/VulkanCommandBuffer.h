@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeletionQueue.h"
 
 struct VulkanCommandPool{
 
@@ -25,8 +26,13 @@ struct VulkanCommandPool{
     }
 
     ~VulkanCommandPool(){
+        release();
+    }
+
+    void release(){
         if(pool){
-            vkDestroyCommandPool(device, pool, nullptr);
+            DeletionQueue::destroy([device = device, pool = pool]{ vkDestroyCommandPool(device, pool, nullptr); });
+            pool = VK_NULL_HANDLE;
         }
     }
 
@@ -34,6 +40,7 @@ struct VulkanCommandPool{
 
     VulkanCommandPool& operator=(VulkanCommandPool&& source) noexcept {
         if(this == &source) return *this;
+        release();
 
         this->device = source.device;
         this->pool = source.pool;
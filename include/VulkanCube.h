@@ -15,6 +15,21 @@
 #include "VulkanDeleters.h"
 #include "primitives.h"
 #include "VulkanDescriptorSet.h"
+#include "cooked.h"
+#include "AsyncIO.h"
+#include "VulkanTexture.h"
+#include "VulkanDeletionQueue.h"
+#include "FrameData.h"
+#include "GpuProfiler.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "Allocations.h"
+#include "RenderGraph.h"
+#include "CommandCache.h"
+#include "MaterialTable.h"
+#include <functional>
+#include <atomic>
+#include <ctime>
 
 template<typename T>
 struct Resource : public T{
@@ -22,8 +37,7 @@ struct Resource : public T{
     VulkanBuffer buffer;
 
     void flush(){
-        T data = *this;
-        buffer.copy(data, size);
+        buffer.copy(static_cast<T*>(this), size);
     }
 };
 
@@ -39,6 +53,7 @@ using Camera = Resource<mvp>;
 struct VulkanMesh{
     VulkanBuffer vertices;
     std::optional<VulkanBuffer> indices = {};
+    std::optional<VulkanBuffer> positions = {};     // tightly packed vertex positions for depth only passes
     VkDeviceSize size;
 };
 
@@ -50,13 +65,22 @@ public:
 
     void stop();
 
+    // marks the scene, camera or window state dirty, an on demand loop draws a frame for it. Thread safe
+    void requestRedraw();
+
 protected:
     void initGlfw();
 
     void mainLoop();
 
+    void applyCubeTexture();
+
+    void waitForRedraw();
+
     void drawFrame();
 
+    void reportStats();
+
     void initVulkan();
 
     void pickPhysicalDevice();
@@ -73,12 +97,16 @@ protected:
 
     void createMesh();
 
-    void createRenderPass();
+    VulkanMesh uploadMesh(VkDeviceSize vertexSize, VkDeviceSize indexSize, const std::function<void(char*, char*)>& fill);
+
+    void createRenderGraphs();
 
-    void createFrameBuffer();
+    void loadShaders();
 
     void createPipelineLayout();
 
+    void createMaterials();
+
     void createsPipeline();
 
     void createDescriptorPool();
@@ -91,35 +119,60 @@ protected:
 
     void createCommandBuffer();
 
+    VkCommandBuffer recordCommandBuffer(uint32_t imageIndex);
+
     void createSyncObjects();
 
     void createCamera();
 
+    void createTextureStreamer();
+
+    void createProfiler();
+
 protected:
     GLFWwindow* window;
     VulkanInstance instance;
     VulkanDebug debug;
     VulkanSurface surface;
     VulkanDevice device;
+    DeletionQueue deletionQueue;
     VulkanSwapChain swapChain;
-    VulkanRenderPass renderPass;
     VulkanPipelineLayout pipelineLayout;
     VulkanPipeline graphicsPipeline;
+    VulkanPipeline depthPipeline;
     VulkanCommandPool commandPool;
     VulkanDescriptorPool descriptorPool;
     VkDescriptorSetLayout descriptorSetLayout;
-
-    std::vector<VulkanFramebuffer> framebuffers;
-    std::vector<VkCommandBuffer> commandBuffers;
+    MaterialTable materials;
+    MaterialTable::Id cubeMaterial = 0;
+    TextureStreamer textureStreamer;
+    GpuProfiler profiler;
+
+    // one per swapchain image, like the cached command buffers executing them
+    std::vector<RenderGraph> renderGraphs;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    bool depthPrePass = false;
+    bool dynamicRendering = false;
+    bool onDemand = false;
+    std::atomic<bool> redrawRequested{ true };
+    double idleSeconds = 0;
+    double idleCpuSeconds = 0;
+
+    CommandCache commandCache;
     std::vector<VulkanDescriptorSet> descriptorSets;
 
-    VulkanSemaphore imageAcquired;
-    VulkanSemaphore renderingFinished;
+    std::array<FrameData, MAX_FRAMES_IN_FLIGHT> frames;
+    std::vector<VkFence> imagesInFlight;
+    uint64_t frameNumber = 0;
 
     ExtensionsAndValidationLayers instanceExtensionsAndValidationLayers;
     ExtensionsAndValidationLayers deviceExtensionsAndValidationLayers;
 
+    io::AsyncReader fileReader;
+    io::ReadBatch shaderLoads;
+
     std::vector<VkClearColorValue> clearColors;
     VulkanMesh cube;
+    std::shared_ptr<Texture> cubeTexture;     // streamed until applyCubeTexture() copies it into the material table
     std::vector<Camera> camera;
 };
\ No newline at end of file
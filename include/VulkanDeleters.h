@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "VulkanDeletionQueue.h"
 
 template<typename Handle, typename Deleter>
 struct VulkanHandle{
@@ -21,15 +22,14 @@ struct VulkanHandle{
     }
 
     ~VulkanHandle(){
-        if(handle){
-            Deleter()(device, handle);
-        }
+        release();
     }
 
     VulkanHandle& operator=(const VulkanHandle&) = delete;
 
     VulkanHandle& operator=(VulkanHandle&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->device = source.device;
         this->handle = source.handle;
 
@@ -46,6 +46,13 @@ struct VulkanHandle{
 //        return &handle;
 //    }
 
+    void release(){
+        if(handle){
+            DeletionQueue::destroy([device = device, handle = handle]{ Deleter()(device, handle); });
+            handle = VK_NULL_HANDLE;
+        }
+    }
+
     VkDevice device = VK_NULL_HANDLE;
     Handle handle = VK_NULL_HANDLE;
 };
@@ -66,3 +73,15 @@ struct Resource##Deleter{ \
 using Vulkan##Resource = VulkanHandle<Vk##Resource, Resource##Deleter>;
 
 MANAGE_VULKAN(Semaphore)
+MANAGE_VULKAN(Fence)
+MANAGE_VULKAN(ImageView)
+MANAGE_VULKAN(Sampler)
+MANAGE_VULKAN(QueryPool)
+MANAGE_VULKAN(DescriptorSetLayout)
+
+struct DeviceMemoryDeleter{
+    inline void operator()(VkDevice device, VkDeviceMemory memory){
+        vkFreeMemory(device, memory, nullptr);
+    }
+};
+using VulkanDeviceMemory = VulkanHandle<VkDeviceMemory, DeviceMemoryDeleter>;
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include "common.h"
+
+/**
+ * Defers destruction of Vulkan objects until the GPU has retired every frame that could still
+ * reference them. Wrappers hand their handles to the active queue tagged with the frame being
+ * recorded, the renderer retires frames as their fences signal and everything tagged with a
+ * retired frame is destroyed in one batch. With no active queue objects are destroyed right away.
+ */
+class DeletionQueue{
+public:
+    DISABLE_COPY(DeletionQueue)
+
+    DeletionQueue() = default;
+
+    ~DeletionQueue(){
+        flush();
+        if(active == this){
+            active = nullptr;
+        }
+    }
+
+    void makeActive(){
+        active = this;
+    }
+
+    // objects released from now on may still be referenced by frame
+    void beginFrame(uint64_t frame){
+        std::lock_guard<std::mutex> lock{ mutex };
+        currentFrame = frame;
+    }
+
+    // the GPU has finished frame and every frame before it, reuses one buffer so idle frames don't allocate
+    void retire(uint64_t frame){
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            while(!entries.empty() && entries.front().frame <= frame){
+                retired.push_back(std::move(entries.front()));
+                entries.pop_front();
+            }
+        }
+        for(auto& entry : retired){
+            entry.destroy();
+        }
+        retired.clear();
+    }
+
+    // caller guarantees the device is idle
+    void flush(){
+        std::deque<Entry> retired;
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            retired.swap(entries);
+        }
+        for(auto& entry : retired){
+            entry.destroy();
+        }
+    }
+
+    [[nodiscard]]
+    size_t size() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        return entries.size();
+    }
+
+    template<typename Destroy>
+    static void destroy(Destroy&& destroy){
+        if(active){
+            active->push(std::forward<Destroy>(destroy));
+        }else{
+            destroy();
+        }
+    }
+
+private:
+    struct Entry{
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+
+    void push(std::function<void()> destroy){
+        std::lock_guard<std::mutex> lock{ mutex };
+        entries.push_back({ currentFrame, std::move(destroy) });
+    }
+
+    static DeletionQueue* active;
+
+    std::mutex mutex;
+    std::deque<Entry> entries;
+    std::vector<Entry> retired;
+    uint64_t currentFrame = 0;
+};
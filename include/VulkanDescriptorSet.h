@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeletionQueue.h"
+#include "Arena.h"
 
 struct VulkanDescriptorSet{
     DISABLE_COPY(VulkanDescriptorSet)
@@ -21,6 +23,7 @@ struct VulkanDescriptorSet{
 
     VulkanDescriptorSet& operator=(VulkanDescriptorSet&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->device = source.device;
         this->pool = source.pool;
         this->descriptorSet = source.descriptorSet;
@@ -31,8 +34,13 @@ struct VulkanDescriptorSet{
     }
 
     ~VulkanDescriptorSet(){
+        release();
+    }
+
+    void release(){
         if(descriptorSet){
-            vkFreeDescriptorSets(device, pool, 1, &descriptorSet);
+            DeletionQueue::destroy([device = device, pool = pool, descriptorSet = descriptorSet]{ vkFreeDescriptorSets(device, pool, 1, &descriptorSet); });
+            descriptorSet = VK_NULL_HANDLE;
         }
     }
 
@@ -51,11 +59,12 @@ struct VulkanDescriptorPool{
 
     VulkanDescriptorPool() = default;
 
-    VulkanDescriptorPool(VkDevice device, uint32_t maxSet, const std::vector<VkDescriptorPoolSize>& poolSizes)
+    VulkanDescriptorPool(VkDevice device, uint32_t maxSet, const std::vector<VkDescriptorPoolSize>& poolSizes, VkDescriptorPoolCreateFlags flags = 0)
     :device(device)
     {
         VkDescriptorPoolCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.flags = flags;
         createInfo.maxSets = maxSet;
         createInfo.poolSizeCount = COUNT(poolSizes);
         createInfo.pPoolSizes = poolSizes.data();
@@ -68,13 +77,19 @@ struct VulkanDescriptorPool{
     }
 
     ~VulkanDescriptorPool(){
+        release();
+    }
+
+    void release(){
         if(pool){
-            vkDestroyDescriptorPool(device, pool, VK_NULL_HANDLE);
+            DeletionQueue::destroy([device = device, pool = pool]{ vkDestroyDescriptorPool(device, pool, VK_NULL_HANDLE); });
+            pool = VK_NULL_HANDLE;
         }
     }
 
     VulkanDescriptorPool& operator=(VulkanDescriptorPool&& source) noexcept {
         if(this == &source) return *this;
+        release();
 
         this->device = source.device;
         this->pool = source.pool;
@@ -85,17 +100,18 @@ struct VulkanDescriptorPool{
     }
 
     [[nodiscard]]
-    std::vector<VulkanDescriptorSet> allocate(const std::vector<VkDescriptorSetLayout>& layouts) const {
+    std::vector<VulkanDescriptorSet> allocate(Span<const VkDescriptorSetLayout> layouts) const {
         VkDescriptorSetAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.descriptorPool = pool;
         allocInfo.descriptorSetCount = COUNT(layouts);
         allocInfo.pSetLayouts = layouts.data();
 
-        std::vector<VkDescriptorSet> sets(layouts.size());
+        SmallVector<VkDescriptorSet, 8> sets(layouts.size());
         vkAllocateDescriptorSets(device, &allocInfo, sets.data());
 
         std::vector<VulkanDescriptorSet> vSets;
+        vSets.reserve(sets.size());
         for(auto& set : sets){
             vSets.emplace_back(device, pool, set);
         }
@@ -2,6 +2,8 @@
 
 #include "common.h"
 #include "VulkanResource.h"
+#include "VulkanMemory.h"
+#include "Arena.h"
 
 struct VulkanDevice{
 
@@ -41,6 +43,9 @@ struct VulkanDevice{
         logicalDevice = source.logicalDevice;
         queueFamilyIndex = source.queueFamilyIndex;
         queues = source.queues;
+        memoryBudget = source.memoryBudget;
+        enabledExtensions = std::move(source.enabledExtensions);
+        enabledFeatures = source.enabledFeatures;
 
         source.physicalDevice = VK_NULL_HANDLE;
         source.logicalDevice = VK_NULL_HANDLE;
@@ -110,6 +115,11 @@ struct VulkanDevice{
 
         ASSERT(vkCreateDevice(physicalDevice, &createInfo, nullptr, &logicalDevice));
         initQueues();
+
+        this->enabledExtensions.assign(begin(enabledExtensions), end(enabledExtensions));
+        this->enabledFeatures = enabledFeatures;
+        memoryBudget.supported = extensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        updateMemoryBudget();
     }
 
     inline void initQueues(){
@@ -168,24 +178,88 @@ struct VulkanDevice{
         return memoryProperties;
     }
 
-    bool supportsMemoryType(VkMemoryPropertyFlags flags){
+    bool supportsMemoryType(VkMemoryPropertyFlags flags) const {
+        auto memoryProps = getMemoryProperties();
+        for(auto i = 0u; i < memoryProps.memoryTypeCount; i++){
+            if((memoryProps.memoryTypes[i].propertyFlags & flags) == flags){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // device local memory the host can map beyond the legacy 256MB BAR window
+    bool hasResizableBar() const {
         auto memoryProps = getMemoryProperties();
-        for(auto i = 0; i < memoryProps.memoryTypeCount; i++){
-            if((memoryProps.memoryTypes[i].propertyFlags & flags)){
+        constexpr VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        for(auto i = 0u; i < memoryProps.memoryTypeCount; i++){
+            auto& type = memoryProps.memoryTypes[i];
+            if((type.propertyFlags & flags) == flags && memoryProps.memoryHeaps[type.heapIndex].size > 256 * 1024 * 1024){
                 return true;
             }
         }
         return false;
     }
 
-    uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags memoryPropertyFlags){
+    uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags memoryPropertyFlags) const {
+        auto candidates = memoryTypeCandidates(memoryTypeBits, memoryPropertyFlags);
+        if(candidates.empty()) throw std::runtime_error{"no memory type supports the requested properties"};
+        return candidates.front();
+    }
+
+    std::vector<uint32_t> memoryTypeCandidates(uint32_t memoryTypeBits, VkMemoryPropertyFlags memoryPropertyFlags) const {
         auto memoryProperties = getMemoryProperties();
+        std::vector<uint32_t> candidates;
         for(uint32_t memoryIndex = 0u; memoryIndex < memoryProperties.memoryTypeCount; memoryIndex++){
-            if((( 1 << memoryIndex) & memoryTypeBits) && (memoryProperties.memoryTypes[memoryIndex].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags){
-                return memoryIndex;
+            if((( 1u << memoryIndex) & memoryTypeBits) && (memoryProperties.memoryTypes[memoryIndex].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags){
+                candidates.push_back(memoryIndex);
+            }
+        }
+        return candidates;
+    }
+
+    std::vector<uint32_t> memoryTypeCandidates(uint32_t memoryTypeBits, MemoryUsage usage) const {
+        return rankMemoryTypes(getMemoryProperties(), memoryTypeBits, usage);
+    }
+
+    // call once per frame, picks up budget changes caused by this and other processes
+    void updateMemoryBudget(){
+        memoryBudget.update(physicalDevice);
+    }
+
+    /**
+     * Allocates from the first candidate whose heap is within budget, spilling down the list
+     * under memory pressure. Only when every heap is over budget is the budget ignored and
+     * the driver left to decide, running out of memory altogether throws.
+     */
+    VkDeviceMemory allocateMemory(const VkMemoryRequirements& memoryRequirements, const std::vector<uint32_t>& candidates){
+        auto memoryProperties = getMemoryProperties();
+        for(auto withinBudget : { true, false }){
+            for(auto memoryTypeIndex : candidates){
+                auto heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+                if(withinBudget && !memoryBudget.fits(heapIndex, memoryRequirements.size)) continue;
+
+                VkMemoryAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                allocInfo.allocationSize = memoryRequirements.size;
+                allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+                VkDeviceMemory memory;
+                auto result = vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &memory);
+                if(result == VK_SUCCESS){
+                    memoryBudget.allocated(heapIndex, memoryRequirements.size);
+                    if(memoryTypeIndex != candidates.front()){
+                        spdlog::debug("memory pressure: {} bytes spilled to memory type {} on heap {}", memoryRequirements.size, memoryTypeIndex, heapIndex);
+                    }
+                    return memory;
+                }
+                if(result != VK_ERROR_OUT_OF_DEVICE_MEMORY && result != VK_ERROR_OUT_OF_HOST_MEMORY){
+                    throw std::runtime_error{"failed to allocate device memory, error: " + std::to_string(result)};
+                }
             }
+            if(!memoryBudget.supported) break;
         }
-        assert(false);
+        throw std::runtime_error{"out of device memory allocating " + std::to_string(memoryRequirements.size) + " bytes"};
     }
 
     inline bool extensionSupported(const char* extension) noexcept {
@@ -195,39 +269,85 @@ struct VulkanDevice{
         });
     }
 
-    VulkanBuffer createBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, std::set<uint32_t> queueIndices = {}){
+    [[nodiscard]]
+    bool extensionEnabled(const char* extension) const {
+        return std::find(begin(enabledExtensions), end(enabledExtensions), extension) != end(enabledExtensions);
+    }
+
+    /**
+     * memoryPlacement is either a MemoryUsage, letting the device pick the best memory type,
+     * or VkMemoryPropertyFlags every candidate memory type must have
+     */
+    template<typename MemoryPlacement>
+    VulkanBuffer createBuffer(VkBufferUsageFlags usage, MemoryPlacement memoryPlacement, VkDeviceSize size, SmallVector<uint32_t, 4> queueIndices = {}){
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
+        std::sort(queueIndices.begin(), queueIndices.end());
+        queueIndices.resize(std::unique(queueIndices.begin(), queueIndices.end()) - queueIndices.begin());
         if(!queueIndices.empty()){
-            std::vector<uint32_t> pIndices{queueIndices.begin(), queueIndices.end()};
             bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-            bufferInfo.queueFamilyIndexCount = queueIndices.size();
-            bufferInfo.pQueueFamilyIndices = pIndices.data();
+            bufferInfo.queueFamilyIndexCount = COUNT(queueIndices);
+            bufferInfo.pQueueFamilyIndices = queueIndices.data();
         }else{
             bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         }
         VkBuffer buffer;
-        vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer);
+        ASSERT(vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer));
         VkMemoryRequirements memoryRequirements;
         vkGetBufferMemoryRequirements(logicalDevice, buffer, &memoryRequirements);
 
-        auto memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memoryRequirements.size;
-        allocInfo.memoryTypeIndex = memoryTypeIndex;
-
         VkDeviceMemory memory;
-        vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &memory);
+        try{
+            memory = allocateMemory(memoryRequirements, memoryTypeCandidates(memoryRequirements.memoryTypeBits, memoryPlacement));
+        }catch(...){
+            vkDestroyBuffer(logicalDevice, buffer, nullptr);
+            throw;
+        }
 
         vkBindBufferMemory(logicalDevice, buffer, memory, 0);
 
         return VulkanBuffer{logicalDevice, buffer, memory, size};
     }
 
+    template<typename MemoryPlacement>
+    VulkanImage createImage(const VkImageCreateInfo& createInfo, MemoryPlacement memoryPlacement){
+        VkImage image;
+        ASSERT(vkCreateImage(logicalDevice, &createInfo, nullptr, &image));
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetImageMemoryRequirements(logicalDevice, image, &memoryRequirements);
+
+        VkDeviceMemory memory;
+        try{
+            memory = allocateMemory(memoryRequirements, memoryTypeCandidates(memoryRequirements.memoryTypeBits, memoryPlacement));
+        }catch(...){
+            vkDestroyImage(logicalDevice, image, nullptr);
+            throw;
+        }
+        vkBindImageMemory(logicalDevice, image, memory, 0);
+
+        return VulkanImage{logicalDevice, image, memory, createInfo.format, createInfo.extent, createInfo.mipLevels, memoryRequirements.size};
+    }
+
+    inline VkFormatProperties getFormatProperties(VkFormat format) const {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+        return properties;
+    }
+
+    // first of candidates, in order of preference, with every feature under optimal tiling
+    [[nodiscard]]
+    VkFormat findSupportedFormat(Span<const VkFormat> candidates, VkFormatFeatureFlags features) const {
+        for(auto format : candidates){
+            if((getFormatProperties(format).optimalTilingFeatures & features) == features){
+                return format;
+            }
+        }
+        return VK_FORMAT_UNDEFINED;
+    }
+
     operator VkDevice() const {
         return logicalDevice;
     }
@@ -238,4 +358,7 @@ struct VulkanDevice{
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice logicalDevice = VK_NULL_HANDLE;
+    MemoryBudget memoryBudget;
+    std::vector<std::string> enabledExtensions;
+    VkPhysicalDeviceFeatures enabledFeatures{};
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeletionQueue.h"
 
 struct VulkanFramebuffer{
 
@@ -30,8 +31,13 @@ struct VulkanFramebuffer{
     }
 
     ~VulkanFramebuffer(){
+        release();
+    }
+
+    void release(){
         if(frameBuffer){
-            vkDestroyFramebuffer(device, frameBuffer, nullptr);
+            DeletionQueue::destroy([device = device, frameBuffer = frameBuffer]{ vkDestroyFramebuffer(device, frameBuffer, nullptr); });
+            frameBuffer = VK_NULL_HANDLE;
         }
     }
 
@@ -39,6 +45,7 @@ struct VulkanFramebuffer{
 
     VulkanFramebuffer& operator=(VulkanFramebuffer&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->device = source.device;
         this->frameBuffer = source.frameBuffer;
 
@@ -52,5 +59,5 @@ struct VulkanFramebuffer{
     }
 
     VkDevice device = VK_NULL_HANDLE;
-    VkFramebuffer frameBuffer;
+    VkFramebuffer frameBuffer = VK_NULL_HANDLE;
 };
\ No newline at end of file
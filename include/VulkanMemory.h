@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <bitset>
+#include <vulkan/vulkan.h>
+
+/**
+ * Where an allocation's data is produced and consumed, VulkanDevice maps this onto the best
+ * memory type the device offers instead of callers hand coding property flags and fallbacks
+ */
+enum class MemoryUsage{
+    GpuOnly,        // written by transfers or shaders, never touched by the host
+    CpuOnly,        // host staging memory, kept out of device local heaps
+    CpuToGpu,       // written by the host every frame, read by the device (uniforms, dynamic vertices)
+    GpuToCpu,       // written by the device, read back on the host
+    Transient       // attachments that only live within a render pass
+};
+
+struct MemoryTypePreference{
+    VkMemoryPropertyFlags required = 0;
+    VkMemoryPropertyFlags preferred = 0;
+    VkMemoryPropertyFlags notPreferred = 0;
+};
+
+inline MemoryTypePreference memoryTypePreference(MemoryUsage usage){
+    switch(usage){
+        case MemoryUsage::GpuOnly:
+            return { 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+        case MemoryUsage::CpuOnly:
+            return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0
+                     , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+        case MemoryUsage::CpuToGpu:
+            // device local + host visible is the BAR window, or all of vram when resizable BAR is on
+            return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                     , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+        case MemoryUsage::GpuToCpu:
+            return { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                     , VK_MEMORY_PROPERTY_HOST_CACHED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+        case MemoryUsage::Transient:
+            return { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+                     , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT };
+    }
+    return {};
+}
+
+/**
+ * Memory types allowed by memoryTypeBits that have every required flag, best match first.
+ * Each missing preferred flag and each present unwanted flag costs one point, ties keep
+ * the driver's order. Lazily allocated types are only offered to transient usage.
+ */
+inline std::vector<uint32_t> rankMemoryTypes(const VkPhysicalDeviceMemoryProperties& properties, uint32_t memoryTypeBits, MemoryUsage usage){
+    auto preference = memoryTypePreference(usage);
+    std::vector<std::pair<size_t, uint32_t>> candidates;
+    for(uint32_t i = 0; i < properties.memoryTypeCount; i++){
+        auto flags = properties.memoryTypes[i].propertyFlags;
+        if(!((1u << i) & memoryTypeBits) || (flags & preference.required) != preference.required) continue;
+        if(usage != MemoryUsage::Transient && (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) continue;
+
+        auto cost = std::bitset<32>(preference.preferred & ~flags).count() + std::bitset<32>(preference.notPreferred & flags).count();
+        candidates.emplace_back(cost, i);
+    }
+    std::stable_sort(begin(candidates), end(candidates), [](auto& a, auto& b){ return a.first < b.first; });
+
+    std::vector<uint32_t> ranked;
+    ranked.reserve(candidates.size());
+    for(auto& [cost, index] : candidates){
+        ranked.push_back(index);
+    }
+    return ranked;
+}
+
+/**
+ * Per heap budget and usage as reported by VK_EXT_memory_budget, refreshed once a frame.
+ * Allocations made since the last refresh are added on top so a burst of allocations
+ * within one frame still sees the pressure it creates. Without the extension nothing
+ * is known about other processes, so every heap is treated as having room and pressure
+ * only shows up as allocation failures.
+ */
+struct MemoryBudget{
+    bool supported = false;
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS]{};
+    VkDeviceSize usage[VK_MAX_MEMORY_HEAPS]{};
+    VkDeviceSize allocatedSinceUpdate[VK_MAX_MEMORY_HEAPS]{};
+
+    void update(VkPhysicalDevice physicalDevice){
+        if(!supported) return;
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+        std::copy(std::begin(budgetProperties.heapBudget), std::end(budgetProperties.heapBudget), budget);
+        std::copy(std::begin(budgetProperties.heapUsage), std::end(budgetProperties.heapUsage), usage);
+        std::fill(std::begin(allocatedSinceUpdate), std::end(allocatedSinceUpdate), 0);
+    }
+
+    [[nodiscard]]
+    bool fits(uint32_t heapIndex, VkDeviceSize size) const {
+        if(!supported) return true;
+        return usage[heapIndex] + allocatedSinceUpdate[heapIndex] + size <= budget[heapIndex];
+    }
+
+    void allocated(uint32_t heapIndex, VkDeviceSize size){
+        allocatedSinceUpdate[heapIndex] += size;
+    }
+};
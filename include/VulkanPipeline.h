@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeletionQueue.h"
 
 struct VulkanPipeline{
 
@@ -19,8 +20,13 @@ struct VulkanPipeline{
     }
 
     ~VulkanPipeline(){
+        release();
+    }
+
+    void release(){
         if(pipeline){
-            vkDestroyPipeline(device, pipeline, nullptr);
+            DeletionQueue::destroy([device = device, pipeline = pipeline]{ vkDestroyPipeline(device, pipeline, nullptr); });
+            pipeline = VK_NULL_HANDLE;
         }
     }
 
@@ -28,6 +34,7 @@ struct VulkanPipeline{
 
     VulkanPipeline& operator=(VulkanPipeline&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->device = source.device;
         this->pipeline = source.pipeline;
 
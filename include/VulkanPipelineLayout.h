@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "VulkanDeletionQueue.h"
 
 struct VulkanPipelineLayout{
 
@@ -28,8 +29,13 @@ struct VulkanPipelineLayout{
     }
 
     ~VulkanPipelineLayout(){
+        release();
+    }
+
+    void release(){
         if(pipelineLayout){
-            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+            DeletionQueue::destroy([device = device, pipelineLayout = pipelineLayout]{ vkDestroyPipelineLayout(device, pipelineLayout, nullptr); });
+            pipelineLayout = VK_NULL_HANDLE;
         }
     }
 
@@ -37,6 +43,7 @@ struct VulkanPipelineLayout{
 
     VulkanPipelineLayout& operator=(VulkanPipelineLayout&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->pipelineLayout = source.pipelineLayout;
         this->device = source.device;
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "VulkanDeletionQueue.h"
+
 struct VulkanRenderPass{
 
     VulkanRenderPass() = default;
@@ -29,8 +31,13 @@ struct VulkanRenderPass{
     }
 
     ~VulkanRenderPass(){
+        release();
+    }
+
+    void release(){
         if(renderPass){
-            vkDestroyRenderPass(device, renderPass, nullptr);
+            DeletionQueue::destroy([device = device, renderPass = renderPass]{ vkDestroyRenderPass(device, renderPass, nullptr); });
+            renderPass = VK_NULL_HANDLE;
         }
     }
 
@@ -38,6 +45,7 @@ struct VulkanRenderPass{
 
     VulkanRenderPass& operator=(VulkanRenderPass&& source) noexcept {
         if(this == &source) return *this;
+        release();
         this->device = source.device;
         this->renderPass = source.renderPass;
 
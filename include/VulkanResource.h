@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include "VulkanDeletionQueue.h"
 
 struct VulkanBuffer{
 
@@ -22,9 +23,12 @@ struct VulkanBuffer{
     VulkanBuffer& operator=(const VulkanBuffer&) = delete;
 
     VulkanBuffer& operator=(VulkanBuffer&& source) noexcept{
+        if(this == &source) return *this;
+        release();
         device = source.device;
         buffer = source.buffer;
         memory = source.memory;
+        size = source.size;
 
         source.device = VK_NULL_HANDLE;
         source.buffer = VK_NULL_HANDLE;
@@ -40,10 +44,29 @@ struct VulkanBuffer{
         vkUnmapMemory(device, memory);
     }
 
+    [[nodiscard]]
+    void* map(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const {
+        void* dest;
+        vkMapMemory(device, memory, offset, size, 0, &dest);
+        return dest;
+    }
+
+    void unmap() const {
+        vkUnmapMemory(device, memory);
+    }
+
     ~VulkanBuffer(){
+        release();
+    }
+
+    void release(){
         if(buffer){
-            vkDestroyBuffer(device, buffer, nullptr);
-            vkFreeMemory(device, memory, nullptr);
+            DeletionQueue::destroy([device = device, buffer = buffer, memory = memory]{
+                vkDestroyBuffer(device, buffer, nullptr);
+                vkFreeMemory(device, memory, nullptr);
+            });
+            buffer = VK_NULL_HANDLE;
+            memory = VK_NULL_HANDLE;
         }
     }
 
@@ -56,3 +79,70 @@ struct VulkanBuffer{
     VkDeviceMemory memory = VK_NULL_HANDLE;
     VkDeviceSize  size = 0;
 };
+
+struct VulkanImage{
+
+    VulkanImage() = default;
+
+    inline VulkanImage(VkDevice device, VkImage image, VkDeviceMemory memory, VkFormat format, VkExtent3D extent, uint32_t mipLevels, VkDeviceSize size)
+    : device(device)
+    , image(image)
+    , memory(memory)
+    , format(format)
+    , extent(extent)
+    , mipLevels(mipLevels)
+    , size(size)
+    {}
+
+    VulkanImage(const VulkanImage&) = delete;
+
+    VulkanImage(VulkanImage&& source) noexcept {
+        operator=(static_cast<VulkanImage&&>(source));
+    }
+
+    VulkanImage& operator=(const VulkanImage&) = delete;
+
+    VulkanImage& operator=(VulkanImage&& source) noexcept{
+        if(this == &source) return *this;
+        release();
+        device = source.device;
+        image = source.image;
+        memory = source.memory;
+        format = source.format;
+        extent = source.extent;
+        mipLevels = source.mipLevels;
+        size = source.size;
+
+        source.image = VK_NULL_HANDLE;
+        source.memory = VK_NULL_HANDLE;
+
+        return *this;
+    }
+
+    ~VulkanImage(){
+        release();
+    }
+
+    void release(){
+        if(image){
+            DeletionQueue::destroy([device = device, image = image, memory = memory]{
+                vkDestroyImage(device, image, nullptr);
+                vkFreeMemory(device, memory, nullptr);
+            });
+            image = VK_NULL_HANDLE;
+            memory = VK_NULL_HANDLE;
+        }
+    }
+
+    operator VkImage() const {
+        return image;
+    }
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D extent{0, 0, 0};
+    uint32_t mipLevels = 0;
+    VkDeviceSize size = 0;
+};
@@ -10,13 +10,17 @@ struct VulkanShaderModule{
     VulkanShaderModule() = default;
 
     explicit VulkanShaderModule(VkDevice device, const io::fs::path& path)
+    :VulkanShaderModule(device, io::load(path))
+    {
+    }
+
+    VulkanShaderModule(VkDevice device, const io::byte_string& code)
     :device(device)
     {
-        auto code = io::load(path);
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
         createInfo.codeSize = COUNT(code);
-        createInfo.pCode = reinterpret_cast<uint32_t*>(code.data());
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
         ASSERT(vkCreateShaderModule(device, &createInfo, nullptr, &module));
     }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+#include "VulkanDevice.h"
+#include "VulkanCommandBuffer.h"
+#include "VulkanDeleters.h"
+#include "Initializers.h"
+#include "ktx2.h"
+#include "GpuProfiler.h"
+
+struct Texture{
+    VulkanImage image;
+    VulkanImageView view;
+    VulkanSampler sampler;
+    uint32_t residentLevel = 0;     // finest mip level of image covered by view
+    uint32_t version = 0;           // bumped whenever view is recreated, descriptors referencing it need rewriting
+
+    [[nodiscard]]
+    bool usable() const {
+        return residentLevel < image.mipLevels;
+    }
+
+    [[nodiscard]]
+    bool complete() const {
+        return residentLevel == 0;
+    }
+};
+
+/**
+ * Streams KTX2 textures into device local images. Levels are uploaded coarsest first, a bounded number
+ * of bytes per update(), and each texture's view grows to cover finer levels as they arrive so textures
+ * can be sampled long before the full chain is resident. Textures without a mip chain have it generated
+ * with vkCmdBlitImage when the format supports linear blits.
+ *
+ * Images are sized against budget: when a texture does not fit, its finest levels are never allocated.
+ * A texture that doesn't fit even without them is refused, load() throws and nothing is allocated.
+ * Nothing is evicted to make room, memory comes back when the last reference to a texture goes.
+ */
+class TextureStreamer{
+public:
+    TextureStreamer() = default;
+
+    TextureStreamer(VulkanDevice& device, VkDeviceSize budget, VkDeviceSize bytesPerUpdate = 8 * 1024 * 1024);
+
+    // throws when the texture can't be made to fit the remaining budget
+    std::shared_ptr<Texture> load(const io::fs::path& path);
+
+    // call once per frame, publishes finished uploads and records the next batch of levels, scratch lists come from arena
+    void update(FrameArena& arena);
+
+    // times each upload batch in the given profiler pool, reserved for this streamer
+    void profile(GpuProfiler& gpuProfiler, uint32_t pool){
+        profiler = &gpuProfiler;
+        profilerPool = pool;
+    }
+
+    [[nodiscard]]
+    VkDeviceSize residentBytes() const {
+        return allocatedBytes;
+    }
+
+    [[nodiscard]]
+    bool idle() const {
+        return pending.empty() && !uploadInFlight;
+    }
+
+private:
+    struct Upload{
+        std::shared_ptr<Texture> texture;
+        ktx2::File source;
+        uint32_t skippedLevels = 0;
+        uint32_t nextLevel = 0;
+        bool generateMips = false;
+        bool done = false;
+    };
+
+    struct Allocation{
+        std::weak_ptr<Texture> texture;
+        VkDeviceSize size;
+    };
+
+    void releaseExpired();
+
+    void createView(Texture& texture);
+
+    void generateMipChain(VkCommandBuffer commandBuffer, const VulkanImage& image);
+
+    VulkanDevice* device = nullptr;
+    VkDeviceSize budget = 0;
+    VkDeviceSize bytesPerUpdate = 0;
+    VkDeviceSize allocatedBytes = 0;
+
+    VulkanCommandPool commandPool;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VulkanFence fence;
+    VulkanBuffer staging;
+    char* stagingData = nullptr;
+
+    std::vector<Upload> pending;
+    std::vector<Allocation> allocations;
+    std::vector<std::pair<std::shared_ptr<Texture>, uint32_t>> inFlight;
+    bool uploadInFlight = false;
+
+    GpuProfiler* profiler = nullptr;
+    uint32_t profilerPool = 0;
+};
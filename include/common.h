@@ -6,6 +6,8 @@ constexpr bool debugMode = true;
 constexpr bool debugMode = false;
 #endif
 
+#include <cassert>
+#include <cstdlib>
 #include <string>
 #include <string_view>
 #include <array>
@@ -26,26 +28,50 @@ constexpr bool debugMode = false;
 constexpr uint32_t WIDTH = 800;
 constexpr uint32_t HEIGHT = 600;
 constexpr std::chrono::seconds ONE_SECOND = std::chrono::seconds(1);
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+constexpr VkDeviceSize TEXTURE_BUDGET = 256 * 1024 * 1024;
+constexpr uint64_t STATS_REPORT_INTERVAL = 600;
+constexpr double IDLE_WAIT_TIMEOUT = 1.0;      // seconds an on demand loop blocks before refreshing its idle metrics
+constexpr uint64_t STEADY_STATE_FRAME = 8;     // first frame expected not to allocate, earlier ones warm caches and pools
 
-#define ASSERT(result) assert(result == VK_SUCCESS)
+#if defined(__GNUC__) || defined(__clang__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#define COLD __attribute__((cold, noinline))
+#else
+#define UNLIKELY(condition) (condition)
+#define COLD __declspec(noinline)
+#endif
+
+[[noreturn]] COLD inline void vulkanCallFailed(VkResult result, const char* call, const char* file, int line){
+    throw std::runtime_error{ std::string{ call } + " failed with VkResult " + std::to_string(result)
+                              + " at " + file + ":" + std::to_string(line) };
+}
+
+// always evaluates call, release builds keep only a predicted not taken branch
+#define ASSERT(call) \
+do { \
+    VkResult assertResult_ = (call); \
+    if(UNLIKELY(assertResult_ != VK_SUCCESS)) vulkanCallFailed(assertResult_, #call, __FILE__, __LINE__); \
+} while(false)
 #define COUNT(sequence) static_cast<uint32_t>(sequence.size())
 
 using cstring = const char*;
 
-template<typename VkObject, typename Provider>
-inline std::vector<VkObject> get(Provider&& provider){
+// Container can be a SmallVector for queries that should not allocate
+template<typename VkObject, typename Container = std::vector<VkObject>, typename Provider>
+inline Container get(Provider&& provider){
     uint32_t size;
     provider(&size, static_cast<VkObject*>(nullptr));
-    std::vector<VkObject> objects(size);
+    Container objects(size);
     provider(&size, objects.data());
     return objects;
 }
 
-template<typename VkObject, typename Provider>
-inline std::vector<VkObject> enumerate(Provider&& provider){
+template<typename VkObject, typename Container = std::vector<VkObject>, typename Provider>
+inline Container enumerate(Provider&& provider){
     uint32_t size;
     provider(&size, static_cast<VkObject*>(nullptr));
-    std::vector<VkObject> objects(size);
+    Container objects(size);
     VkResult result;
     do {
         result = provider(&size, objects.data());
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstring>
+#include <lz4.h>
+#include "io.h"
+#include "primitives.h"
+
+/**
+ * Cooked mesh container, written offline by VulkanCubeCooker and mapped at runtime
+ *
+ * | Header | Section[sectionCount] | section data ... |
+ *
+ * Mesh i owns sections 2i (vertices) and 2i + 1 (indices), section data is stored in
+ * the exact layout consumed by the vertex / index buffers, optionally LZ4 compressed
+ */
+namespace cooked {
+
+    constexpr uint32_t MAGIC = 0x424D4356;  // "VCMB"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint64_t SECTION_ALIGNMENT = 16;
+    constexpr uint64_t MAX_SECTION_SIZE = LZ4_MAX_INPUT_SIZE;     // also the most LZ4 can compress in one block
+
+    enum class Compression : uint32_t {
+        None = 0,
+        LZ4 = 1
+    };
+
+    enum class SectionType : uint32_t {
+        Vertices = 0,
+        Indices = 1
+    };
+
+    struct Header{
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t vertexStride = sizeof(Vertex);
+        uint32_t indexSize = sizeof(Indices::value_type);
+        uint32_t meshCount = 0;
+        uint32_t sectionCount = 0;
+    };
+
+    struct Section{
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t uncompressedSize = 0;
+        uint32_t count = 0;
+        SectionType type = SectionType::Vertices;
+        Compression compression = Compression::None;
+        uint32_t reserved = 0;
+    };
+
+    static_assert(sizeof(Header) == 24);
+    static_assert(sizeof(Section) == 40);
+
+    inline void write(const io::fs::path& path, const std::vector<Mesh>& meshes, Compression compression = Compression::None){
+        Header header{};
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.sectionCount = header.meshCount * 2;
+
+        std::vector<Section> sections(header.sectionCount);
+        std::vector<io::byte_string> payloads(header.sectionCount);
+
+        auto offset = sizeof(Header) + sizeof(Section) * sections.size();
+        for(size_t i = 0; i < sections.size(); i++){
+            auto& mesh = meshes[i/2];
+            auto& section = sections[i];
+            const char* source;
+            if(i % 2 == 0){
+                section.type = SectionType::Vertices;
+                section.count = static_cast<uint32_t>(mesh.vertices.size());
+                section.uncompressedSize = sizeof(Vertex) * mesh.vertices.size();
+                source = reinterpret_cast<const char*>(mesh.vertices.data());
+            }else{
+                section.type = SectionType::Indices;
+                section.count = static_cast<uint32_t>(mesh.indices.size());
+                section.uncompressedSize = sizeof(Indices::value_type) * mesh.indices.size();
+                source = reinterpret_cast<const char*>(mesh.indices.data());
+            }
+            // the reader refuses bigger sections and LZ4 takes their sizes as int
+            if(section.uncompressedSize > MAX_SECTION_SIZE){
+                throw std::runtime_error{ "mesh " + std::to_string(i/2) + " has a section of " + std::to_string(section.uncompressedSize)
+                                          + " bytes, at most " + std::to_string(MAX_SECTION_SIZE) + " fit" };
+            }
+
+            auto& payload = payloads[i];
+            if(compression == Compression::LZ4 && section.uncompressedSize > 0){
+                auto sourceSize = static_cast<int>(section.uncompressedSize);
+                payload.resize(LZ4_compressBound(sourceSize));
+                auto compressedSize = LZ4_compress_default(source, payload.data(), sourceSize, static_cast<int>(payload.size()));
+                if(compressedSize > 0 && static_cast<uint64_t>(compressedSize) < section.uncompressedSize){
+                    payload.resize(compressedSize);
+                    section.compression = Compression::LZ4;
+                }
+            }
+            if(section.compression == Compression::None){
+                payload.assign(source, source + section.uncompressedSize);
+            }
+
+            offset = (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+            section.offset = offset;
+            section.size = payload.size();
+            offset += payload.size();
+        }
+
+        std::ofstream fout{path.string(), std::ios::binary | std::ios::trunc};
+        if(!fout) throw std::runtime_error{ "unable to open " + path.string() + " for writing" };
+
+        fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        fout.write(reinterpret_cast<const char*>(sections.data()), sizeof(Section) * sections.size());
+        for(size_t i = 0; i < sections.size(); i++){
+            static const char padding[SECTION_ALIGNMENT]{};
+            auto position = static_cast<uint64_t>(fout.tellp());
+            fout.write(padding, sections[i].offset - position);
+            fout.write(payloads[i].data(), payloads[i].size());
+        }
+        if(!fout) throw std::runtime_error{ "failed to write " + path.string() };
+    }
+
+    struct MeshFile{
+
+        MeshFile() = default;
+
+        explicit MeshFile(const io::fs::path& path)
+        : file(path)
+        {
+            if(file.size < sizeof(Header)) throw std::runtime_error{ path.string() + " is not a cooked mesh file" };
+            header = reinterpret_cast<const Header*>(file.data);
+
+            if(header->magic != MAGIC) throw std::runtime_error{ path.string() + " is not a cooked mesh file" };
+            if(header->version != VERSION) throw std::runtime_error{ path.string() + " has unsupported version " + std::to_string(header->version) };
+            if(header->vertexStride != sizeof(Vertex) || header->indexSize != sizeof(Indices::value_type)){
+                throw std::runtime_error{ path.string() + " was cooked with a different vertex layout" };
+            }
+            if(header->sectionCount != uint64_t{ header->meshCount } * 2
+                || sizeof(Header) + sizeof(Section) * header->sectionCount > file.size){
+                throw std::runtime_error{ path.string() + " has a corrupt section table" };
+            }
+
+            sections = reinterpret_cast<const Section*>(file.data + sizeof(Header));
+            for(auto i = 0u; i < header->sectionCount; i++){
+                validate(path, sections[i], i % 2 == 0 ? SectionType::Vertices : SectionType::Indices);
+            }
+        }
+
+        [[nodiscard]]
+        uint32_t meshCount() const {
+            return header ? header->meshCount : 0;
+        }
+
+        [[nodiscard]]
+        const Section& vertices(uint32_t mesh) const {
+            return sections[mesh * 2];
+        }
+
+        [[nodiscard]]
+        const Section& indices(uint32_t mesh) const {
+            return sections[mesh * 2 + 1];
+        }
+
+        /**
+         * Writes the section straight from the mapping into dest, which must hold section.uncompressedSize bytes,
+         * dest is expected to be mapped staging memory so this is the only copy the data goes through
+         */
+        void decode(const Section& section, void* dest) const {
+            auto source = file.data + section.offset;
+            if(section.compression == Compression::None){
+                std::memcpy(dest, source, section.size);
+                return;
+            }
+            auto decodedSize = LZ4_decompress_safe(source, static_cast<char*>(dest), static_cast<int>(section.size), static_cast<int>(section.uncompressedSize));
+            if(decodedSize < 0 || static_cast<uint64_t>(decodedSize) != section.uncompressedSize){
+                throw std::runtime_error{ "corrupt compressed mesh section" };
+            }
+        }
+
+    private:
+        /**
+         * Everything decode() and the callers sizing buffers from a section rely on, checked once up front so a
+         * damaged or crafted file is rejected here instead of writing past the destination
+         */
+        void validate(const io::fs::path& path, const Section& section, SectionType type) const {
+            if(section.size > file.size || section.offset > file.size - section.size){
+                throw std::runtime_error{ path.string() + " is truncated" };
+            }
+            auto elementSize = type == SectionType::Vertices ? sizeof(Vertex) : sizeof(Indices::value_type);
+            if(section.type != type
+                || section.uncompressedSize > MAX_SECTION_SIZE
+                || section.uncompressedSize != uint64_t{ section.count } * elementSize){
+                throw std::runtime_error{ path.string() + " has a corrupt section" };
+            }
+            auto sizeValid = false;
+            switch(section.compression){
+                case Compression::None:
+                    sizeValid = section.size == section.uncompressedSize;
+                    break;
+                case Compression::LZ4:
+                    sizeValid = section.size <= static_cast<uint64_t>(LZ4_compressBound(static_cast<int>(section.uncompressedSize)));
+                    break;
+            }
+            if(!sizeValid) throw std::runtime_error{ path.string() + " has a corrupt section" };
+        }
+
+    public:
+        io::MappedFile file;
+        const Header* header = nullptr;
+        const Section* sections = nullptr;
+    };
+}
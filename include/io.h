@@ -3,24 +3,144 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace io {
 
     namespace fs = std::filesystem;
     using byte_string = std::vector<char>;
 
-    inline byte_string load(const fs::path& path) {
-       if(!fs::exists(path))  throw std::runtime_error{ path.string() + " does not exists" };
-
+    inline void load(const fs::path& path, byte_string& data) {
        std::ifstream fin{path.string(), std::ios::binary | std::ios::ate};
+       if(!fin) throw std::runtime_error{ path.string() + " does not exists" };
+
        auto size = fin.tellg();
        fin.seekg(0);
-       byte_string data(size);
+       data.resize(size);
        fin.read(data.data(), size);
-       fin.close();
+       if(!fin) throw std::runtime_error{ "failed to read " + path.string() };
+    }
 
+    inline byte_string load(const fs::path& path) {
+       byte_string data;
+       load(path, data);
        return data;
     }
-}
 
+    /**
+     * Read only memory mapping of a whole file, pages are faulted in by the OS as they are touched
+     */
+    struct MappedFile{
+
+        MappedFile() = default;
+
+        explicit MappedFile(const fs::path& path){
+#ifdef _WIN32
+            file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if(file == INVALID_HANDLE_VALUE) throw std::runtime_error{ "unable to open " + path.string() };
+
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = static_cast<size_t>(fileSize.QuadPart);
+            if(size == 0) return;
+
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(!mapping) throw std::runtime_error{ "unable to map " + path.string() };
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if(!data) throw std::runtime_error{ "unable to map " + path.string() };
+#else
+            auto fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0) throw std::runtime_error{ "unable to open " + path.string() };
+
+            struct stat info{};
+            fstat(fd, &info);
+            size = static_cast<size_t>(info.st_size);
+            if(size == 0){
+                ::close(fd);
+                return;
+            }
 
+            auto ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(ptr == MAP_FAILED) throw std::runtime_error{ "unable to map " + path.string() };
+            // advice values are not flags, each one is its own call
+            madvise(ptr, size, MADV_SEQUENTIAL);
+            madvise(ptr, size, MADV_WILLNEED);
+            data = static_cast<const char*>(ptr);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& source) noexcept {
+            operator=(static_cast<MappedFile&&>(source));
+        }
+
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile& operator=(MappedFile&& source) noexcept {
+            if(this == &source) return *this;
+            release();
+            data = source.data;
+            size = source.size;
+#ifdef _WIN32
+            file = source.file;
+            mapping = source.mapping;
+            source.file = INVALID_HANDLE_VALUE;
+            source.mapping = nullptr;
+#endif
+            source.data = nullptr;
+            source.size = 0;
+
+            return *this;
+        }
+
+        ~MappedFile(){
+            release();
+        }
+
+        [[nodiscard]]
+        const char* begin() const {
+            return data;
+        }
+
+        [[nodiscard]]
+        const char* end() const {
+            return data + size;
+        }
+
+        const char* data = nullptr;
+        size_t size = 0;
+
+    private:
+        void release(){
+#ifdef _WIN32
+            if(data) UnmapViewOfFile(data);
+            if(mapping) CloseHandle(mapping);
+            if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            mapping = nullptr;
+#else
+            if(data) munmap(const_cast<char*>(data), size);
+#endif
+            data = nullptr;
+        }
+
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <vulkan/vulkan.h>
+#include "io.h"
+
+/**
+ * Reader for KTX2 containers holding 2D textures in a Vulkan format (BCn, ASTC, plain RGBA ...),
+ * level data is read straight from the memory mapping, supercompressed (basis / zstd) files are rejected
+ */
+namespace ktx2 {
+
+    constexpr uint8_t IDENTIFIER[12]{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    struct Header{
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct Level{
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    static_assert(sizeof(Header) == 80);
+    static_assert(sizeof(Level) == 24);
+
+    struct File{
+
+        File() = default;
+
+        explicit File(const io::fs::path& path)
+        : file(path)
+        {
+            if(file.size < sizeof(Header) || std::memcmp(file.data, IDENTIFIER, sizeof(IDENTIFIER)) != 0){
+                throw std::runtime_error{ path.string() + " is not a KTX2 file" };
+            }
+            header = reinterpret_cast<const Header*>(file.data);
+            if(header->vkFormat == VK_FORMAT_UNDEFINED || header->supercompressionScheme != 0){
+                throw std::runtime_error{ path.string() + ": supercompressed KTX2 textures are not supported" };
+            }
+            if(header->pixelDepth > 1 || header->layerCount > 1 || header->faceCount != 1){
+                throw std::runtime_error{ path.string() + ": only single layer 2D KTX2 textures are supported" };
+            }
+            if(sizeof(Header) + sizeof(Level) * levelCount() > file.size){
+                throw std::runtime_error{ path.string() + " has a corrupt level index" };
+            }
+            levels = reinterpret_cast<const Level*>(file.data + sizeof(Header));
+            for(auto i = 0u; i < levelCount(); i++){
+                if(levels[i].byteOffset + levels[i].byteLength > file.size) throw std::runtime_error{ path.string() + " is truncated" };
+            }
+        }
+
+        [[nodiscard]]
+        VkFormat format() const {
+            return static_cast<VkFormat>(header->vkFormat);
+        }
+
+        // levelCount of zero in the header asks the loader to generate the mip chain
+        [[nodiscard]]
+        uint32_t levelCount() const {
+            return std::max(1u, header->levelCount);
+        }
+
+        [[nodiscard]]
+        bool hasMipChain() const {
+            return header->levelCount > 0;
+        }
+
+        [[nodiscard]]
+        VkExtent3D extent(uint32_t level = 0) const {
+            return { std::max(1u, header->pixelWidth >> level), std::max(1u, header->pixelHeight >> level), 1 };
+        }
+
+        [[nodiscard]]
+        const char* levelData(uint32_t level) const {
+            return file.data + levels[level].byteOffset;
+        }
+
+        [[nodiscard]]
+        VkDeviceSize levelSize(uint32_t level) const {
+            return levels[level].byteLength;
+        }
+
+        io::MappedFile file;
+        const Header* header = nullptr;
+        const Level* levels = nullptr;
+    };
+}
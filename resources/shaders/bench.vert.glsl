@@ -0,0 +1,23 @@
+#version 450 core
+
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 color;
+layout(location = 3) in vec2 uv;
+layout(location = 4) in mat4 model;
+layout(location = 8) in uint material;
+
+layout(push_constant) uniform Camera {
+    mat4 viewProjection;
+};
+
+layout(location = 0) smooth out vec3 vColor;
+layout(location = 1) smooth out vec2 vUv;
+layout(location = 2) flat out uint vMaterial;
+
+void main() {
+    gl_Position = viewProjection * model * position;
+    vColor = color;
+    vUv = uv;
+    vMaterial = material;
+}
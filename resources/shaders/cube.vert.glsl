@@ -5,15 +5,27 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec3 color;
 layout(location = 3) in vec2 uv;
 
-layout(set = 0, binding = 0) uniform mvp {
+// set 0 is the material table
+layout(set = 1, binding = 0) uniform mvp {
     mat4 model;
     mat4 view;
     mat4 proj;
 };
 
+layout(push_constant) uniform Object {
+    uint material;
+};
+
 layout(location = 0) smooth out vec3 vColor;
+layout(location = 1) smooth out vec2 vUv;
+layout(location = 2) flat out uint vMaterial;
+
+// the depth pre-pass and the colour pass must agree on depth
+invariant gl_Position;
 
 void main() {
     gl_Position = proj * view * model * position;
     vColor = color;
+    vUv = uv;
+    vMaterial = material;
 }
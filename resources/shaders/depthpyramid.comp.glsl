@@ -0,0 +1,31 @@
+#version 450 core
+
+// one level of the depth pyramid: every texel keeps the farthest depth of the 2x2 source texels it
+// covers, plus the extra row or column an odd sized source leaves over at the edge
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform Level {
+    ivec2 sourceSize;
+    ivec2 size;
+};
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if(any(greaterThanEqual(texel, size))) return;
+
+    ivec2 first = texel * 2;
+    ivec2 last = min(first + 1, sourceSize - 1);
+    last = mix(last, sourceSize - 1, equal(texel, size - 1));
+
+    float depth = 0.0;
+    for(int y = first.y; y <= last.y; y++){
+        for(int x = first.x; x <= last.x; x++){
+            depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+        }
+    }
+    imageStore(destination, texel, vec4(depth));
+}
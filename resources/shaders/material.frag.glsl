@@ -0,0 +1,28 @@
+#version 450 core
+
+// MaterialTable::Material
+struct Material {
+    vec4 baseColor;
+    uint albedoLayer;
+    float roughness;
+    float metallic;
+    uint padding;
+};
+
+layout(set = 0, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+
+layout(set = 0, binding = 1) uniform sampler2DArray textures;
+
+layout(location = 0) in vec3 vColor;
+layout(location = 1) in vec2 vUv;
+layout(location = 2) flat in uint vMaterial;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    Material material = materials[vMaterial];
+    vec4 albedo = texture(textures, vec3(vUv, float(material.albedoLayer)));
+    fragColor = vec4(vColor, 1.0) * material.baseColor * albedo;
+}
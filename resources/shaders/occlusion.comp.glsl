@@ -0,0 +1,105 @@
+#version 450 core
+
+// frustum and occlusion test of one object's bounding sphere, survivors are appended to the phase's
+// indirect draw list. Phase 0 tests every object against the previous frame's depth pyramid, phase 1
+// tests only what phase 0 rejected against the pyramid of what phase 0 drew.
+
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    vec4 spheres[];     // world space center and radius
+};
+
+layout(std430, set = 0, binding = 1) buffer Drawn {
+    uint drawn[];       // per object, 1 when phase 0 drew it
+};
+
+layout(std430, set = 0, binding = 2) buffer Counts {
+    uint drawCounts[2];
+};
+
+layout(std430, set = 0, binding = 3) writeonly buffer Draws {
+    DrawCommand draws[];    // objectCount commands per phase
+};
+
+layout(set = 0, binding = 4) uniform sampler2D pyramid;
+
+layout(push_constant) uniform Cull {
+    mat4 viewProjection;
+    uint objectCount;
+    uint phase;
+    uint indexCount;
+    uint levels;
+    vec2 depthSize;     // size of the depth buffer the pyramid's first level halves
+};
+
+// one bit per clip plane the point is outside of, z is clipped to [0, w] like the rasterizer does
+uint outcode(vec4 clip) {
+    return uint(clip.x < -clip.w) | uint(clip.x > clip.w) << 1
+         | uint(clip.y < -clip.w) << 2 | uint(clip.y > clip.w) << 3
+         | uint(clip.z < 0.0) << 4 | uint(clip.z > clip.w) << 5;
+}
+
+bool visible(vec4 sphere) {
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    uint outside = 63u;
+    bool behind = false;
+
+    // the corners of the sphere's box bound its projection and nearest depth
+    for(int corner = 0; corner < 8; corner++){
+        vec3 offset = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1) * 2.0 - 1.0;
+        vec4 clip = viewProjection * vec4(sphere.xyz + offset * sphere.w, 1.0);
+
+        outside &= outcode(clip);
+        if(clip.w <= 0.0){
+            behind = true;
+        }else{
+            vec3 ndc = clip.xyz / clip.w;
+            ndcMin = min(ndcMin, ndc);
+            ndcMax = max(ndcMax, ndc);
+        }
+    }
+    // every corner is outside the same plane
+    if(outside != 0u) return false;
+
+    // a box crossing the camera plane has no bounded projection, it can't be proven occluded
+    if(behind) return true;
+
+    vec2 pixelMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * depthSize;
+    vec2 pixelMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * depthSize;
+    vec2 extent = pixelMax - pixelMin;
+
+    // level L texels cover 2^(L+1) depth pixels, pick the level where the rectangle spans at most 2x2 texels
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))) - 1, 0, int(levels) - 1);
+    ivec2 size = textureSize(pyramid, level);
+    ivec2 first = min(ivec2(pixelMin) >> (level + 1), size - 1);
+    ivec2 last = min(ivec2(pixelMax) >> (level + 1), size - 1);
+
+    float farthest = max(max(texelFetch(pyramid, first, level).r, texelFetch(pyramid, ivec2(last.x, first.y), level).r),
+                         max(texelFetch(pyramid, ivec2(first.x, last.y), level).r, texelFetch(pyramid, last, level).r));
+    return ndcMin.z <= farthest;
+}
+
+void main() {
+    uint object = gl_GlobalInvocationID.x;
+    if(object >= objectCount) return;
+    if(phase == 1 && drawn[object] == 1) return;
+
+    bool draw = visible(spheres[object]);
+    if(phase == 0){
+        drawn[object] = draw ? 1 : 0;
+    }
+    if(draw){
+        uint slot = atomicAdd(drawCounts[phase], 1);
+        draws[phase * objectCount + slot] = DrawCommand(indexCount, 1, 0, 0, object);
+    }
+}
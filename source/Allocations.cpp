@@ -0,0 +1,135 @@
+#include "Allocations.h"
+#include <cstdlib>
+#include <new>
+
+#ifdef VULKAN_CUBE_COUNT_ALLOCATIONS
+static thread_local uint64_t threadAllocations = 0;
+
+static void* countedAllocate(std::size_t size) noexcept {
+    threadAllocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size){
+    if(auto memory = countedAllocate(size)) return memory;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size){
+    if(auto memory = countedAllocate(size)) return memory;
+    throw std::bad_alloc{};
+}
+
+// aligned_alloc wants a size that is a multiple of the alignment, Windows has its own aligned heap
+static void* countedAllocate(std::size_t size, std::align_val_t alignment) noexcept {
+    threadAllocations++;
+    auto align = static_cast<std::size_t>(alignment);
+    size = size ? (size + align - 1) & ~(align - 1) : align;
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return std::aligned_alloc(align, size);
+#endif
+}
+
+static void alignedFree(void* memory) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment){
+    if(auto memory = countedAllocate(size, alignment)) return memory;
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment){
+    if(auto memory = countedAllocate(size, alignment)) return memory;
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    alignedFree(memory);
+}
+#endif
+
+namespace allocations {
+
+    bool counting() {
+#ifdef VULKAN_CUBE_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t count() {
+#ifdef VULKAN_CUBE_COUNT_ALLOCATIONS
+        return threadAllocations;
+#else
+        return 0;
+#endif
+    }
+}
@@ -0,0 +1,238 @@
+#include "AsyncIO.h"
+#include <spdlog/spdlog.h>
+#include "Trace.h"
+
+#ifdef VULKAN_CUBE_IO_URING
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace io {
+
+#ifdef VULKAN_CUBE_IO_URING
+    static constexpr unsigned QUEUE_DEPTH = 64;
+    static constexpr size_t MAX_READ_SIZE = 1u << 30;
+
+    // a full submission queue is drained by submitting it, a ring that can't take submissions anymore is fatal
+    static io_uring_sqe* acquireSqe(io_uring* uring) {
+        auto sqe = io_uring_get_sqe(uring);
+        while(!sqe){
+            auto result = io_uring_submit(uring);
+            if(result < 0 && result != -EINTR){
+                throw std::runtime_error{ std::string{ "io_uring submission failed: " } + strerror(-result) };
+            }
+            sqe = io_uring_get_sqe(uring);
+        }
+        return sqe;
+    }
+#endif
+
+    AsyncReader::AsyncReader(uint32_t workerCount) {
+#ifdef VULKAN_CUBE_IO_URING
+        auto uring = new io_uring{};
+        auto result = io_uring_queue_init(QUEUE_DEPTH, uring, 0);
+        if(result == 0){
+            ring = uring;
+            completionThread = std::thread{ [this]{ reap(); } };
+            return;
+        }
+        delete uring;
+        spdlog::warn("io_uring unavailable ({}), falling back to worker threads", strerror(-result));
+#endif
+        workers.reserve(workerCount);
+        for(auto i = 0u; i < workerCount; i++){
+            workers.emplace_back([this]{ work(); });
+        }
+    }
+
+    AsyncReader::~AsyncReader() {
+        {
+            std::lock_guard<std::mutex> lock{ queueMutex };
+            running = false;
+        }
+        queueSignal.notify_all();
+        for(auto& worker : workers){
+            worker.join();
+        }
+#ifdef VULKAN_CUBE_IO_URING
+        if(ring){
+            auto uring = static_cast<io_uring*>(ring);
+            {
+                std::lock_guard<std::mutex> lock{ ringMutex };
+                auto sqe = acquireSqe(uring);
+                io_uring_prep_nop(sqe);
+                io_uring_sqe_set_data(sqe, nullptr);
+                io_uring_submit(uring);
+            }
+            completionThread.join();
+            io_uring_queue_exit(uring);
+            delete uring;
+        }
+#endif
+    }
+
+    ReadHandle AsyncReader::read(const fs::path& path, byte_string* destination) {
+        return read(std::vector<ReadRequest>{ { path, destination } })[0];
+    }
+
+    ReadBatch AsyncReader::read(const std::vector<ReadRequest>& requests) {
+        std::vector<std::shared_ptr<detail::ReadState>> states;
+        std::vector<ReadHandle> handles;
+        states.reserve(requests.size());
+        handles.reserve(requests.size());
+        for(auto& request : requests){
+            states.push_back(createState(request));
+            handles.emplace_back(states.back());
+        }
+        submit(states);
+
+        return ReadBatch{ std::move(handles) };
+    }
+
+    std::shared_ptr<detail::ReadState> AsyncReader::createState(const ReadRequest& request) {
+        auto state = std::make_shared<detail::ReadState>();
+        state->path = request.path;
+        state->destination = request.destination;
+        if(!request.destination){
+            state->pooled = pool->acquire();
+            state->pool = pool;
+        }
+        return state;
+    }
+
+    void AsyncReader::submit(const std::vector<std::shared_ptr<detail::ReadState>>& states) {
+#ifdef VULKAN_CUBE_IO_URING
+        if(ring){
+            std::lock_guard<std::mutex> lock{ ringMutex };
+            for(auto& state : states){
+                submitToRing(state);
+            }
+            io_uring_submit(static_cast<io_uring*>(ring));
+            return;
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lock{ queueMutex };
+            queue.insert(end(queue), begin(states), end(states));
+        }
+        queueSignal.notify_all();
+    }
+
+    void AsyncReader::work() {
+        trace::setThreadName("io worker");
+        while(true){
+            std::shared_ptr<detail::ReadState> state;
+            {
+                std::unique_lock<std::mutex> lock{ queueMutex };
+                queueSignal.wait(lock, [&]{ return !running || !queue.empty(); });
+                if(queue.empty()) return;
+                state = std::move(queue.front());
+                queue.pop_front();
+            }
+            try{
+                TRACE_SCOPE("read file", "io");
+                load(state->path, state->buffer());
+                state->complete();
+            }catch(...){
+                state->complete(std::current_exception());
+            }
+        }
+    }
+
+#ifdef VULKAN_CUBE_IO_URING
+    // open and fstat stay synchronous, they are cheap next to the reads and keep the ring single purpose
+    void AsyncReader::submitToRing(const std::shared_ptr<detail::ReadState>& state) {
+        if(!ringError.empty()){
+            state->complete(std::make_exception_ptr(std::runtime_error{ "failed to read " + state->path.string() + ": " + ringError }));
+            return;
+        }
+        state->fd = ::open(state->path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info{};
+        if(state->fd < 0 || fstat(state->fd, &info) != 0){
+            if(state->fd >= 0) ::close(state->fd);
+            state->complete(std::make_exception_ptr(std::runtime_error{ state->path.string() + " does not exists" }));
+            return;
+        }
+
+        state->buffer().resize(static_cast<size_t>(info.st_size));
+        if(info.st_size == 0){
+            ::close(state->fd);
+            state->complete();
+            return;
+        }
+        inFlight.emplace(state.get(), state);
+        queueRead(state.get());
+    }
+
+    void AsyncReader::queueRead(detail::ReadState* state) {
+        auto uring = static_cast<io_uring*>(ring);
+        auto sqe = acquireSqe(uring);
+        auto& buffer = state->buffer();
+        auto size = std::min(buffer.size() - state->offset, MAX_READ_SIZE);
+        io_uring_prep_read(sqe, state->fd, buffer.data() + state->offset, static_cast<unsigned>(size), state->offset);
+        io_uring_sqe_set_data(sqe, state);
+    }
+
+    void AsyncReader::reap() {
+        trace::setThreadName("io_uring completions");
+        auto uring = static_cast<io_uring*>(ring);
+        bool stopping = false;
+        while(true){
+            io_uring_cqe* cqe;
+            auto waited = io_uring_wait_cqe(uring, &cqe);
+            if(waited == -EINTR) continue;
+            if(waited < 0){
+                // the ring is unusable, everything in flight and everything submitted later fails instead of waiting forever
+                std::lock_guard<std::mutex> lock{ ringMutex };
+                ringError = std::string{ "io_uring wait failed: " } + strerror(-waited);
+                spdlog::error(ringError);
+                for(auto& [state, owner] : inFlight){
+                    ::close(state->fd);
+                    owner->complete(std::make_exception_ptr(std::runtime_error{ "failed to read " + state->path.string() + ": " + ringError }));
+                }
+                inFlight.clear();
+                return;
+            }
+            auto state = static_cast<detail::ReadState*>(io_uring_cqe_get_data(cqe));
+            auto result = cqe->res;
+            io_uring_cqe_seen(uring, cqe);
+
+            std::lock_guard<std::mutex> lock{ ringMutex };
+            if(!state){
+                stopping = true;
+            }else{
+                std::exception_ptr error;
+                bool finished = false;
+                if(result == -EINTR || result == -EAGAIN){
+                    queueRead(state);
+                    io_uring_submit(uring);
+                }else if(result <= 0){
+                    auto reason = result < 0 ? strerror(-result) : "unexpected end of file";
+                    error = std::make_exception_ptr(std::runtime_error{ "failed to read " + state->path.string() + ": " + reason });
+                    finished = true;
+                }else{
+                    state->offset += static_cast<size_t>(result);
+                    finished = state->offset >= state->buffer().size();
+                    if(!finished){
+                        queueRead(state);
+                        io_uring_submit(uring);
+                    }
+                }
+
+                if(finished){
+                    ::close(state->fd);
+                    auto itr = inFlight.find(state);
+                    auto owner = std::move(itr->second);
+                    inFlight.erase(itr);
+                    owner->complete(error);
+                }
+            }
+            if(stopping && inFlight.empty()) return;
+        }
+    }
+#endif
+}
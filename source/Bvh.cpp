@@ -0,0 +1,477 @@
+#include "Bvh.h"
+
+// SAH bins per axis
+static constexpr int BINS = 16;
+
+// nodes with at most LEAF_SIZE objects always become leaves, up to MAX_LEAF when the SAH finds splitting doesn't pay
+static constexpr uint32_t LEAF_SIZE = 4;
+static constexpr uint32_t MAX_LEAF = 16;
+
+// cost of visiting a node relative to testing one object's box
+static constexpr float TRAVERSAL_COST = 1.0f;
+
+// nodes with more objects are binned in chunks on the workers, children with more objects become jobs
+static constexpr uint32_t PARALLEL_BIN = 1u << 16;
+static constexpr uint32_t PARALLEL_SPLIT = 4096;
+static constexpr size_t BIN_GRAIN = 16384;
+
+static void grow(Bvh::Bounds& bounds, const Bvh::Bounds& other){
+    bounds.min = glm::min(bounds.min, other.min);
+    bounds.max = glm::max(bounds.max, other.max);
+}
+
+static Bvh::Bounds empty(){
+    return { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+}
+
+// half the surface area, the SAH only compares ratios
+static float area(const Bvh::Bounds& bounds){
+    auto extent = glm::max(bounds.max - bounds.min, glm::vec3(0));
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+struct Bvh::Builder{
+    // bounds of a range of objects and of their centroids
+    struct Extent{
+        Bounds bounds = empty();
+        Bounds centroids = empty();
+        uint32_t count = 0;
+
+        void add(const Extent& other){
+            grow(bounds, other.bounds);
+            grow(centroids, other.centroids);
+            count += other.count;
+        }
+    };
+
+    struct Node{
+        Extent extent;
+        uint32_t begin = 0;
+        uint32_t left = INVALID;
+        uint32_t right = INVALID;
+    };
+
+    using Bins = std::array<std::array<Extent, BINS>, 3>;
+
+    // objects are partitioned with their boxes so every pass over a node reads memory sequentially
+    struct Item{
+        Bounds bounds;
+        uint32_t object;
+
+        [[nodiscard]]
+        glm::vec3 centroid() const {
+            return (bounds.min + bounds.max) * 0.5f;
+        }
+    };
+
+    std::vector<Item> items;
+    std::unique_ptr<Node[]> nodes;
+    std::atomic<uint32_t> nodeCount = 1;
+    jobs::Scheduler* scheduler = nullptr;
+    jobs::Counter counter;
+
+    Builder(jobs::Scheduler* scheduler, Span<const Bounds> bounds)
+    : items(bounds.size())
+    , nodes(new Node[2 * bounds.size() - 1])
+    , scheduler(scheduler)
+    {
+        auto count = static_cast<uint32_t>(bounds.size());
+        nodes[0].extent = reduce<Extent>(0, count, [&](size_t first, size_t last, Extent& extent){
+            for(auto i = first; i < last; i++){
+                items[i] = { bounds[i], static_cast<uint32_t>(i) };
+                auto centroid = items[i].centroid();
+                grow(extent.bounds, items[i].bounds);
+                grow(extent.centroids, { centroid, centroid });
+            }
+            extent.count = static_cast<uint32_t>(last - first);
+        });
+    }
+
+    // runs body over chunks of [begin, end) on the workers when the range is large and merges the per chunk results
+    template<typename Result, typename Body>
+    Result reduce(uint32_t begin, uint32_t end, Body&& body){
+        if(!scheduler || end - begin < PARALLEL_BIN){
+            Result result;
+            body(begin, end, result);
+            return result;
+        }
+        std::vector<Result> chunks((end - begin + BIN_GRAIN - 1) / BIN_GRAIN);
+        scheduler->parallelFor(begin, end, BIN_GRAIN, [&](size_t first, size_t last){
+            body(first, last, chunks[(first - begin) / BIN_GRAIN]);
+        });
+        for(size_t chunk = 1; chunk < chunks.size(); chunk++){
+            merge(chunks[0], chunks[chunk]);
+        }
+        return chunks[0];
+    }
+
+    static void merge(Extent& into, const Extent& from){
+        into.add(from);
+    }
+
+    static void merge(Bins& into, const Bins& from){
+        for(int axis = 0; axis < 3; axis++){
+            for(int b = 0; b < BINS; b++){
+                into[axis][b].add(from[axis][b]);
+            }
+        }
+    }
+
+    // bins hold the exact extents of their objects, so children never need another pass to measure themselves
+    Bins bin(uint32_t begin, uint32_t end, const glm::vec3& origin, const glm::vec3& scale){
+        return reduce<Bins>(begin, end, [&](size_t first, size_t last, Bins& bins){
+            for(auto i = first; i < last; i++){
+                auto centroid = items[i].centroid();
+                auto position = (centroid - origin) * scale;
+                for(int axis = 0; axis < 3; axis++){
+                    auto& bin = bins[axis][std::min(BINS - 1, static_cast<int>(position[axis]))];
+                    grow(bin.bounds, items[i].bounds);
+                    grow(bin.centroids, { centroid, centroid });
+                    bin.count++;
+                }
+            }
+        });
+    }
+
+    Extent measure(uint32_t begin, uint32_t end){
+        return reduce<Extent>(begin, end, [&](size_t first, size_t last, Extent& extent){
+            for(auto i = first; i < last; i++){
+                auto centroid = items[i].centroid();
+                grow(extent.bounds, items[i].bounds);
+                grow(extent.centroids, { centroid, centroid });
+            }
+            extent.count = static_cast<uint32_t>(last - first);
+        });
+    }
+
+    // splits node and its descendants, children big enough are handed to the workers
+    void split(uint32_t root){
+        SmallVector<uint32_t, 64> stack{ root };
+        while(!stack.empty()){
+            auto index = stack.back();
+            stack.pop_back();
+
+            auto& node = nodes[index];
+            auto& extent = node.extent;
+            auto begin = node.begin;
+            auto end = node.begin + extent.count;
+            if(extent.count <= LEAF_SIZE) continue;
+
+            // cheapest split plane among the bin boundaries of every axis
+            int bestAxis = -1;
+            int bestBin = 0;
+            float bestCost = std::numeric_limits<float>::max();
+            Extent bestLeft, bestRight;
+            auto origin = extent.centroids.min;
+            auto centroidExtent = extent.centroids.max - extent.centroids.min;
+            auto scale = glm::vec3(BINS) / glm::max(centroidExtent, glm::vec3(1e-30f));
+            if(centroidExtent.x > 0 || centroidExtent.y > 0 || centroidExtent.z > 0){
+                auto bins = bin(begin, end, origin, scale);
+                for(int axis = 0; axis < 3; axis++){
+                    if(centroidExtent[axis] <= 0) continue;
+                    std::array<float, BINS - 1> leftCost;
+                    Bounds bounds = empty();
+                    uint32_t count = 0;
+                    for(int b = 0; b < BINS - 1; b++){
+                        grow(bounds, bins[axis][b].bounds);
+                        count += bins[axis][b].count;
+                        leftCost[b] = count == 0 ? std::numeric_limits<float>::max() : area(bounds) * static_cast<float>(count);
+                    }
+                    bounds = empty();
+                    count = 0;
+                    for(int b = BINS - 1; b > 0; b--){
+                        grow(bounds, bins[axis][b].bounds);
+                        count += bins[axis][b].count;
+                        auto cost = leftCost[b - 1] + area(bounds) * static_cast<float>(count);
+                        if(cost < bestCost && count > 0 && count < extent.count){
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestBin = b;
+                        }
+                    }
+                }
+                if(bestAxis >= 0){
+                    for(int b = 0; b < BINS; b++){
+                        (b < bestBin ? bestLeft : bestRight).add(bins[bestAxis][b]);
+                    }
+                }
+            }
+
+            auto leafCost = static_cast<float>(extent.count);
+            auto splitCost = TRAVERSAL_COST + bestCost / std::max(area(extent.bounds), 1e-30f);
+            if(extent.count <= MAX_LEAF && bestAxis >= 0 && splitCost >= leafCost) continue;
+
+            auto left = nodeCount.fetch_add(2, std::memory_order_relaxed);
+            auto right = left + 1;
+            if(bestAxis >= 0){
+                auto first = items.begin() + begin;
+                std::partition(first, items.begin() + end, [&](const Item& item){
+                    return std::min(BINS - 1, static_cast<int>((item.centroid()[bestAxis] - origin[bestAxis]) * scale[bestAxis])) < bestBin;
+                });
+                nodes[left].extent = bestLeft;
+                nodes[right].extent = bestRight;
+            }else{
+                // every centroid is the same point, split in the middle
+                auto middle = begin + extent.count / 2;
+                nodes[left].extent = measure(begin, middle);
+                nodes[right].extent = measure(middle, end);
+            }
+            node.left = left;
+            node.right = right;
+            nodes[left].begin = begin;
+            nodes[right].begin = begin + nodes[left].extent.count;
+
+            if(scheduler && nodes[right].extent.count >= PARALLEL_SPLIT){
+                scheduler->run([this, right]{ split(right); }, counter);
+            }else{
+                stack.push_back(right);
+            }
+            stack.push_back(left);
+        }
+    }
+};
+
+void Bvh::build(Span<const Bounds> bounds) {
+    build(nullptr, bounds);
+}
+
+void Bvh::build(jobs::Scheduler& scheduler, Span<const Bounds> bounds) {
+    build(&scheduler, bounds);
+}
+
+void Bvh::build(jobs::Scheduler* scheduler, Span<const Bounds> bounds) {
+    nodes.clear();
+    parents.clear();
+    objects.clear();
+    boxes.clear();
+    leafOf.assign(bounds.size(), INVALID);
+    slotOf.assign(bounds.size(), INVALID);
+    if(bounds.empty()) return;
+    if(bounds.size() >= INTERNAL) throw std::runtime_error{ "too many objects for a bvh" };
+
+    Builder builder{ scheduler, bounds };
+    if(scheduler){
+        scheduler->run([&builder]{ builder.split(0); }, builder.counter);
+        scheduler->wait(builder.counter);
+    }else{
+        builder.split(0);
+    }
+
+    // lay the tree out depth first, partitioning already left the objects in leaf order
+    objects.resize(builder.items.size());
+    boxes.resize(builder.items.size());
+    for(uint32_t i = 0; i < objects.size(); i++){
+        objects[i] = builder.items[i].object;
+        boxes[i] = builder.items[i].bounds;
+        slotOf[objects[i]] = i;
+    }
+    nodes.reserve(builder.nodeCount);
+    parents.reserve(builder.nodeCount);
+    struct Pending{
+        uint32_t node;
+        uint32_t parent;
+        bool right;
+    };
+    SmallVector<Pending, 64> stack{ Pending{ 0, INVALID, false } };
+    while(!stack.empty()){
+        auto pending = stack.back();
+        stack.pop_back();
+
+        auto index = static_cast<uint32_t>(nodes.size());
+        auto& source = builder.nodes[pending.node];
+        auto& extent = source.extent;
+        if(pending.right) nodes[pending.parent].offset = index;
+        parents.push_back(pending.parent);
+        if(source.left == INVALID){
+            nodes.push_back({ extent.bounds.min, source.begin, extent.bounds.max, extent.count });
+            for(auto i = source.begin; i < source.begin + extent.count; i++){
+                leafOf[objects[i]] = index;
+            }
+        }else{
+            nodes.push_back({ extent.bounds.min, INVALID, extent.bounds.max, extent.count | INTERNAL });
+            stack.push_back({ source.right, index, true });
+            stack.push_back({ source.left, index, false });
+        }
+    }
+
+    dirty.assign(nodes.size(), 0);
+}
+
+void Bvh::refit(Span<const Bounds> bounds) {
+    if(bounds.size() != objects.size()) throw std::runtime_error{ "bvh refit with a different object count" };
+
+    for(size_t i = 0; i < objects.size(); i++){
+        boxes[i] = bounds[objects[i]];
+    }
+    // children always come after their parent
+    for(auto i = nodes.size(); i-- > 0;){
+        auto& node = nodes[i];
+        Bounds box = empty();
+        if(node.leaf()){
+            for(auto o = node.offset; o < node.offset + node.count; o++) grow(box, boxes[o]);
+        }else{
+            grow(box, { nodes[i + 1].min, nodes[i + 1].max });
+            grow(box, { nodes[node.offset].min, nodes[node.offset].max });
+        }
+        node.min = box.min;
+        node.max = box.max;
+    }
+}
+
+void Bvh::refit(Span<const Bounds> bounds, Span<const uint32_t> moved) {
+    if(bounds.size() != objects.size()) throw std::runtime_error{ "bvh refit with a different object count" };
+
+    for(auto object : moved){
+        boxes[slotOf[object]] = bounds[object];
+        for(auto node = leafOf[object]; node != INVALID && !dirty[node]; node = parents[node]){
+            dirty[node] = 1;
+            dirtyNodes.push_back(node);
+        }
+    }
+
+    // deepest first so children are refitted before their parents
+    std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<>{});
+    for(auto i : dirtyNodes){
+        auto& node = nodes[i];
+        Bounds box = empty();
+        if(node.leaf()){
+            for(auto o = node.offset; o < node.offset + node.count; o++) grow(box, boxes[o]);
+        }else{
+            grow(box, { nodes[i + 1].min, nodes[i + 1].max });
+            grow(box, { nodes[node.offset].min, nodes[node.offset].max });
+        }
+        node.min = box.min;
+        node.max = box.max;
+        dirty[i] = 0;
+    }
+    dirtyNodes.clear();
+}
+
+void Bvh::cull(const culling::Frustum& frustum, std::vector<uint32_t>& visible) const {
+    if(nodes.empty()) return;
+
+    // mask holds the planes the box still straddles, a box inside all of them is accepted whole
+    auto classify = [&](const glm::vec3& min, const glm::vec3& max, uint32_t& mask){
+        auto center = (min + max) * 0.5f;
+        auto extent = (max - min) * 0.5f;
+        for(uint32_t p = 0; p < 6; p++){
+            if(!(mask & (1u << p))) continue;
+            auto& plane = frustum.planes[p];
+            auto distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            auto radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+            if(distance < -radius) return false;
+            if(distance >= radius) mask &= ~(1u << p);
+        }
+        return true;
+    };
+
+    struct Entry{
+        uint32_t node;
+        uint32_t begin;
+        uint32_t mask;
+    };
+    SmallVector<Entry, 64> stack{ Entry{ 0, 0, 0x3f } };
+    while(!stack.empty()){
+        auto entry = stack.back();
+        stack.pop_back();
+
+        auto& node = nodes[entry.node];
+        if(!classify(node.min, node.max, entry.mask)) continue;
+        if(entry.mask == 0){
+            visible.insert(visible.end(), objects.begin() + entry.begin, objects.begin() + entry.begin + node.objectCount());
+        }else if(node.leaf()){
+            for(auto i = node.offset; i < node.offset + node.count; i++){
+                auto mask = entry.mask;
+                if(classify(boxes[i].min, boxes[i].max, mask)) visible.push_back(objects[i]);
+            }
+        }else{
+            stack.push_back({ node.offset, entry.begin + nodes[entry.node + 1].objectCount(), entry.mask });
+            stack.push_back({ entry.node + 1, entry.begin, entry.mask });
+        }
+    }
+}
+
+Bvh::Hit Bvh::raycast(const Ray& ray) const {
+    Hit hit;
+    if(nodes.empty()) return hit;
+
+    auto inverse = 1.0f / ray.direction;
+    hit.distance = ray.maxDistance;
+    // distance at which the ray enters the box, or a negative value when it misses or enters beyond the best hit
+    auto enter = [&](const glm::vec3& min, const glm::vec3& max){
+        auto t0 = (min - ray.origin) * inverse;
+        auto t1 = (max - ray.origin) * inverse;
+        auto near = glm::min(t0, t1);
+        auto far = glm::max(t0, t1);
+        auto entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        auto exit = std::min(std::min(far.x, far.y), far.z);
+        return entry <= exit && entry < hit.distance ? entry : -1.0f;
+    };
+
+    SmallVector<uint32_t, 64> stack{ 0 };
+    while(!stack.empty()){
+        auto index = stack.back();
+        stack.pop_back();
+
+        auto& node = nodes[index];
+        if(enter(node.min, node.max) < 0) continue;
+        if(node.leaf()){
+            for(auto i = node.offset; i < node.offset + node.count; i++){
+                auto distance = enter(boxes[i].min, boxes[i].max);
+                if(distance >= 0){
+                    hit.distance = distance;
+                    hit.object = objects[i];
+                }
+            }
+        }else{
+            // visit the nearer child first so the farther one is more likely to be pruned
+            auto left = index + 1;
+            auto right = node.offset;
+            auto leftDistance = enter(nodes[left].min, nodes[left].max);
+            auto rightDistance = enter(nodes[right].min, nodes[right].max);
+            if(leftDistance >= 0 && rightDistance >= 0){
+                stack.push_back(leftDistance < rightDistance ? right : left);
+                stack.push_back(leftDistance < rightDistance ? left : right);
+            }else if(leftDistance >= 0){
+                stack.push_back(left);
+            }else if(rightDistance >= 0){
+                stack.push_back(right);
+            }
+        }
+    }
+    return hit;
+}
+
+void Bvh::query(const Bounds& box, std::vector<uint32_t>& objects) const {
+    if(nodes.empty()) return;
+
+    auto overlaps = [&](const glm::vec3& min, const glm::vec3& max){
+        return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+    };
+    auto contains = [&](const glm::vec3& min, const glm::vec3& max){
+        return glm::all(glm::lessThanEqual(box.min, min)) && glm::all(glm::lessThanEqual(max, box.max));
+    };
+
+    struct Entry{
+        uint32_t node;
+        uint32_t begin;
+    };
+    SmallVector<Entry, 64> stack{ Entry{ 0, 0 } };
+    while(!stack.empty()){
+        auto entry = stack.back();
+        stack.pop_back();
+
+        auto& node = nodes[entry.node];
+        if(!overlaps(node.min, node.max)) continue;
+        if(contains(node.min, node.max)){
+            objects.insert(objects.end(), this->objects.begin() + entry.begin, this->objects.begin() + entry.begin + node.objectCount());
+        }else if(node.leaf()){
+            for(auto i = node.offset; i < node.offset + node.count; i++){
+                if(overlaps(boxes[i].min, boxes[i].max)) objects.push_back(this->objects[i]);
+            }
+        }else{
+            stack.push_back({ node.offset, entry.begin + nodes[entry.node + 1].objectCount() });
+            stack.push_back({ entry.node + 1, entry.begin });
+        }
+    }
+}
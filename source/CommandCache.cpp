@@ -0,0 +1,52 @@
+#include "CommandCache.h"
+#include "Metrics.h"
+
+static const std::string RECORDED_METRIC = "command_cache.recorded";
+static const std::string REUSED_METRIC = "command_cache.reused";
+
+CommandCache::CommandCache(VkDevice device, uint32_t queueFamilyIndex, uint32_t slots, VkCommandBufferLevel level)
+: level(level)
+, commandPool(device, queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT)
+, slots(slots)
+{}
+
+CommandCache::Entry& CommandCache::find(uint32_t slot, uint32_t bucket) {
+    auto& entries = slots.at(slot);
+    if(bucket >= entries.size()){
+        auto buffers = commandPool.allocate(bucket + 1 - COUNT(entries), level);
+        for(auto commandBuffer : buffers){
+            entries.push_back({ commandBuffer });
+        }
+    }
+    return entries[bucket];
+}
+
+void CommandCache::begin(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo* inheritance) const {
+    ASSERT(vkResetCommandBuffer(commandBuffer, 0));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pInheritanceInfo = inheritance;
+    // inheriting a render pass, or the attachments of dynamic rendering, makes the whole recording part of it
+    if(level == VK_COMMAND_BUFFER_LEVEL_SECONDARY && inheritance && (inheritance->renderPass || inheritance->pNext)){
+        beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    }
+    ASSERT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+}
+
+void CommandCache::invalidate() {
+    for(auto& entries : slots){
+        for(auto& entry : entries){
+            entry.recorded = false;
+        }
+    }
+}
+
+void CommandCache::beginFrame() {
+    lastStats = frameStats;
+    frameStats = {};
+
+    auto& registry = metrics::registry();
+    registry.set(RECORDED_METRIC, lastStats.recorded);
+    registry.set(REUSED_METRIC, lastStats.reused);
+}
@@ -0,0 +1,253 @@
+#include "Culling.h"
+#include "Arena.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULLING_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace culling {
+
+    using transform::Isa;
+
+    // volumes per job, a multiple of the widest kernel so only the last chunk takes the scalar tail
+    static constexpr size_t PARALLEL_GRAIN = 16384;
+
+    Frustum Frustum::extract(const glm::mat4& viewProjection) {
+        auto m = reinterpret_cast<const float*>(&viewProjection);
+        auto row = [m](int r){ return glm::vec4{ m[r], m[4 + r], m[8 + r], m[12 + r] }; };
+        auto x = row(0), y = row(1), z = row(2), w = row(3);
+
+        Frustum frustum;
+        frustum.planes[0] = w + x;
+        frustum.planes[1] = w - x;
+        frustum.planes[2] = w + y;
+        frustum.planes[3] = w - y;
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+        frustum.planes[4] = z;
+#else
+        frustum.planes[4] = w + z;
+#endif
+        frustum.planes[5] = w - z;
+
+        for(auto& plane : frustum.planes){
+            auto length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            plane = plane / length;
+        }
+        return frustum;
+    }
+
+    // lane indices of the set bits of every 8 bit mask packed to the front, and how many there are
+    struct Pack{
+        uint32_t lanes[8];
+        uint32_t count;
+    };
+
+    static const std::array<Pack, 256>& packTable(){
+        static const auto table = []{
+            std::array<Pack, 256> packs{};
+            for(uint32_t mask = 0; mask < 256; mask++){
+                auto& pack = packs[mask];
+                for(uint32_t lane = 0; lane < 8; lane++){
+                    if(mask & (1u << lane)) pack.lanes[pack.count++] = lane;
+                }
+            }
+            return packs;
+        }();
+        return table;
+    }
+
+    static bool inside(const Frustum& frustum, const Spheres& spheres, size_t i){
+        for(auto& plane : frustum.planes){
+            auto distance = plane[0] * spheres.x[i] + plane[1] * spheres.y[i] + plane[2] * spheres.z[i] + plane[3];
+            if(distance < -spheres.radius[i]) return false;
+        }
+        return true;
+    }
+
+    static bool inside(const Frustum& frustum, const Boxes& boxes, size_t i){
+        for(auto& plane : frustum.planes){
+            auto distance = plane[0] * boxes.x[i] + plane[1] * boxes.y[i] + plane[2] * boxes.z[i] + plane[3];
+            auto extent = std::abs(plane[0]) * boxes.ex[i] + std::abs(plane[1]) * boxes.ey[i] + std::abs(plane[2]) * boxes.ez[i];
+            if(distance < -extent) return false;
+        }
+        return true;
+    }
+
+    template<typename Volumes>
+    static size_t scalarKernel(const Frustum& frustum, const Volumes& volumes, size_t first, size_t last, uint32_t* visible){
+        size_t written = 0;
+        for(auto i = first; i < last; i++){
+            visible[written] = static_cast<uint32_t>(i);
+            written += inside(frustum, volumes, i) ? 1 : 0;
+        }
+        return written;
+    }
+
+#ifdef CULLING_X86
+    // the returned mask has bit l set when volume i + l is inside
+    static int insideMask4(const Frustum& frustum, const Spheres& spheres, size_t i){
+        auto x = _mm_loadu_ps(&spheres.x[i]), y = _mm_loadu_ps(&spheres.y[i]), z = _mm_loadu_ps(&spheres.z[i]);
+        auto negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(auto& plane : frustum.planes){
+            auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y))
+                                       , _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), z), _mm_set1_ps(plane[3])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        return _mm_movemask_ps(inside);
+    }
+
+    static int insideMask4(const Frustum& frustum, const Boxes& boxes, size_t i){
+        auto x = _mm_loadu_ps(&boxes.x[i]), y = _mm_loadu_ps(&boxes.y[i]), z = _mm_loadu_ps(&boxes.z[i]);
+        auto ex = _mm_loadu_ps(&boxes.ex[i]), ey = _mm_loadu_ps(&boxes.ey[i]), ez = _mm_loadu_ps(&boxes.ez[i]);
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(auto& plane : frustum.planes){
+            auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y))
+                                       , _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), z), _mm_set1_ps(plane[3])));
+            auto extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane[0])), ex), _mm_mul_ps(_mm_set1_ps(std::abs(plane[1])), ey))
+                                     , _mm_mul_ps(_mm_set1_ps(std::abs(plane[2])), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, extent), _mm_setzero_ps()));
+        }
+        return _mm_movemask_ps(inside);
+    }
+
+    template<typename Volumes>
+    static size_t sseKernel(const Frustum& frustum, const Volumes& volumes, size_t first, size_t last, uint32_t* visible, size_t& done){
+        auto& packs = packTable();
+        size_t written = 0;
+        auto i = first;
+        for(; i + 4 <= last; i += 4){
+            auto& pack = packs[insideMask4(frustum, volumes, i)];
+            for(uint32_t lane = 0; lane < 4; lane++){
+                visible[written + lane] = static_cast<uint32_t>(i) + pack.lanes[lane];
+            }
+            written += pack.count;
+        }
+        done = i;
+        return written;
+    }
+
+    TARGET_AVX2 static int insideMask8(const __m256* planes, const Spheres& spheres, size_t i){
+        auto x = _mm256_loadu_ps(&spheres.x[i]), y = _mm256_loadu_ps(&spheres.y[i]), z = _mm256_loadu_ps(&spheres.z[i]);
+        auto negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+        auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < 6; p++){
+            auto plane = planes + p * 4;
+            auto distance = _mm256_fmadd_ps(plane[0], x, _mm256_fmadd_ps(plane[1], y, _mm256_fmadd_ps(plane[2], z, plane[3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+        return _mm256_movemask_ps(inside);
+    }
+
+    // planes[24 + 4 * p + c] holds the absolute value of planes[4 * p + c], the box's reach along the normal
+    TARGET_AVX2 static int insideMask8(const __m256* planes, const Boxes& boxes, size_t i){
+        auto x = _mm256_loadu_ps(&boxes.x[i]), y = _mm256_loadu_ps(&boxes.y[i]), z = _mm256_loadu_ps(&boxes.z[i]);
+        auto ex = _mm256_loadu_ps(&boxes.ex[i]), ey = _mm256_loadu_ps(&boxes.ey[i]), ez = _mm256_loadu_ps(&boxes.ez[i]);
+        auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < 6; p++){
+            auto plane = planes + p * 4;
+            auto absolute = planes + 24 + p * 4;
+            auto distance = _mm256_fmadd_ps(plane[0], x, _mm256_fmadd_ps(plane[1], y, _mm256_fmadd_ps(plane[2], z, plane[3])));
+            distance = _mm256_fmadd_ps(absolute[0], ex, _mm256_fmadd_ps(absolute[1], ey, _mm256_fmadd_ps(absolute[2], ez, distance)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        return _mm256_movemask_ps(inside);
+    }
+
+    template<typename Volumes>
+    TARGET_AVX2 static size_t avx2Kernel(const Frustum& frustum, const Volumes& volumes, size_t first, size_t last, uint32_t* visible, size_t& done){
+        __m256 planes[48];
+        for(int p = 0; p < 6; p++){
+            for(int c = 0; c < 4; c++){
+                planes[p * 4 + c] = _mm256_set1_ps(frustum.planes[p][c]);
+                planes[24 + p * 4 + c] = _mm256_set1_ps(std::abs(frustum.planes[p][c]));
+            }
+        }
+
+        auto& packs = packTable();
+        const auto laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        size_t written = 0;
+        auto i = first;
+        for(; i + 8 <= last; i += 8){
+            auto& pack = packs[insideMask8(planes, volumes, i)];
+            auto indices = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), laneOffsets);
+            auto packed = _mm256_permutevar8x32_epi32(indices, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pack.lanes)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(visible + written), packed);
+            written += pack.count;
+        }
+        done = i;
+        return written;
+    }
+#endif
+
+    template<typename Volumes>
+    static size_t cullRange(Isa isa, const Frustum& frustum, const Volumes& volumes, size_t first, size_t last, uint32_t* visible){
+        size_t written = 0;
+        auto done = first;
+#ifdef CULLING_X86
+        if(isa == Isa::Avx2){
+            written = avx2Kernel(frustum, volumes, first, last, visible, done);
+        }else if(isa == Isa::Sse){
+            written = sseKernel(frustum, volumes, first, last, visible, done);
+        }
+#endif
+        return written + scalarKernel(frustum, volumes, done, last, visible + written);
+    }
+
+    template<typename Volumes>
+    static void cullParallel(jobs::Scheduler& scheduler, const Frustum& frustum, const Volumes& volumes, std::vector<uint32_t>& visible){
+        static const Isa isa = transform::detect();
+        const auto count = volumes.size();
+        visible.resize(count);
+        SmallVector<size_t, 128> counts((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+
+        // every chunk packs its survivors to the front of its own slice, the slices are then moved together
+        scheduler.parallelFor(0, count, PARALLEL_GRAIN, [&](size_t first, size_t last){
+            counts[first / PARALLEL_GRAIN] = cullRange(isa, frustum, volumes, first, last, visible.data() + first);
+        });
+        size_t written = 0;
+        for(size_t chunk = 0; chunk < counts.size(); chunk++){
+            // slices only move towards the front, one already in place, like the first, is left alone
+            auto slice = chunk * PARALLEL_GRAIN;
+            if(slice != written){
+                std::copy(visible.begin() + static_cast<std::ptrdiff_t>(slice), visible.begin() + static_cast<std::ptrdiff_t>(slice + counts[chunk])
+                          , visible.begin() + static_cast<std::ptrdiff_t>(written));
+            }
+            written += counts[chunk];
+        }
+        visible.resize(written);
+    }
+
+    size_t cull(const Frustum& frustum, const Spheres& spheres, uint32_t* visible) {
+        static const Isa isa = transform::detect();
+        return cullRange(isa, frustum, spheres, 0, spheres.size(), visible);
+    }
+
+    size_t cull(Isa isa, const Frustum& frustum, const Spheres& spheres, uint32_t* visible) {
+        return cullRange(isa, frustum, spheres, 0, spheres.size(), visible);
+    }
+
+    size_t cull(const Frustum& frustum, const Boxes& boxes, uint32_t* visible) {
+        static const Isa isa = transform::detect();
+        return cullRange(isa, frustum, boxes, 0, boxes.size(), visible);
+    }
+
+    size_t cull(Isa isa, const Frustum& frustum, const Boxes& boxes, uint32_t* visible) {
+        return cullRange(isa, frustum, boxes, 0, boxes.size(), visible);
+    }
+
+    void cull(jobs::Scheduler& scheduler, const Frustum& frustum, const Spheres& spheres, std::vector<uint32_t>& visible) {
+        cullParallel(scheduler, frustum, spheres, visible);
+    }
+
+    void cull(jobs::Scheduler& scheduler, const Frustum& frustum, const Boxes& boxes, std::vector<uint32_t>& visible) {
+        cullParallel(scheduler, frustum, boxes, visible);
+    }
+}
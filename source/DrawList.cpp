@@ -0,0 +1,177 @@
+#include "DrawList.h"
+#include <array>
+#include "Arena.h"
+#include "Metrics.h"
+
+static constexpr uint32_t DEPTH_SHIFT = 0;
+static constexpr uint32_t GEOMETRY_SHIFT = DEPTH_SHIFT + DrawList::DEPTH_BITS;
+static constexpr uint32_t DESCRIPTOR_SET_SHIFT = GEOMETRY_SHIFT + DrawList::GEOMETRY_BITS;
+static constexpr uint32_t PIPELINE_SHIFT = DESCRIPTOR_SET_SHIFT + DrawList::DESCRIPTOR_SET_BITS;
+static_assert(PIPELINE_SHIFT + DrawList::PIPELINE_BITS == 64, "sort key fields have to fill 64 bits");
+
+static constexpr uint32_t NONE_ID = ~0u;
+
+// packets per job, below this a single thread sorts faster than jobs can be handed out
+static constexpr size_t PARALLEL_GRAIN = 8192;
+
+static const std::string DRAWS_METRIC = "draw_list.draws";
+static const std::string BINDS_METRIC = "draw_list.binds";
+static const std::string BINDS_AVOIDED_METRIC = "draw_list.binds_avoided";
+
+static uint32_t field(uint64_t key, uint32_t shift, uint32_t bits){
+    return static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+}
+
+static void checkId(size_t count, uint32_t bits, const char* what){
+    if(count >= (1ull << bits)){
+        throw std::runtime_error{ std::string{ "draw list holds at most " } + std::to_string(1ull << bits) + " " + what };
+    }
+}
+
+DrawList::Id DrawList::addPipeline(VkPipeline pipeline) {
+    checkId(pipelines.size(), PIPELINE_BITS, "pipelines");
+    pipelines.push_back(pipeline);
+    return COUNT(pipelines) - 1;
+}
+
+DrawList::Id DrawList::addDescriptorSet(const DescriptorSet& descriptorSet) {
+    checkId(descriptorSets.size(), DESCRIPTOR_SET_BITS, "descriptor sets");
+    descriptorSets.push_back(descriptorSet);
+    return COUNT(descriptorSets) - 1;
+}
+
+DrawList::Id DrawList::addGeometry(Geometry geometry) {
+    checkId(geometries.size(), GEOMETRY_BITS, "geometries");
+    geometries.push_back(std::move(geometry));
+    return COUNT(geometries) - 1;
+}
+
+uint64_t DrawList::key(Id pipeline, Id descriptorSet, Id geometry, float depth) {
+    constexpr auto maxDepth = static_cast<float>((1u << DEPTH_BITS) - 1);
+    auto bucket = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * maxDepth);
+    return static_cast<uint64_t>(pipeline) << PIPELINE_SHIFT
+         | static_cast<uint64_t>(descriptorSet) << DESCRIPTOR_SET_SHIFT
+         | static_cast<uint64_t>(geometry) << GEOMETRY_SHIFT
+         | bucket << DEPTH_SHIFT;
+}
+
+void DrawList::add(Id pipeline, Id descriptorSet, Id geometry, float depth, const Draw& draw) {
+    packets.push_back({ key(pipeline, descriptorSet, geometry, depth), COUNT(draws) });
+    draws.push_back(draw);
+}
+
+void DrawList::clear() {
+    draws.clear();
+    packets.clear();
+}
+
+void DrawList::sort(jobs::Scheduler& scheduler) {
+    if(packets.size() < 2) return;
+
+    // digits where every key agrees leave the order as it is
+    uint64_t differing = 0;
+    for(auto& packet : packets){
+        differing |= packet.key ^ packets.front().key;
+    }
+
+    auto count = packets.size();
+    auto chunks = std::max<size_t>(1, std::min<size_t>(scheduler.workerCount() + 1, count / PARALLEL_GRAIN));
+    auto chunkSize = (count + chunks - 1) / chunks;
+    // grows to the most chunks any sort has used and stays, steady state sorts don't allocate
+    if(offsets.size() < chunks){
+        offsets.resize(chunks);
+    }
+    scratch.resize(count);
+
+    for(uint32_t shift = 0; shift < 64; shift += RADIX_BITS){
+        if(!field(differing, shift, RADIX_BITS)) continue;
+
+        scheduler.parallelFor(0, chunks, 1, [&](size_t first, size_t last){
+            for(auto chunk = first; chunk < last; chunk++){
+                auto& histogram = offsets[chunk];
+                histogram.fill(0);
+                auto end = std::min(count, (chunk + 1) * chunkSize);
+                for(auto i = chunk * chunkSize; i < end; i++){
+                    histogram[field(packets[i].key, shift, RADIX_BITS)]++;
+                }
+            }
+        });
+
+        // digit major, chunk minor, so equal digits keep their order and the sort stays stable
+        uint32_t offset = 0;
+        for(auto digit = 0u; digit < RADIX; digit++){
+            for(auto chunk = 0u; chunk < chunks; chunk++){
+                auto& histogram = offsets[chunk];
+                auto digitCount = histogram[digit];
+                histogram[digit] = offset;
+                offset += digitCount;
+            }
+        }
+
+        scheduler.parallelFor(0, chunks, 1, [&](size_t first, size_t last){
+            for(auto chunk = first; chunk < last; chunk++){
+                auto& next = offsets[chunk];
+                auto end = std::min(count, (chunk + 1) * chunkSize);
+                for(auto i = chunk * chunkSize; i < end; i++){
+                    scratch[next[field(packets[i].key, shift, RADIX_BITS)]++] = packets[i];
+                }
+            }
+        });
+        packets.swap(scratch);
+    }
+}
+
+const DrawList::Counters& DrawList::submit(VkCommandBuffer commandBuffer) {
+    Counters counters{};
+    counters.draws = COUNT(packets);
+
+    auto pipeline = NONE_ID;
+    auto descriptorSet = NONE_ID;
+    auto geometry = NONE_ID;
+    for(auto& packet : packets){
+        auto nextPipeline = field(packet.key, PIPELINE_SHIFT, PIPELINE_BITS);
+        auto nextDescriptorSet = field(packet.key, DESCRIPTOR_SET_SHIFT, DESCRIPTOR_SET_BITS);
+        auto nextGeometry = field(packet.key, GEOMETRY_SHIFT, GEOMETRY_BITS);
+
+        if(nextPipeline != pipeline){
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[nextPipeline]);
+            pipeline = nextPipeline;
+            counters.pipelineBinds++;
+        }else{
+            counters.bindsAvoided++;
+        }
+
+        auto& set = descriptorSets[nextDescriptorSet];
+        if(set.set != VK_NULL_HANDLE){
+            if(nextDescriptorSet != descriptorSet){
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, set.layout, set.firstSet, 1, &set.set, 0, nullptr);
+                descriptorSet = nextDescriptorSet;
+                counters.descriptorSetBinds++;
+            }else{
+                counters.bindsAvoided++;
+            }
+        }
+
+        if(nextGeometry != geometry){
+            auto& buffers = geometries[nextGeometry];
+            SmallVector<VkDeviceSize, 4> offsets(buffers.vertexBuffers.size());
+            vkCmdBindVertexBuffers(commandBuffer, 0, COUNT(buffers.vertexBuffers), buffers.vertexBuffers.data(), offsets.data());
+            vkCmdBindIndexBuffer(commandBuffer, buffers.indexBuffer, 0, buffers.indexType);
+            geometry = nextGeometry;
+            counters.geometryBinds++;
+        }else{
+            counters.bindsAvoided++;
+        }
+
+        auto& draw = draws[packet.draw];
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+    }
+
+    auto& registry = metrics::registry();
+    registry.set(DRAWS_METRIC, counters.draws);
+    registry.set(BINDS_METRIC, counters.pipelineBinds + counters.descriptorSetBinds + counters.geometryBinds);
+    registry.set(BINDS_AVOIDED_METRIC, counters.bindsAvoided);
+
+    lastCounters = counters;
+    return lastCounters;
+}
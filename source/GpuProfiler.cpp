@@ -0,0 +1,238 @@
+#include "GpuProfiler.h"
+#include <fstream>
+
+// recalibrating now and then keeps the GPU track from drifting against the host clock
+static constexpr uint32_t COLLECTS_PER_CALIBRATION = 256;
+
+// order of the counters in a result follows the bit order of the flags
+static constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+static constexpr uint32_t PIPELINE_STATISTICS_COUNT = 6;
+
+GpuProfiler::GpuProfiler(VulkanDevice& device, uint32_t poolCount, uint32_t queueFamily, uint32_t maxScopes)
+: device(device)
+, maxScopes(maxScopes)
+{
+    auto properties = device.getProperties();
+    auto validBits = device.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+    if(validBits == 0 || properties.limits.timestampPeriod == 0){
+        spdlog::warn("GPU timestamps are not supported on queue family {}, profiling disabled", queueFamily);
+        return;
+    }
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = maxScopes * 2;
+
+    pools.resize(poolCount);
+    for(auto& pool : pools){
+        VkQueryPool queryPool;
+        ASSERT(vkCreateQueryPool(device, &createInfo, nullptr, &queryPool));
+        pool.queries = VulkanQueryPool{ device, queryPool };
+    }
+
+    statisticsSupported = device.enabledFeatures.pipelineStatisticsQuery == VK_TRUE;
+    if(statisticsSupported){
+        createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        createInfo.queryCount = maxScopes;
+        createInfo.pipelineStatistics = PIPELINE_STATISTICS;
+        for(auto& pool : pools){
+            VkQueryPool queryPool;
+            ASSERT(vkCreateQueryPool(device, &createInfo, nullptr, &queryPool));
+            pool.statistics = VulkanQueryPool{ device, queryPool };
+        }
+    }
+    results.resize(maxScopes * (PIPELINE_STATISTICS_COUNT + 1));
+
+    if(device.extensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)){
+        getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT"));
+        calibrate();
+    }
+}
+
+void GpuProfiler::calibrate() {
+    if(!getCalibratedTimestamps) return;
+
+    VkCalibratedTimestampInfoEXT infos[2]{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = HOST_TIME_DOMAIN;
+
+    uint64_t timestamps[2];
+    uint64_t maxDeviation;
+    if(getCalibratedTimestamps(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS){
+        getCalibratedTimestamps = nullptr;
+        spdlog::warn("timestamp calibration failed, GPU scopes will not be traced");
+        return;
+    }
+    calibrationTicks = timestamps[0] & timestampMask;
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    calibrationHostTime = static_cast<uint64_t>(static_cast<double>(timestamps[1]) * 1e9 / static_cast<double>(frequency.QuadPart));
+#else
+    calibrationHostTime = timestamps[1];
+#endif
+    collectsSinceCalibration = 0;
+}
+
+uint64_t GpuProfiler::toHostTime(uint64_t ticks) const {
+    auto elapsed = static_cast<int64_t>(ticks - calibrationTicks);
+    return calibrationHostTime + static_cast<int64_t>(static_cast<double>(elapsed) * timestampPeriod);
+}
+
+void GpuProfiler::begin(VkCommandBuffer commandBuffer, uint32_t pool) {
+    if(!enabled()) return;
+    auto& target = pools[pool];
+    target.scopes.clear();
+    target.passes.clear();
+    target.recorded = true;
+    vkCmdResetQueryPool(commandBuffer, target.queries, 0, maxScopes * 2);
+    if(statisticsSupported){
+        vkCmdResetQueryPool(commandBuffer, target.statistics, 0, maxScopes);
+    }
+}
+
+GpuProfiler::Scope GpuProfiler::scope(VkCommandBuffer commandBuffer, uint32_t pool, const char* name) {
+    if(!enabled() || pools[pool].scopes.size() >= maxScopes){
+        return Scope{ nullptr, commandBuffer, pool, 0 };
+    }
+    auto& target = pools[pool];
+    auto query = static_cast<uint32_t>(target.scopes.size()) * 2;
+    target.scopes.push_back(name);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, target.queries, query);
+
+    return Scope{ this, commandBuffer, pool, query };
+}
+
+GpuProfiler::Scope GpuProfiler::pass(VkCommandBuffer commandBuffer, uint32_t pool, const char* name) {
+    if(!enabled() || pools[pool].scopes.size() >= maxScopes){
+        return Scope{ nullptr, commandBuffer, pool, 0 };
+    }
+    auto& target = pools[pool];
+    auto query = static_cast<uint32_t>(target.scopes.size()) * 2;
+    target.scopes.push_back(name);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, target.queries, query);
+
+    std::optional<uint32_t> statisticsQuery;
+    if(statisticsSupported && target.passes.size() < maxScopes){
+        statisticsQuery = COUNT(target.passes);
+        target.passes.push_back(target.scopes.back());
+        vkCmdBeginQuery(commandBuffer, target.statistics, *statisticsQuery, 0);
+    }
+
+    return Scope{ this, commandBuffer, pool, query, statisticsQuery };
+}
+
+void GpuProfiler::end(VkCommandBuffer commandBuffer, uint32_t pool, uint32_t query, std::optional<uint32_t> statisticsQuery) {
+    if(statisticsQuery){
+        vkCmdEndQuery(commandBuffer, pools[pool].statistics, *statisticsQuery);
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pools[pool].queries, query + 1);
+}
+
+void GpuProfiler::collect(uint32_t pool) {
+    if(!enabled()) return;
+    auto& source = pools[pool];
+    if(!source.recorded || source.scopes.empty()) return;
+
+    // each query yields its value followed by an availability word
+    auto queryCount = COUNT(source.scopes) * 2;
+    auto result = vkGetQueryPoolResults(device, source.queries, 0, queryCount, queryCount * 2 * sizeof(uint64_t)
+                                        , results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if(result != VK_SUCCESS && result != VK_NOT_READY) return;
+
+    if(getCalibratedTimestamps && ++collectsSinceCalibration >= COLLECTS_PER_CALIBRATION){
+        calibrate();
+    }
+    for(auto i = 0u; i < source.scopes.size(); i++){
+        auto start = &results[i * 4];
+        auto end = start + 2;
+        if(!start[1] || !end[1]) continue;
+        auto ticks = ((end[0] & timestampMask) - (start[0] & timestampMask)) & timestampMask;
+        auto stats = scopeStats.find(std::string_view{ source.scopes[i] });
+        if(stats == scopeStats.end()){
+            stats = scopeStats.emplace(source.scopes[i], RollingStats{}).first;
+        }
+        stats->second.add(static_cast<double>(ticks) * timestampPeriod * 1e-6);
+
+        if(getCalibratedTimestamps){
+            auto begin = toHostTime(start[0] & timestampMask);
+            trace::complete(source.scopes[i], "gpu", begin, begin + static_cast<uint64_t>(static_cast<double>(ticks) * timestampPeriod), trace::Track::Gpu);
+        }
+    }
+    collectStatistics(source);
+}
+
+void GpuProfiler::collectStatistics(Pool& source) {
+    if(!statisticsSupported || source.passes.empty()) return;
+
+    constexpr VkDeviceSize stride = (PIPELINE_STATISTICS_COUNT + 1) * sizeof(uint64_t);
+    auto queryCount = COUNT(source.passes);
+    auto result = vkGetQueryPoolResults(device, source.statistics, 0, queryCount, queryCount * stride
+                                        , results.data(), stride, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if(result != VK_SUCCESS && result != VK_NOT_READY) return;
+
+    auto& registry = metrics::registry();
+    for(auto i = 0u; i < queryCount; i++){
+        auto counters = &results[i * (PIPELINE_STATISTICS_COUNT + 1)];
+        if(!counters[PIPELINE_STATISTICS_COUNT]) continue;
+
+        std::string_view name = source.passes[i];
+        auto pass = passStatistics.find(name);
+        if(pass == passStatistics.end()){
+            pass = passStatistics.emplace(name, PipelineStatistics{}).first;
+            auto prefix = "gpu." + std::string{ name } + ".";
+            statisticNames.emplace(name, std::vector<std::string>{
+                prefix + "input_assembly_vertices", prefix + "input_assembly_primitives", prefix + "vertex_shader_invocations"
+                , prefix + "clipping_primitives", prefix + "fragment_shader_invocations", prefix + "compute_shader_invocations" });
+        }
+        auto& statistics = pass->second;
+        statistics.inputAssemblyVertices = counters[0];
+        statistics.inputAssemblyPrimitives = counters[1];
+        statistics.vertexShaderInvocations = counters[2];
+        statistics.clippingPrimitives = counters[3];
+        statistics.fragmentShaderInvocations = counters[4];
+        statistics.computeShaderInvocations = counters[5];
+
+        auto& names = statisticNames.find(name)->second;
+        registry.set(names[0], static_cast<double>(statistics.inputAssemblyVertices));
+        registry.set(names[1], static_cast<double>(statistics.inputAssemblyPrimitives));
+        registry.set(names[2], static_cast<double>(statistics.vertexShaderInvocations));
+        registry.set(names[3], static_cast<double>(statistics.clippingPrimitives));
+        registry.set(names[4], static_cast<double>(statistics.fragmentShaderInvocations));
+        registry.set(names[5], static_cast<double>(statistics.computeShaderInvocations));
+    }
+}
+
+void GpuProfiler::report() const {
+    for(auto& [name, stats] : scopeStats){
+        spdlog::info("gpu {}: min {:.3f} ms, avg {:.3f} ms, p99 {:.3f} ms over {} samples"
+                     , name, stats.min(), stats.average(), stats.percentile(0.99), stats.samples.size());
+    }
+    for(auto& [name, statistics] : passStatistics){
+        spdlog::info("gpu {}: {} vertices, {} primitives, {} vertex / {} fragment / {} compute invocations, {} primitives after clipping"
+                     , name, statistics.inputAssemblyVertices, statistics.inputAssemblyPrimitives, statistics.vertexShaderInvocations
+                     , statistics.fragmentShaderInvocations, statistics.computeShaderInvocations, statistics.clippingPrimitives);
+    }
+}
+
+void GpuProfiler::write(const io::fs::path& path) const {
+    std::ofstream fout{ path };
+    if(!fout.good()) throw std::runtime_error{ "unable to write profile to " + path.string() };
+
+    fout << "scope,min_ms,avg_ms,p99_ms,samples,total_samples\n";
+    for(auto& [name, stats] : scopeStats){
+        fout << name << ',' << stats.min() << ',' << stats.average() << ',' << stats.percentile(0.99)
+             << ',' << stats.samples.size() << ',' << stats.count << '\n';
+    }
+}
@@ -0,0 +1,242 @@
+#include "Jobs.h"
+#include "Trace.h"
+
+namespace jobs {
+
+    static constexpr uint32_t SPIN_COUNT = 64;
+
+    static thread_local Scheduler* currentScheduler = nullptr;
+    static thread_local uint32_t currentWorker = 0;
+
+    namespace detail {
+
+        Deque::Deque(int64_t capacity) {
+            rings.push_back(std::make_unique<Ring>(capacity));
+            ring.store(rings.back().get(), std::memory_order_relaxed);
+        }
+
+        void Deque::push(Job* job) {
+            auto b = bottom.load(std::memory_order_relaxed);
+            auto t = top.load(std::memory_order_acquire);
+            auto r = ring.load(std::memory_order_relaxed);
+            if(b - t > r->capacity - 1){
+                r = grow(r, t, b);
+            }
+            r->put(b, job);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        Job* Deque::pop() {
+            auto b = bottom.load(std::memory_order_relaxed) - 1;
+            auto r = ring.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto t = top.load(std::memory_order_relaxed);
+
+            if(t > b){
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            auto job = r->get(b);
+            if(t == b){
+                // last job, race thieves for it
+                if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+                    job = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* Deque::steal() {
+            auto t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto b = bottom.load(std::memory_order_acquire);
+            if(t >= b) return nullptr;
+
+            auto job = ring.load(std::memory_order_acquire)->get(t);
+            if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+                return nullptr;
+            }
+            return job;
+        }
+
+        Deque::Ring* Deque::grow(Ring* old, int64_t t, int64_t b) {
+            rings.push_back(std::make_unique<Ring>(old->capacity * 2));
+            auto grown = rings.back().get();
+            for(auto i = t; i < b; i++){
+                grown->put(i, old->get(i));
+            }
+            ring.store(grown, std::memory_order_release);
+            return grown;
+        }
+    }
+
+    Scheduler::Scheduler(uint32_t workerCount) {
+        deques.reserve(workerCount);
+        for(auto i = 0u; i < workerCount; i++){
+            deques.push_back(std::make_unique<detail::Deque>());
+        }
+        workers.reserve(workerCount);
+        for(auto i = 0u; i < workerCount; i++){
+            workers.emplace_back([this, i]{ work(i); });
+        }
+    }
+
+    Scheduler::~Scheduler() {
+        {
+            std::lock_guard<std::mutex> lock{ sleepMutex };
+            running = false;
+        }
+        wake.notify_all();
+        for(auto& worker : workers){
+            worker.join();
+        }
+        for(auto& deque : deques){
+            while(auto job = deque->pop()) delete job;
+        }
+        for(auto job : queue){
+            delete job;
+        }
+    }
+
+    void Scheduler::run(std::function<void()> task, Counter& counter) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        submit(new Job{ std::move(task), &counter });
+    }
+
+    void Scheduler::run(std::function<void()> task, Counter& counter, Counter& dependency) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        auto job = new Job{ std::move(task), &counter };
+        {
+            std::lock_guard<std::mutex> lock{ dependency.mutex };
+            if(!dependency.done()){
+                dependency.continuations.push_back(job);
+                return;
+            }
+        }
+        submit(job);
+    }
+
+    void Scheduler::wait(Counter& counter) {
+        uint32_t misses = 0;
+        while(!counter.done()){
+            if(auto job = find()){
+                execute(job);
+                misses = 0;
+            }else if(++misses > SPIN_COUNT){
+                std::this_thread::yield();
+            }
+        }
+
+        // the last job may still be inside complete(), it holds the mutex until it stops touching the counter
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock{ counter.mutex };
+            std::swap(error, counter.error);
+        }
+        if(error) std::rethrow_exception(error);
+    }
+
+    void Scheduler::submit(Job* job) {
+        if(currentScheduler == this){
+            deques[currentWorker]->push(job);
+        }else{
+            std::lock_guard<std::mutex> lock{ queueMutex };
+            queue.push_back(job);
+            queueSize.fetch_add(1, std::memory_order_relaxed);
+        }
+        queued.fetch_add(1);
+        if(sleepers.load() > 0){
+            { std::lock_guard<std::mutex> lock{ sleepMutex }; }
+            wake.notify_one();
+        }
+    }
+
+    Job* Scheduler::find() {
+        Job* job = nullptr;
+        auto self = currentScheduler == this;
+        if(self){
+            job = deques[currentWorker]->pop();
+        }
+        if(!job && queueSize.load(std::memory_order_relaxed) > 0){
+            std::lock_guard<std::mutex> lock{ queueMutex };
+            if(!queue.empty()){
+                job = queue.front();
+                queue.pop_front();
+                queueSize.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        if(!job && !deques.empty()){
+            static thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1u;
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            auto count = static_cast<uint32_t>(deques.size());
+            for(auto i = 0u; i < count && !job; i++){
+                auto victim = (seed + i) % count;
+                if(self && victim == currentWorker) continue;
+                job = deques[victim]->steal();
+            }
+        }
+        if(job){
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    void Scheduler::execute(Job* job) {
+        std::exception_ptr error;
+        try{
+            job->task();
+        }catch(...){
+            error = std::current_exception();
+        }
+        auto& counter = *job->counter;
+        delete job;
+        complete(counter, error);
+    }
+
+    void Scheduler::complete(Counter& counter, std::exception_ptr error) {
+        std::vector<Job*> ready;
+        {
+            std::lock_guard<std::mutex> lock{ counter.mutex };
+            if(error && !counter.error){
+                counter.error = error;
+            }
+            if(counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1){
+                ready.swap(counter.continuations);
+            }
+        }
+        for(auto job : ready){
+            submit(job);
+        }
+    }
+
+    void Scheduler::work(uint32_t index) {
+        trace::setThreadName("job worker");
+        currentScheduler = this;
+        currentWorker = index;
+
+        uint32_t misses = 0;
+        while(running){
+            if(auto job = find()){
+                execute(job);
+                misses = 0;
+            }else if(++misses > SPIN_COUNT){
+                idle();
+                misses = 0;
+            }else{
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void Scheduler::idle() {
+        std::unique_lock<std::mutex> lock{ sleepMutex };
+        sleepers.fetch_add(1);
+        wake.wait(lock, [&]{ return !running || queued.load() > 0; });
+        sleepers.fetch_sub(1);
+    }
+}
@@ -0,0 +1,278 @@
+#include "MaterialTable.h"
+#include <array>
+#include <cstring>
+#include "Initializers.h"
+
+// vkCmdUpdateBuffer takes at most this many bytes per call
+static constexpr VkDeviceSize MAX_UPDATE_SIZE = 65536;
+
+static constexpr VkPipelineStageFlags SHADER_STAGES = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+MaterialTable::MaterialTable(VulkanDevice& device, uint32_t maxMaterials, VkExtent2D textureExtent, uint32_t textureLayers)
+: device(&device)
+, maxMaterials(maxMaterials)
+, textureExtent(textureExtent)
+, textureLayers(textureLayers + 1)
+{
+    if(maxMaterials == 0) throw std::runtime_error{ "material table needs room for at least one material" };
+
+    materials.reserve(maxMaterials);
+    buffer = device.createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly
+                                 , sizeof(Material) * maxMaterials);
+    commandPool = VulkanCommandPool{ device, *device.queueFamilyIndex.graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT };
+
+    createTextureArray(device);
+    createDescriptorSet(device);
+}
+
+void MaterialTable::createTextureArray(VulkanDevice& device) {
+    auto mipLevels = 1u;
+    while((std::max(textureExtent.width, textureExtent.height) >> mipLevels) > 0){
+        mipLevels++;
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = TEXTURE_FORMAT;
+    imageInfo.extent = { textureExtent.width, textureExtent.height, 1 };
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = textureLayers;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    textures = device.createImage(imageInfo, MemoryUsage::GpuOnly);
+
+    VkImageView view;
+    auto viewInfo = initializers::imageViewCreateInfo(textures.image, TEXTURE_FORMAT
+                                                      , { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, textureLayers }, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+    ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &view));
+    texturesView = VulkanImageView{ device, view };
+
+    auto samplerInfo = initializers::samplerCreateInfo(static_cast<float>(mipLevels));
+    VkSampler vkSampler;
+    ASSERT(vkCreateSampler(device, &samplerInfo, nullptr, &vkSampler));
+    sampler = VulkanSampler{ device, vkSampler };
+
+    // every layer starts out white so the view is complete before any texture is added
+    commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
+        auto toTransfer = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                           , 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkClearColorValue white{ {1, 1, 1, 1} };
+        VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, textureLayers };
+        vkCmdClearColorImage(commandBuffer, textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white, 1, &range);
+
+        auto toShader = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                         , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toShader);
+    });
+    usedLayers = 1;
+}
+
+void MaterialTable::createDescriptorSet(VkDevice device) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings{
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+            { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+    };
+
+    VkDescriptorSetLayoutCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.bindingCount = COUNT(bindings);
+    createInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout;
+    ASSERT(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &layout));
+    setLayout = VulkanDescriptorSetLayout{ device, layout };
+
+    descriptorPool = VulkanDescriptorPool{ device, 1, {
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+    }, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT };
+    descriptors = std::move(descriptorPool.allocate({ setLayout.handle }).front());
+
+    VkDescriptorBufferInfo bufferInfo{ buffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorImageInfo imageInfo{ sampler, texturesView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = descriptors;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &bufferInfo;
+
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = descriptors;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, COUNT(writes), writes.data(), 0, nullptr);
+}
+
+MaterialTable::Id MaterialTable::add(const Material& material) {
+    if(materials.size() >= maxMaterials){
+        throw std::runtime_error{ fmt::format("material table holds at most {} materials", maxMaterials) };
+    }
+    materials.push_back(material);
+    auto id = COUNT(materials) - 1;
+    markDirty(id);
+    return id;
+}
+
+void MaterialTable::set(Id id, const Material& material) {
+    materials.at(id) = material;
+    markDirty(id);
+}
+
+void MaterialTable::markDirty(Id id) {
+    if(dirtyBegin == dirtyEnd){
+        dirtyBegin = id;
+        dirtyEnd = id + 1;
+    }else{
+        dirtyBegin = std::min(dirtyBegin, id);
+        dirtyEnd = std::max(dirtyEnd, id + 1);
+    }
+}
+
+uint32_t MaterialTable::addTexture(Span<const uint8_t> texels) {
+    VkDeviceSize layerSize = VkDeviceSize{ textureExtent.width } * textureExtent.height * 4;
+    if(texels.size() != layerSize){
+        throw std::runtime_error{ fmt::format("texture has {} bytes, a layer of the material table's textures takes {}", texels.size(), layerSize) };
+    }
+    if(usedLayers >= textureLayers){
+        throw std::runtime_error{ fmt::format("material table holds at most {} textures", textureLayers - 1) };
+    }
+    auto layer = usedLayers;
+
+    auto staging = device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly, layerSize);
+    std::memcpy(staging.map(), texels.data(), layerSize);
+    staging.unmap();
+
+    commandPool.oneTime(device->queues.graphics, [&](VkCommandBuffer commandBuffer){
+        auto toTransfer = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                           , VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT
+                                                           , { VK_IMAGE_ASPECT_COLOR_BIT, 0, textures.mipLevels, layer, 1 });
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layer, 1 };
+        region.imageExtent = { textureExtent.width, textureExtent.height, 1 };
+        vkCmdCopyBufferToImage(commandBuffer, staging, textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        generateMips(commandBuffer, layer);
+    });
+
+    usedLayers++;
+    return layer;
+}
+
+uint32_t MaterialTable::addTexture(const VulkanImage& source, uint32_t level) {
+    constexpr VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if((device->getFormatProperties(source.format).optimalTilingFeatures & blitFeatures) != blitFeatures){
+        throw std::runtime_error{ fmt::format("textures of format {} can not be blitted into the material table", static_cast<int>(source.format)) };
+    }
+    if(level >= source.mipLevels){
+        throw std::runtime_error{ fmt::format("texture has {} mip levels, level {} doesn't exist", source.mipLevels, level) };
+    }
+    if(usedLayers >= textureLayers){
+        throw std::runtime_error{ fmt::format("material table holds at most {} textures", textureLayers - 1) };
+    }
+    auto layer = usedLayers;
+
+    commandPool.oneTime(device->queues.graphics, [&](VkCommandBuffer commandBuffer){
+        std::array<VkImageMemoryBarrier, 2> toTransfer{
+            initializers::imageMemoryBarrier(source, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                             , VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT
+                                             , { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 }),
+            initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                             , VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT
+                                             , { VK_IMAGE_ASPECT_COLOR_BIT, 0, textures.mipLevels, layer, 1 })
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr
+                             , COUNT(toTransfer), toTransfer.data());
+
+        // scaled to the table's extent and converted to its format by the blit
+        VkImageBlit blit{};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        blit.srcOffsets[1] = { static_cast<int32_t>(std::max(1u, source.extent.width >> level))
+                               , static_cast<int32_t>(std::max(1u, source.extent.height >> level)), 1 };
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layer, 1 };
+        blit.dstOffsets[1] = { static_cast<int32_t>(textureExtent.width), static_cast<int32_t>(textureExtent.height), 1 };
+        vkCmdBlitImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        auto sourceToShader = initializers::imageMemoryBarrier(source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                               , VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                               , { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 });
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &sourceToShader);
+
+        generateMips(commandBuffer, layer);
+    });
+
+    usedLayers++;
+    return layer;
+}
+
+// blits the layer's mip chain, each level from the one above, level 0 and the rest of the layer in transfer dst layout
+void MaterialTable::generateMips(VkCommandBuffer commandBuffer, uint32_t layer) {
+    auto width = static_cast<int32_t>(textureExtent.width);
+    auto height = static_cast<int32_t>(textureExtent.height);
+    for(auto level = 1u; level < textures.mipLevels; level++){
+        auto barrier = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                        , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT
+                                                        , { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, layer, 1 });
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, layer, 1 };
+        blit.srcOffsets[1] = { width, height, 1 };
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, layer, 1 };
+        blit.dstOffsets[1] = { width, height, 1 };
+        vkCmdBlitImage(commandBuffer, textures, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                   , VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                   , { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, layer, 1 });
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    auto toShader = initializers::imageMemoryBarrier(textures, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                     , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                     , { VK_IMAGE_ASPECT_COLOR_BIT, textures.mipLevels - 1, 1, layer, 1 });
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toShader);
+}
+
+void MaterialTable::update(VkCommandBuffer commandBuffer) {
+    if(dirtyBegin == dirtyEnd) return;
+
+    // draws of earlier frames may still read the range being replaced
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = sizeof(Material) * dirtyBegin;
+    barrier.size = sizeof(Material) * (dirtyEnd - dirtyBegin);
+    vkCmdPipelineBarrier(commandBuffer, SHADER_STAGES, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    auto data = reinterpret_cast<const char*>(materials.data());
+    for(auto offset = barrier.offset; offset < barrier.offset + barrier.size; offset += MAX_UPDATE_SIZE){
+        auto size = std::min(MAX_UPDATE_SIZE, barrier.offset + barrier.size - offset);
+        vkCmdUpdateBuffer(commandBuffer, buffer, offset, size, data + offset);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, SHADER_STAGES, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    dirtyBegin = dirtyEnd = 0;
+}
@@ -0,0 +1,281 @@
+#include "OcclusionCuller.h"
+#include <cstring>
+#include "VulkanShaderModule.h"
+#include "VulkanCommandBuffer.h"
+#include "Initializers.h"
+
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+static constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
+
+static VulkanPipeline computePipeline(VkDevice device, VkPipelineLayout layout, const io::fs::path& path){
+    VulkanShaderModule module{ device, path };
+
+    VkComputePipelineCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module = module;
+    createInfo.stage.pName = "main";
+    createInfo.layout = layout;
+    createInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline;
+    ASSERT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline));
+    return VulkanPipeline{ device, pipeline };
+}
+
+static VulkanDescriptorSetLayout descriptorSetLayout(VkDevice device, Span<const VkDescriptorType> types){
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    for(auto i = 0u; i < types.size(); i++){
+        bindings.push_back({ i, types[i], 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+    }
+
+    VkDescriptorSetLayoutCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.bindingCount = COUNT(bindings);
+    createInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout;
+    ASSERT(vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &layout));
+    return VulkanDescriptorSetLayout{ device, layout };
+}
+
+static void computeBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess
+                           , VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages){
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+OcclusionCuller::OcclusionCuller(VulkanDevice& device, const io::fs::path& shaderDir, VkExtent2D depthExtent
+                                 , Span<const VkImageView> depthViews, uint32_t maxObjects, uint32_t indexCount)
+: depthExtent(depthExtent)
+, maxObjects(maxObjects)
+, indexCount(indexCount)
+{
+    objects = device.createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::CpuToGpu, sizeof(glm::vec4) * maxObjects);
+    drawn = device.createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, sizeof(uint32_t) * maxObjects);
+    counts = device.createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                 , MemoryUsage::GpuToCpu, sizeof(uint32_t) * PHASES);
+    draws = device.createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                                , MemoryUsage::GpuOnly, sizeof(VkDrawIndexedIndirectCommand) * maxObjects * PHASES);
+
+    createPyramid(device);
+    createPipelines(device, shaderDir);
+    createDescriptorSets(device, depthViews);
+}
+
+void OcclusionCuller::createPyramid(VulkanDevice& device) {
+    // level 0 halves the depth buffer, odd sizes round down and the last texel takes the remainder
+    pyramidExtent = { std::max(depthExtent.width / 2, 1u), std::max(depthExtent.height / 2, 1u) };
+    pyramidLevels = 1;
+    while((std::max(pyramidExtent.width, pyramidExtent.height) >> pyramidLevels) > 0){
+        pyramidLevels++;
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.extent = { pyramidExtent.width, pyramidExtent.height, 1 };
+    imageInfo.mipLevels = pyramidLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    pyramid = device.createImage(imageInfo, MemoryUsage::GpuOnly);
+
+    VkImageView view;
+    auto viewInfo = initializers::imageViewCreateInfo(pyramid.image, VK_FORMAT_R32_SFLOAT, { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels, 0, 1 });
+    ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &view));
+    pyramidView = VulkanImageView{ device, view };
+
+    for(auto level = 0u; level < pyramidLevels; level++){
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &view));
+        levelViews.emplace_back(device, view);
+    }
+
+    auto samplerInfo = initializers::samplerCreateInfo(static_cast<float>(pyramidLevels), VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    VkSampler vkSampler;
+    ASSERT(vkCreateSampler(device, &samplerInfo, nullptr, &vkSampler));
+    sampler = VulkanSampler{ device, vkSampler };
+
+    // the first frame has no depth to cull against yet, the far plane everywhere hides nothing
+    VulkanCommandPool commandPool{ device, *device.queueFamilyIndex.graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT };
+    commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
+        auto toTransfer = initializers::imageMemoryBarrier(pyramid, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                           , 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkClearColorValue far{ {1, 1, 1, 1} };
+        VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels, 0, 1 };
+        vkCmdClearColorImage(commandBuffer, pyramid, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &far, 1, &range);
+
+        auto toGeneral = initializers::imageMemoryBarrier(pyramid, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL
+                                                          , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+    });
+}
+
+void OcclusionCuller::createPipelines(VkDevice device, const io::fs::path& shaderDir) {
+    pyramidSetLayout = descriptorSetLayout(device, { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+    cullSetLayout = descriptorSetLayout(device, {
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+            , VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER });
+
+    pyramidLayout = VulkanPipelineLayout{ device, { pyramidSetLayout }, { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidConstants) } } };
+    cullLayout = VulkanPipelineLayout{ device, { cullSetLayout }, { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants) } } };
+
+    pyramidPipeline = computePipeline(device, pyramidLayout, shaderDir / "depthpyramid.comp.spv");
+    cullPipeline = computePipeline(device, cullLayout, shaderDir / "occlusion.comp.spv");
+}
+
+void OcclusionCuller::createDescriptorSets(VkDevice device, Span<const VkImageView> depthViews) {
+    auto pyramidSets = COUNT(depthViews) + pyramidLevels - 1;
+    descriptorPool = VulkanDescriptorPool{ device, pyramidSets + 1, {
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramidSets + 1 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramidSets },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 }
+    }, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT };
+
+    std::vector<VkDescriptorSetLayout> depthLayouts(depthViews.size(), pyramidSetLayout);
+    std::vector<VkDescriptorSetLayout> levelLayouts(pyramidLevels - 1, pyramidSetLayout);
+    depthSets = descriptorPool.allocate(depthLayouts);
+    if(!levelLayouts.empty()){
+        levelSets = descriptorPool.allocate(levelLayouts);
+    }
+    cullSet = std::move(descriptorPool.allocate({ cullSetLayout.handle }).front());
+
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    imageInfos.reserve((pyramidSets + 1) * 2);
+    std::vector<VkDescriptorBufferInfo> bufferInfos;
+    std::vector<VkWriteDescriptorSet> writes;
+
+    auto writeImage = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout){
+        imageInfos.push_back({ type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? sampler.handle : VK_NULL_HANDLE, view, layout });
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = binding;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        write.pImageInfo = &imageInfos.back();
+        writes.push_back(write);
+    };
+
+    for(auto i = 0u; i < depthSets.size(); i++){
+        writeImage(depthSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthViews[i], VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        writeImage(depthSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelViews[0], VK_IMAGE_LAYOUT_GENERAL);
+    }
+    for(auto i = 0u; i < levelSets.size(); i++){
+        writeImage(levelSets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelViews[i], VK_IMAGE_LAYOUT_GENERAL);
+        writeImage(levelSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelViews[i + 1], VK_IMAGE_LAYOUT_GENERAL);
+    }
+    writeImage(cullSet, 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramidView, VK_IMAGE_LAYOUT_GENERAL);
+
+    bufferInfos = { { objects, 0, VK_WHOLE_SIZE }, { drawn, 0, VK_WHOLE_SIZE }, { counts, 0, VK_WHOLE_SIZE }, { draws, 0, VK_WHOLE_SIZE } };
+    for(auto binding = 0u; binding < bufferInfos.size(); binding++){
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = cullSet;
+        write.dstBinding = binding;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfos[binding];
+        writes.push_back(write);
+    }
+
+    vkUpdateDescriptorSets(device, COUNT(writes), writes.data(), 0, nullptr);
+}
+
+void OcclusionCuller::setObjects(Span<const glm::vec4> spheres) {
+    if(spheres.size() > maxObjects){
+        throw std::runtime_error{ fmt::format("{} objects exceed the occlusion culler's capacity of {}", spheres.size(), maxObjects) };
+    }
+    objectCount = COUNT(spheres);
+    if(objectCount > 0){
+        std::memcpy(objects.map(), spheres.data(), sizeof(glm::vec4) * objectCount);
+        objects.unmap();
+    }
+}
+
+void OcclusionCuller::cullFirst(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection) {
+    // the previous frame has to be done drawing from the lists and writing the pyramid before they are reused
+    computeBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT
+                   , VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                   , VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                   , VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    vkCmdFillBuffer(commandBuffer, counts, 0, VK_WHOLE_SIZE, 0);
+    computeBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                   , VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    cull(commandBuffer, viewProjection, 0);
+}
+
+void OcclusionCuller::buildPyramid(VkCommandBuffer commandBuffer, uint32_t depth) {
+    // phase 1 culling reads the pyramid it is about to overwrite
+    auto overwrite = initializers::imageMemoryBarrier(pyramid, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL
+                                                      , VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                         , 0, 0, nullptr, 0, nullptr, 1, &overwrite);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline);
+    for(auto level = 0u; level < pyramidLevels; level++){
+        VkDescriptorSet set = level == 0 ? depthSets[depth].descriptorSet : levelSets[level - 1].descriptorSet;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidLayout, 0, 1, &set, 0, nullptr);
+
+        auto source = level == 0 ? depthExtent : levelExtent(level - 1);
+        auto size = levelExtent(level);
+        PyramidConstants constants{ glm::ivec2(source.width, source.height), glm::ivec2(size.width, size.height) };
+        vkCmdPushConstants(commandBuffer, pyramidLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (size.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (size.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+        // the next level reduces this one
+        auto written = initializers::imageMemoryBarrier(pyramid, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL
+                                                        , VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                        , { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 });
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                             , 0, 0, nullptr, 0, nullptr, 1, &written);
+    }
+}
+
+void OcclusionCuller::cullSecond(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection) {
+    // phase 1 reads the drawn flags and the count phase 0 wrote
+    computeBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                   , VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    cull(commandBuffer, viewProjection, 1);
+}
+
+void OcclusionCuller::cull(VkCommandBuffer commandBuffer, const glm::mat4& viewProjection, uint32_t phase) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSet.descriptorSet, 0, nullptr);
+
+    CullConstants constants{ viewProjection, objectCount, phase, indexCount, pyramidLevels
+                             , { static_cast<float>(depthExtent.width), static_cast<float>(depthExtent.height) } };
+    vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    computeBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT
+                   , VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT);
+}
+
+void OcclusionCuller::draw(VkCommandBuffer commandBuffer, uint32_t phase) const {
+    VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * objectCount * phase;
+    vkCmdDrawIndexedIndirectCount(commandBuffer, draws, offset, counts, sizeof(uint32_t) * phase
+                                  , objectCount, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+std::array<uint32_t, OcclusionCuller::PHASES> OcclusionCuller::drawCounts() const {
+    std::array<uint32_t, PHASES> result{};
+    auto mapped = static_cast<const uint32_t*>(counts.map());
+    std::copy(mapped, mapped + PHASES, result.begin());
+    counts.unmap();
+    return result;
+}
@@ -0,0 +1,790 @@
+#include "RenderGraph.h"
+#include "Initializers.h"
+#include "Metrics.h"
+
+static constexpr VkPipelineStageFlags FRAGMENT_TESTS = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+static constexpr VkImageUsageFlags ATTACHMENT_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+struct UsageInfo{
+    VkPipelineStageFlags stages;
+    VkAccessFlags read;
+    VkAccessFlags write;
+    VkImageLayout layout;       // UNDEFINED for usages that apply to buffers as well
+    VkImageUsageFlags imageUsage;
+    bool attachment;
+};
+
+static UsageInfo usageInfo(RenderGraph::Usage usage){
+    using Usage = RenderGraph::Usage;
+    switch(usage){
+        case Usage::ColorAttachment:
+            return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                     , VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true };
+        case Usage::DepthAttachment:
+            return { FRAGMENT_TESTS, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+                     , VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true };
+        case Usage::DepthRead:
+            return { FRAGMENT_TESTS, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 0
+                     , VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true };
+        case Usage::Sampled:
+            return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0
+                     , VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false };
+        case Usage::StorageRead:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0
+                     , VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false };
+        case Usage::StorageWrite:
+            return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_ACCESS_SHADER_WRITE_BIT
+                     , VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, false };
+        case Usage::Indirect:
+            return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0
+                     , VK_IMAGE_LAYOUT_UNDEFINED, 0, false };
+        case Usage::TransferSrc:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0
+                     , VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false };
+        case Usage::TransferDst:
+            return { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT
+                     , VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, false };
+    }
+    throw std::runtime_error{ "unknown render graph usage" };
+}
+
+static bool hasStencil(VkFormat format){
+    return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT
+        || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static VkImageAspectFlags aspectMask(VkFormat format){
+    switch(format){
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(Resource resource, Usage usage) {
+    graph.passes[pass].accesses.push_back({ resource, usage, false });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(Resource resource, Usage usage) {
+    graph.passes[pass].accesses.push_back({ resource, usage, true });
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::clear(Resource resource, VkClearValue value) {
+    graph.passes[pass].clears.emplace_back(resource, value);
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect() {
+    graph.passes[pass].sideEffect = true;
+    return *this;
+}
+
+RenderGraph::Resource RenderGraph::createImage(const std::string& name, const ImageInfo& info) {
+    ResourceData resource{};
+    resource.name = name;
+    resource.info = info;
+    resources.push_back(std::move(resource));
+    return COUNT(resources) - 1;
+}
+
+RenderGraph::Resource RenderGraph::importImage(const std::string& name, VkImage image, VkImageView view, const ImageInfo& info
+                                               , const State& initial, VkImageLayout finalLayout) {
+    ResourceData resource{};
+    resource.name = name;
+    resource.imported = true;
+    resource.output = finalLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.info = info;
+    resource.image = image;
+    resource.view = view;
+    resource.initial = initial;
+    resource.finalLayout = finalLayout;
+    resources.push_back(std::move(resource));
+    return COUNT(resources) - 1;
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string& name, VkBuffer buffer, const State& initial, bool output) {
+    ResourceData resource{};
+    resource.name = name;
+    resource.isImage = false;
+    resource.imported = true;
+    resource.output = output;
+    resource.buffer = buffer;
+    resource.initial = initial;
+    resources.push_back(std::move(resource));
+    return COUNT(resources) - 1;
+}
+
+void RenderGraph::addPass(const std::string& name, Queue queue, const Setup& setup, Execute execute) {
+    Pass pass{};
+    pass.name = name;
+    pass.queue = queue;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+
+    PassBuilder builder{ *this, COUNT(passes) - 1 };
+    setup(builder);
+}
+
+void RenderGraph::compile() {
+    if(!device) throw std::runtime_error{ "render graph has no device" };
+    if(dynamicRendering){
+        beginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(*device, "vkCmdBeginRenderingKHR"));
+        endRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(*device, "vkCmdEndRenderingKHR"));
+        if(!beginRendering || !endRendering) throw std::runtime_error{ "dynamic rendering needs VK_KHR_dynamic_rendering enabled" };
+    }
+
+    combineUses();
+    cull();
+    allocate();
+    planBarriers();
+    groupRenderPasses();
+    createRenderPasses();
+
+    statistics.passes = COUNT(passes);
+    for(auto& pass : passes){
+        if(!pass.live) statistics.culledPasses++;
+        statistics.barriers += COUNT(pass.barriers.images) + COUNT(pass.barriers.buffers);
+    }
+    statistics.barriers += COUNT(finalBarriers.images) + COUNT(finalBarriers.buffers);
+
+    auto& registry = metrics::registry();
+    registry.set("render_graph.culled_passes", statistics.culledPasses);
+    registry.set("render_graph.barriers", statistics.barriers);
+    registry.set("render_graph.transient_bytes", static_cast<double>(statistics.transientBytes));
+    registry.set("render_graph.allocated_bytes", static_cast<double>(statistics.allocatedBytes));
+    spdlog::debug("render graph: {} passes, {} culled, {} render passes, {} barriers, {} of {} transient bytes allocated"
+                  , statistics.passes, statistics.culledPasses, renderPasses.size(), statistics.barriers
+                  , statistics.allocatedBytes, statistics.transientBytes);
+}
+
+void RenderGraph::combineUses() {
+    for(auto& pass : passes){
+        pass.uses.clear();
+        for(auto& access : pass.accesses){
+            if(access.resource >= resources.size()) throw std::runtime_error{ pass.name + " uses an unknown resource" };
+            auto& resource = resources[access.resource];
+            auto info = usageInfo(access.usage);
+
+            if(info.attachment && pass.queue != Queue::Graphics){
+                throw std::runtime_error{ pass.name + " uses " + resource.name + " as an attachment outside a graphics pass" };
+            }
+            if(!resource.isImage && (info.attachment || access.usage == Usage::Sampled)){
+                throw std::runtime_error{ pass.name + " uses buffer " + resource.name + " as an image" };
+            }
+
+            auto use = std::find_if(pass.uses.begin(), pass.uses.end(), [&](auto& use){ return use.resource == access.resource; });
+            if(use == pass.uses.end()){
+                use = pass.uses.insert(pass.uses.end(), Use{ access.resource });
+            }
+            if(resource.isImage){
+                if(use->layout != VK_IMAGE_LAYOUT_UNDEFINED && use->layout != info.layout){
+                    throw std::runtime_error{ pass.name + " uses " + resource.name + " in two layouts" };
+                }
+                use->layout = info.layout;
+            }
+            use->stages |= info.stages;
+            use->access |= info.read | (access.write ? info.write : 0);
+            use->write |= access.write;
+            use->attachment |= info.attachment;
+        }
+
+        for(auto& [resource, value] : pass.clears){
+            auto use = std::find_if(pass.uses.begin(), pass.uses.end(), [&, resource = resource](auto& use){ return use.resource == resource; });
+            if(use == pass.uses.end() || !use->attachment || !use->write){
+                throw std::runtime_error{ pass.name + " clears a resource it doesn't write as an attachment" };
+            }
+            use->clear = true;
+            use->clearValue = value;
+        }
+    }
+}
+
+void RenderGraph::cull() {
+    // walk back from the outputs, a pass lives if it writes something a later live pass or the frame needs
+    std::vector<bool> needed(resources.size());
+    for(auto r = 0u; r < resources.size(); r++){
+        needed[r] = resources[r].output;
+    }
+    for(auto p = passes.size(); p-- > 0;){
+        auto& pass = passes[p];
+        pass.live = pass.sideEffect || std::any_of(pass.uses.begin(), pass.uses.end(), [&](auto& use){
+            return use.write && needed[use.resource];
+        });
+        if(!pass.live) continue;
+
+        // a cleared attachment doesn't care who wrote it before, other writes may be partial
+        for(auto& use : pass.uses){
+            needed[use.resource] = !use.clear;
+        }
+    }
+
+    for(auto p = 0u; p < passes.size(); p++){
+        auto& pass = passes[p];
+        if(!pass.live) continue;
+
+        for(auto& use : pass.uses){
+            auto& resource = resources[use.resource];
+            if(resource.firstPass == NONE) resource.firstPass = p;
+            resource.lastPass = p;
+        }
+        for(auto& access : pass.accesses){
+            resources[access.resource].usage |= usageInfo(access.usage).imageUsage;
+        }
+    }
+}
+
+void RenderGraph::allocate() {
+    struct Block{
+        VkMemoryRequirements requirements;
+        std::vector<Resource> users;
+    };
+
+    auto memoryProperties = device->getMemoryProperties();
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    std::vector<Resource> aliased;
+
+    for(auto r = 0u; r < resources.size(); r++){
+        auto& resource = resources[r];
+        if(resource.imported || resource.firstPass == NONE) continue;
+
+        // images only ever used as attachments can live in tile memory and never be backed
+        auto attachmentOnly = (resource.usage & ~ATTACHMENT_USAGE) == 0;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.info.format;
+        imageInfo.extent = { resource.info.extent.width, resource.info.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.usage | (attachmentOnly ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image;
+        ASSERT(vkCreateImage(*device, &imageInfo, nullptr, &image));
+        resource.owned = VulkanImage{ *device, image, VK_NULL_HANDLE, imageInfo.format, imageInfo.extent, 1, 0 };
+        resource.image = image;
+
+        vkGetImageMemoryRequirements(*device, image, &requirements[r]);
+        resource.owned.size = requirements[r].size;
+        statistics.transientBytes += requirements[r].size;
+
+        if(attachmentOnly){
+            auto candidates = device->memoryTypeCandidates(requirements[r].memoryTypeBits, MemoryUsage::Transient);
+            if(!candidates.empty() && (memoryProperties.memoryTypes[candidates.front()].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)){
+                resource.owned.memory = device->allocateMemory(requirements[r], candidates);
+                vkBindImageMemory(*device, image, resource.owned.memory, 0);
+                continue;
+            }
+        }
+        aliased.push_back(r);
+    }
+
+    // largest first, each image goes into the first block none of whose images are alive at the same time
+    std::stable_sort(aliased.begin(), aliased.end(), [&](auto a, auto b){ return requirements[a].size > requirements[b].size; });
+    auto overlaps = [&](Resource a, Resource b){
+        return resources[a].firstPass <= resources[b].lastPass && resources[b].firstPass <= resources[a].lastPass;
+    };
+
+    std::vector<Block> blocks;
+    for(auto r : aliased){
+        auto block = std::find_if(blocks.begin(), blocks.end(), [&](auto& block){
+            return (block.requirements.memoryTypeBits & requirements[r].memoryTypeBits)
+                && std::none_of(block.users.begin(), block.users.end(), [&](auto user){ return overlaps(user, r); });
+        });
+        if(block == blocks.end()){
+            blocks.push_back({ requirements[r], { r } });
+            continue;
+        }
+        block->requirements.size = std::max(block->requirements.size, requirements[r].size);
+        block->requirements.alignment = std::max(block->requirements.alignment, requirements[r].alignment);
+        block->requirements.memoryTypeBits &= requirements[r].memoryTypeBits;
+        block->users.push_back(r);
+    }
+
+    for(auto& block : blocks){
+        auto candidates = device->memoryTypeCandidates(block.requirements.memoryTypeBits, MemoryUsage::GpuOnly);
+        memory.emplace_back(*device, device->allocateMemory(block.requirements, candidates));
+        statistics.allocatedBytes += block.requirements.size;
+
+        std::sort(block.users.begin(), block.users.end(), [&](auto a, auto b){ return resources[a].firstPass < resources[b].firstPass; });
+        for(auto i = 0u; i < block.users.size(); i++){
+            auto& resource = resources[block.users[i]];
+            vkBindImageMemory(*device, resource.image, memory.back(), 0);
+            if(i > 0) resource.aliasOf = block.users[i - 1];
+        }
+    }
+
+    for(auto& resource : resources){
+        if(resource.imported || resource.firstPass == NONE) continue;
+
+        auto viewInfo = initializers::imageViewCreateInfo(resource.image, resource.info.format, { aspectMask(resource.info.format), 0, 1, 0, 1 });
+        VkImageView view;
+        ASSERT(vkCreateImageView(*device, &viewInfo, nullptr, &view));
+        resource.ownedView = VulkanImageView{ *device, view };
+        resource.view = view;
+    }
+}
+
+bool RenderGraph::transition(const Use& use, Tracked& state, Transition& transition) const {
+    auto layoutChange = resources[use.resource].isImage && state.layout != use.layout;
+    transition = { use.resource, 0, 0, use.stages, use.access, state.layout, use.layout };
+
+    auto needed = false;
+    if(use.write || layoutChange){
+        // writes and layout transitions wait for every earlier access, earlier writes are made available
+        transition.srcStages = state.writeStages | state.readStages;
+        transition.srcAccess = state.writeAccess;
+        needed = layoutChange || transition.srcStages != 0;
+
+        // a transition without writes is already visible to the use it was made for
+        state.writeStages = use.stages;
+        state.writeAccess = use.access & WRITE_ACCESS;
+        state.readStages = use.write ? 0 : use.stages;
+        state.visibleStages = use.write ? 0 : use.stages;
+        state.visibleAccess = use.write ? 0 : use.access;
+    }else{
+        // reads in the same layout only wait when the last write isn't visible to them yet
+        if(state.writeStages && ((use.stages & ~state.visibleStages) || (use.access & ~state.visibleAccess))){
+            transition.srcStages = state.writeStages;
+            transition.srcAccess = state.writeAccess;
+            needed = true;
+            state.visibleStages |= use.stages;
+            state.visibleAccess |= use.access;
+        }
+        state.readStages |= use.stages;
+    }
+    state.layout = use.layout;
+
+    if(!transition.srcStages) transition.srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    return needed;
+}
+
+void RenderGraph::planBarriers() {
+    std::vector<Tracked> states(resources.size());
+    for(auto r = 0u; r < resources.size(); r++){
+        auto& initial = resources[r].initial;
+        states[r].layout = initial.layout;
+        states[r].writeStages = initial.stages;
+        states[r].writeAccess = initial.access;
+    }
+
+    for(auto p = 0u; p < passes.size(); p++){
+        auto& pass = passes[p];
+        if(!pass.live) continue;
+
+        pass.transitions.clear();
+        for(auto& use : pass.uses){
+            auto& resource = resources[use.resource];
+            auto& state = states[use.resource];
+
+            // the image before it in the same memory has to be done with it, its contents are discarded
+            if(resource.firstPass == p && resource.aliasOf != NONE){
+                auto& previous = states[resource.aliasOf];
+                state.writeStages = previous.writeStages | previous.readStages;
+                state.writeAccess = previous.writeAccess;
+            }
+
+            Transition transition{};
+            if(this->transition(use, state, transition)){
+                pass.transitions.push_back(transition);
+            }
+        }
+    }
+
+    finalTransitions.clear();
+    for(auto r = 0u; r < resources.size(); r++){
+        auto& resource = resources[r];
+        auto& state = states[r];
+        if(!resource.isImage || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) continue;
+
+        auto srcStages = state.writeStages | state.readStages;
+        finalTransitions.push_back({ r, srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, state.writeAccess
+                                     , VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, state.layout, resource.finalLayout });
+    }
+}
+
+void RenderGraph::addBarrier(Barriers& barriers, const Transition& transition) const {
+    auto& resource = resources[transition.resource];
+    barriers.srcStages |= transition.srcStages;
+    barriers.dstStages |= transition.dstStages;
+
+    if(resource.isImage){
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = transition.srcAccess;
+        barrier.dstAccessMask = transition.dstAccess;
+        barrier.oldLayout = transition.oldLayout;
+        barrier.newLayout = transition.newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = resource.image;
+        barrier.subresourceRange = { aspectMask(resource.info.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+        barriers.images.push_back(barrier);
+    }else{
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = transition.srcAccess;
+        barrier.dstAccessMask = transition.dstAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = resource.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barriers.buffers.push_back(barrier);
+    }
+}
+
+void RenderGraph::groupRenderPasses() {
+    renderPasses.clear();
+
+    // how the current render pass uses each resource, a resource is only ever an attachment of it or not
+    std::vector<bool> used(resources.size());
+    std::vector<bool> attachment(resources.size());
+    auto previous = NONE;
+
+    for(auto p = 0u; p < passes.size(); p++){
+        auto& pass = passes[p];
+        if(!pass.live) continue;
+
+        if(pass.queue != Queue::Graphics){
+            for(auto& transition : pass.transitions) addBarrier(pass.barriers, transition);
+            previous = p;
+            continue;
+        }
+
+        VkExtent2D extent{ 0, 0 };
+        for(auto& use : pass.uses){
+            if(!use.attachment) continue;
+            auto& info = resources[use.resource].info;
+            if(extent.width == 0){
+                extent = info.extent;
+            }else if(extent.width != info.extent.width || extent.height != info.extent.height){
+                throw std::runtime_error{ pass.name + " has attachments of different sizes" };
+            }
+        }
+        if(extent.width == 0) throw std::runtime_error{ pass.name + " is a graphics pass without attachments" };
+
+        // a subpass of the previous render pass if it only has to wait for that render pass through
+        // attachments of both, waits on anything else are moved before the render pass begins
+        auto merge = !dynamicRendering && previous != NONE && passes[previous].queue == Queue::Graphics;
+        if(merge){
+            auto& current = renderPasses.back();
+            merge = current.extent.width == extent.width && current.extent.height == extent.height;
+            for(auto& use : pass.uses){
+                if(used[use.resource] && (use.clear || use.attachment != attachment[use.resource])) merge = false;
+            }
+        }
+
+        if(!merge){
+            std::fill(used.begin(), used.end(), false);
+            std::fill(attachment.begin(), attachment.end(), false);
+            RenderPass renderPass{};
+            renderPass.firstPass = p;
+            renderPass.extent = extent;
+            renderPasses.push_back(std::move(renderPass));
+
+            for(auto& transition : pass.transitions) addBarrier(pass.barriers, transition);
+        }else{
+            auto& current = renderPasses.back();
+            auto subpass = passes[current.lastPass].subpass + 1;
+
+            VkSubpassDependency dependency{};
+            dependency.dstSubpass = subpass;
+            dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+            for(auto& transition : pass.transitions){
+                if(!used[transition.resource]){
+                    addBarrier(passes[current.firstPass].barriers, transition);
+                    continue;
+                }
+                dependency.srcStageMask |= transition.srcStages;
+                dependency.srcAccessMask |= transition.srcAccess;
+                dependency.dstStageMask |= transition.dstStages;
+                dependency.dstAccessMask |= transition.dstAccess;
+            }
+            // every earlier subpass, the one that last wrote an attachment needn't be the one right before
+            if(dependency.dstStageMask){
+                for(dependency.srcSubpass = 0; dependency.srcSubpass < subpass; dependency.srcSubpass++){
+                    current.dependencies.push_back(dependency);
+                }
+            }
+            pass.subpass = subpass;
+        }
+
+        auto& current = renderPasses.back();
+        current.lastPass = p;
+        pass.renderPass = COUNT(renderPasses) - 1;
+        for(auto& use : pass.uses){
+            if(use.attachment && !attachment[use.resource]){
+                current.attachments.push_back(use.resource);
+            }
+            used[use.resource] = true;
+            attachment[use.resource] = use.attachment;
+        }
+        previous = p;
+    }
+}
+
+void RenderGraph::createRenderPasses() {
+    // whether a resource holds anything a later pass could load
+    std::vector<bool> written(resources.size());
+    for(auto r = 0u; r < resources.size(); r++){
+        written[r] = resources[r].imported && (!resources[r].isImage || resources[r].initial.layout != VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    for(auto p = 0u; p < passes.size(); p++){
+        auto& pass = passes[p];
+        if(!pass.live) continue;
+
+        if(pass.renderPass != NONE && renderPasses[pass.renderPass].firstPass == p){
+            auto& renderPass = renderPasses[pass.renderPass];
+            auto subpassCount = passes[renderPass.lastPass].subpass + 1;
+
+            auto findUse = [&](const Pass& pass, Resource resource) -> const Use* {
+                for(auto& use : pass.uses){
+                    if(use.resource == resource) return &use;
+                }
+                return nullptr;
+            };
+
+            std::vector<VkAttachmentDescription> descriptions;
+            std::vector<VkImageView> views;
+            renderPass.clearValues.assign(renderPass.attachments.size(), VkClearValue{});
+            for(auto a = 0u; a < renderPass.attachments.size(); a++){
+                auto r = renderPass.attachments[a];
+                auto& resource = resources[r];
+
+                const Use* first = nullptr;
+                const Use* last = nullptr;
+                for(auto q = renderPass.firstPass; q <= renderPass.lastPass; q++){
+                    if(!passes[q].live) continue;
+                    if(auto use = findUse(passes[q], r)){
+                        if(!first) first = use;
+                        last = use;
+                    }
+                }
+
+                auto loadOp = first->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : written[r] ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                auto storeOp = resource.output || resource.lastPass > renderPass.lastPass ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                auto stencil = hasStencil(resource.info.format);
+
+                VkAttachmentDescription description{};
+                description.format = resource.info.format;
+                description.samples = VK_SAMPLE_COUNT_1_BIT;
+                description.loadOp = loadOp;
+                description.storeOp = storeOp;
+                description.stencilLoadOp = stencil ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                description.stencilStoreOp = stencil ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                description.initialLayout = first->layout;
+                description.finalLayout = last->layout;
+
+                // an output last used here is left in its final layout by the render pass instead of a barrier
+                if(!dynamicRendering && resource.lastPass <= renderPass.lastPass && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED){
+                    description.finalLayout = resource.finalLayout;
+                    finalTransitions.erase(std::remove_if(finalTransitions.begin(), finalTransitions.end(), [r](auto& transition){
+                        return transition.resource == r;
+                    }), finalTransitions.end());
+                }
+                descriptions.push_back(description);
+                views.push_back(resource.view);
+                if(first->clear) renderPass.clearValues[a] = first->clearValue;
+            }
+
+            if(dynamicRendering){
+                for(auto a = 0u; a < renderPass.attachments.size(); a++){
+                    auto& description = descriptions[a];
+                    VkRenderingAttachmentInfoKHR attachment{};
+                    attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+                    attachment.imageView = views[a];
+                    attachment.imageLayout = description.initialLayout;
+                    attachment.resolveMode = VK_RESOLVE_MODE_NONE;
+                    attachment.loadOp = description.loadOp;
+                    attachment.storeOp = description.storeOp;
+                    attachment.clearValue = renderPass.clearValues[a];
+
+                    if(!(aspectMask(description.format) & (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT))){
+                        renderPass.colorAttachments.push_back(attachment);
+                        renderPass.colorFormats.push_back(description.format);
+                    }else if(renderPass.depthAttachment.imageView == VK_NULL_HANDLE){
+                        renderPass.depthAttachment = attachment;
+                        renderPass.renderingInfo.depthAttachmentFormat = description.format;
+                        renderPass.renderingInfo.stencilAttachmentFormat = hasStencil(description.format) ? description.format : VK_FORMAT_UNDEFINED;
+                    }else{
+                        throw std::runtime_error{ pass.name + " has more than one depth attachment" };
+                    }
+                }
+                renderPass.renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+                renderPass.renderingInfo.colorAttachmentCount = COUNT(renderPass.colorFormats);
+                renderPass.renderingInfo.pColorAttachmentFormats = renderPass.colorFormats.data();
+            }else{
+                std::vector<std::vector<VkAttachmentReference>> colorReferences(subpassCount);
+                std::vector<VkAttachmentReference> depthReferences(subpassCount, { VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+                std::vector<std::vector<uint32_t>> preserved(subpassCount);
+                std::vector<VkSubpassDescription> subpasses(subpassCount);
+                for(auto q = renderPass.firstPass; q <= renderPass.lastPass; q++){
+                    auto& subpass = passes[q];
+                    if(!subpass.live) continue;
+
+                    for(auto& use : subpass.uses){
+                        if(!use.attachment) continue;
+                        auto a = static_cast<uint32_t>(std::find(renderPass.attachments.begin(), renderPass.attachments.end(), use.resource) - renderPass.attachments.begin());
+                        if(use.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL){
+                            colorReferences[subpass.subpass].push_back({ a, use.layout });
+                        }else if(depthReferences[subpass.subpass].attachment == VK_ATTACHMENT_UNUSED){
+                            depthReferences[subpass.subpass] = { a, use.layout };
+                        }else{
+                            throw std::runtime_error{ subpass.name + " has more than one depth attachment" };
+                        }
+                    }
+                }
+                // attachments used before and after a subpass that doesn't use them have to be kept through it
+                for(auto a = 0u; a < renderPass.attachments.size(); a++){
+                    auto usedIn = [&](uint32_t s){
+                        auto& colors = colorReferences[s];
+                        return depthReferences[s].attachment == a || std::any_of(colors.begin(), colors.end(), [&](auto& reference){ return reference.attachment == a; });
+                    };
+                    for(auto s = 1u; s + 1 < subpassCount; s++){
+                        if(usedIn(s)) continue;
+                        auto before = false, after = false;
+                        for(auto t = 0u; t < s; t++) before |= usedIn(t);
+                        for(auto t = s + 1; t < subpassCount; t++) after |= usedIn(t);
+                        if(before && after) preserved[s].push_back(a);
+                    }
+                }
+                for(auto s = 0u; s < subpassCount; s++){
+                    auto& subpass = subpasses[s];
+                    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+                    subpass.colorAttachmentCount = COUNT(colorReferences[s]);
+                    subpass.pColorAttachments = colorReferences[s].data();
+                    subpass.pDepthStencilAttachment = depthReferences[s].attachment != VK_ATTACHMENT_UNUSED ? &depthReferences[s] : nullptr;
+                    subpass.preserveAttachmentCount = COUNT(preserved[s]);
+                    subpass.pPreserveAttachments = preserved[s].data();
+                }
+
+                renderPass.renderPass = VulkanRenderPass{ *device, descriptions, subpasses, renderPass.dependencies };
+                renderPass.framebuffer = VulkanFramebuffer{ *device, renderPass.renderPass, views, renderPass.extent.width, renderPass.extent.height };
+            }
+        }
+
+        for(auto& use : pass.uses){
+            if(use.write) written[use.resource] = true;
+        }
+    }
+
+    finalBarriers = Barriers{};
+    for(auto& transition : finalTransitions){
+        addBarrier(finalBarriers, transition);
+    }
+}
+
+void RenderGraph::Barriers::record(VkCommandBuffer commandBuffer) const {
+    if(images.empty() && buffers.empty()) return;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr
+                         , COUNT(buffers), buffers.data(), COUNT(images), images.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) const {
+    for(auto p = 0u; p < passes.size(); p++){
+        auto& pass = passes[p];
+        if(!pass.live) continue;
+
+        if(pass.renderPass == NONE){
+            pass.barriers.record(commandBuffer);
+            pass.execute(commandBuffer);
+            continue;
+        }
+
+        auto& renderPass = renderPasses[pass.renderPass];
+        if(dynamicRendering){
+            pass.barriers.record(commandBuffer);
+
+            VkRenderingInfoKHR renderingInfo{};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+            renderingInfo.renderArea.offset = { 0, 0 };
+            renderingInfo.renderArea.extent = renderPass.extent;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = COUNT(renderPass.colorAttachments);
+            renderingInfo.pColorAttachments = renderPass.colorAttachments.data();
+            if(renderPass.renderingInfo.depthAttachmentFormat != VK_FORMAT_UNDEFINED){
+                renderingInfo.pDepthAttachment = &renderPass.depthAttachment;
+            }
+            if(renderPass.renderingInfo.stencilAttachmentFormat != VK_FORMAT_UNDEFINED){
+                renderingInfo.pStencilAttachment = &renderPass.depthAttachment;
+            }
+            beginRendering(commandBuffer, &renderingInfo);
+            pass.execute(commandBuffer);
+            endRendering(commandBuffer);
+            continue;
+        }
+
+        if(renderPass.firstPass == p){
+            pass.barriers.record(commandBuffer);
+
+            VkRenderPassBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            beginInfo.renderPass = renderPass.renderPass;
+            beginInfo.framebuffer = renderPass.framebuffer;
+            beginInfo.renderArea.offset = { 0, 0 };
+            beginInfo.renderArea.extent = renderPass.extent;
+            beginInfo.clearValueCount = COUNT(renderPass.clearValues);
+            beginInfo.pClearValues = renderPass.clearValues.data();
+            vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        }else{
+            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        pass.execute(commandBuffer);
+
+        if(renderPass.lastPass == p){
+            vkCmdEndRenderPass(commandBuffer);
+        }
+    }
+    finalBarriers.record(commandBuffer);
+}
+
+const RenderGraph::Pass& RenderGraph::find(const std::string& pass) const {
+    auto match = std::find_if(passes.begin(), passes.end(), [&](auto& candidate){ return candidate.name == pass; });
+    if(match == passes.end()) throw std::runtime_error{ "render graph has no pass named " + pass };
+    return *match;
+}
+
+VkRenderPass RenderGraph::renderPass(const std::string& pass) const {
+    auto& match = find(pass);
+    if(match.renderPass == NONE) throw std::runtime_error{ pass + " is not recorded in a render pass" };
+    return renderPasses[match.renderPass].renderPass;
+}
+
+uint32_t RenderGraph::subpass(const std::string& pass) const {
+    auto& match = find(pass);
+    if(match.renderPass == NONE) throw std::runtime_error{ pass + " is not recorded in a render pass" };
+    return match.subpass;
+}
+
+const VkPipelineRenderingCreateInfoKHR* RenderGraph::renderingInfo(const std::string& pass) const {
+    auto& match = find(pass);
+    if(match.renderPass == NONE) throw std::runtime_error{ pass + " is not recorded in a render pass" };
+    return dynamicRendering ? &renderPasses[match.renderPass].renderingInfo : nullptr;
+}
+
+bool RenderGraph::culled(const std::string& pass) const {
+    return !find(pass).live;
+}
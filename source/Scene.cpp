@@ -0,0 +1,204 @@
+#include "Scene.h"
+
+static Scene::Bounds transformBounds(const glm::mat4& m, const Scene::Bounds& bounds){
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+    glm::vec3 worldCenter{ m[3][0], m[3][1], m[3][2] };
+    glm::vec3 worldExtent{ 0 };
+    for(int column = 0; column < 3; column++){
+        for(int row = 0; row < 3; row++){
+            worldCenter[row] += m[column][row] * center[column];
+            worldExtent[row] += std::abs(m[column][row]) * extent[column];
+        }
+    }
+    return { worldCenter - worldExtent, worldCenter + worldExtent };
+}
+
+Scene::Handle Scene::create(Handle parent, const glm::mat4& local, uint32_t mesh, const Bounds& bounds) {
+    auto parentIndex = parent.valid() ? dense(parent) : INVALID;
+    auto index = static_cast<uint32_t>(parents.size());
+
+    uint32_t slot;
+    if(!freeSlots.empty()){
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }else{
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    slots[slot].dense = index;
+
+    parents.push_back(parentIndex);
+    locals.push_back(local);
+    worlds.push_back(local);
+    meshes.push_back(mesh);
+    localBoxes.push_back(bounds);
+    worldBoxes.push_back(bounds);
+    subtreeEnd.push_back(index + 1);
+    slotOf.push_back(slot);
+    dirty.push_back(0);
+    markDirty(index);
+
+    // appending keeps depth first order when the parent's subtree is the last one
+    if(parentIndex != INVALID){
+        if(!structureChanged && subtreeEnd[parentIndex] == index){
+            for(auto ancestor = parentIndex; ancestor != INVALID; ancestor = parents[ancestor]){
+                subtreeEnd[ancestor] = index + 1;
+            }
+        }else{
+            structureChanged = true;
+        }
+    }
+
+    return { slot, slots[slot].generation };
+}
+
+void Scene::destroy(Handle node) {
+    if(structureChanged) rebuild();
+
+    auto index = dense(node);
+    for(auto i = index; i < subtreeEnd[index]; i++){
+        auto& slot = slots[slotOf[i]];
+        slot.dense = INVALID;
+        slot.generation++;
+        freeSlots.push_back(slotOf[i]);
+        slotOf[i] = INVALID;
+        meshes[i] = NO_MESH;
+    }
+    structureChanged = true;
+}
+
+void Scene::setParent(Handle node, Handle parent) {
+    if(structureChanged) rebuild();
+
+    auto index = dense(node);
+    auto parentIndex = parent.valid() ? dense(parent) : INVALID;
+    if(parentIndex != INVALID && parentIndex >= index && parentIndex < subtreeEnd[index]){
+        throw std::runtime_error{ "a scene node can't be parented to its own subtree" };
+    }
+    parents[index] = parentIndex;
+    markDirty(index);
+    structureChanged = true;
+}
+
+void Scene::setLocal(Handle node, const glm::mat4& local) {
+    auto index = dense(node);
+    locals[index] = local;
+    markDirty(index);
+}
+
+void Scene::setMesh(Handle node, uint32_t mesh, const Bounds& bounds) {
+    auto index = dense(node);
+    meshes[index] = mesh;
+    localBoxes[index] = bounds;
+    markDirty(index);
+}
+
+void Scene::markDirty(uint32_t node) {
+    if(!dirty[node]){
+        dirty[node] = 1;
+        dirtyNodes.push_back(node);
+    }
+}
+
+void Scene::update() {
+    if(structureChanged) rebuild();
+    if(dirtyNodes.empty()) return;
+
+    // a dirty node inside an already recomputed subtree is covered by its ancestor's range
+    std::sort(begin(dirtyNodes), end(dirtyNodes));
+    uint32_t covered = 0;
+    for(auto node : dirtyNodes){
+        if(node < covered) continue;
+        covered = subtreeEnd[node];
+        propagate(node, covered);
+    }
+    dirtyNodes.clear();
+}
+
+void Scene::propagate(uint32_t begin, uint32_t end) {
+    for(auto i = begin; i < end; i++){
+        auto parent = parents[i];
+        worlds[i] = parent == INVALID ? locals[i] : worlds[parent] * locals[i];
+        worldBoxes[i] = transformBounds(worlds[i], localBoxes[i]);
+        dirty[i] = 0;
+    }
+}
+
+// restores depth first order and drops destroyed nodes
+void Scene::rebuild() {
+    const auto count = static_cast<uint32_t>(parents.size());
+
+    std::vector<uint32_t> firstChild(count, INVALID);
+    std::vector<uint32_t> lastChild(count, INVALID);
+    std::vector<uint32_t> nextSibling(count, INVALID);
+    std::vector<uint32_t> roots;
+    for(uint32_t i = 0; i < count; i++){
+        if(slotOf[i] == INVALID) continue;
+        auto parent = parents[i];
+        if(parent == INVALID){
+            roots.push_back(i);
+        }else if(lastChild[parent] == INVALID){
+            firstChild[parent] = lastChild[parent] = i;
+        }else{
+            nextSibling[lastChild[parent]] = i;
+            lastChild[parent] = i;
+        }
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    std::vector<uint32_t> stack;
+    for(auto root = roots.rbegin(); root != roots.rend(); root++){
+        stack.push_back(*root);
+    }
+    std::vector<uint32_t> children;
+    while(!stack.empty()){
+        auto node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+
+        children.clear();
+        for(auto child = firstChild[node]; child != INVALID; child = nextSibling[child]){
+            children.push_back(child);
+        }
+        stack.insert(end(stack), children.rbegin(), children.rend());
+    }
+
+    std::vector<uint32_t> newIndex(count, INVALID);
+    for(uint32_t i = 0; i < order.size(); i++){
+        newIndex[order[i]] = i;
+    }
+
+    auto permute = [&](auto& values){
+        std::remove_reference_t<decltype(values)> permuted;
+        permuted.reserve(order.size());
+        for(auto i : order) permuted.push_back(values[i]);
+        values.swap(permuted);
+    };
+    permute(locals);
+    permute(worlds);
+    permute(meshes);
+    permute(localBoxes);
+    permute(worldBoxes);
+    permute(slotOf);
+    permute(dirty);
+    permute(parents);
+
+    const auto alive = static_cast<uint32_t>(order.size());
+    subtreeEnd.resize(alive);
+    dirtyNodes.clear();
+    for(uint32_t i = 0; i < alive; i++){
+        if(parents[i] != INVALID) parents[i] = newIndex[parents[i]];
+        slots[slotOf[i]].dense = i;
+        subtreeEnd[i] = i + 1;
+        if(dirty[i]) dirtyNodes.push_back(i);
+    }
+    for(auto i = alive; i-- > 0;){
+        if(parents[i] != INVALID){
+            subtreeEnd[parents[i]] = std::max(subtreeEnd[parents[i]], subtreeEnd[i]);
+        }
+    }
+    structureChanged = false;
+}
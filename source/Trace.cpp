@@ -0,0 +1,169 @@
+#include "Trace.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace trace {
+
+    static constexpr size_t CHUNK_SIZE = 1024;
+    static constexpr size_t MAX_CHUNKS_PER_THREAD = 256;
+
+    struct Chunk{
+        std::array<Event, CHUNK_SIZE> events;
+        std::atomic<uint32_t> count{ 0 };
+        std::atomic<uint64_t> generation{ 0 };     // bumped when the chunk is recycled, readers drop what they copied across a bump
+    };
+
+    /**
+     * Written only by its owning thread. The chunks are allocated with the buffer, on the thread's
+     * first event, and used as a ring: a full buffer recycles its oldest chunk so the trace always
+     * holds the most recent events. Recording never allocates, frames checked for heap use can
+     * record freely, and readers can look at any chunk at any time. Pages of chunks not written yet
+     * are only reserved, a thread that records little doesn't pay for the whole ring.
+     */
+    struct ThreadBuffer{
+        uint32_t id = 0;
+        std::atomic<const char*> name{ nullptr };
+        std::unique_ptr<Chunk[]> chunks{ new Chunk[MAX_CHUNKS_PER_THREAD] };
+        size_t current = 0;
+        std::atomic<uint64_t> overwritten{ 0 };
+
+        void push(const Event& event){
+            auto chunk = &chunks[current];
+            auto count = chunk->count.load(std::memory_order_relaxed);
+            if(count == CHUNK_SIZE){
+                current = (current + 1) % MAX_CHUNKS_PER_THREAD;
+                chunk = &chunks[current];
+                count = chunk->count.load(std::memory_order_relaxed);
+                if(count > 0){
+                    overwritten.fetch_add(count, std::memory_order_relaxed);
+                    chunk->generation.store(chunk->generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    chunk->count.store(0, std::memory_order_relaxed);
+                    count = 0;
+                }
+            }
+            chunk->events[count] = event;
+            chunk->count.store(count + 1, std::memory_order_release);
+        }
+    };
+
+    struct Registry{
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> threads;
+        std::unordered_set<std::string> names;
+        std::atomic_bool enabled{ true };
+    };
+
+    static Registry& registry(){
+        static auto instance = new Registry{};     // leaked so threads outliving static destruction can still record
+        return *instance;
+    }
+
+    static ThreadBuffer& threadBuffer(){
+        thread_local ThreadBuffer* buffer = []{
+            auto& reg = registry();
+            std::lock_guard<std::mutex> lock{ reg.mutex };
+            reg.threads.push_back(std::make_unique<ThreadBuffer>());
+            auto buffer = reg.threads.back().get();
+            buffer->id = static_cast<uint32_t>(reg.threads.size());
+            return buffer;
+        }();
+        return *buffer;
+    }
+
+    void setEnabled(bool enabled) {
+        registry().enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool enabled() {
+        return registry().enabled.load(std::memory_order_relaxed);
+    }
+
+    void record(const Event& event) {
+        if(!enabled()) return;
+        threadBuffer().push(event);
+    }
+
+    const char* intern(const std::string& name) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock{ reg.mutex };
+        return reg.names.insert(name).first->c_str();
+    }
+
+    void setThreadName(const char* name) {
+        threadBuffer().name.store(name, std::memory_order_relaxed);
+    }
+
+    static void writeString(std::ofstream& out, const char* value){
+        out << '"';
+        for(auto c = value; *c; c++){
+            if(*c == '"' || *c == '\\') out << '\\';
+            if(static_cast<unsigned char>(*c) < 0x20) continue;
+            out << *c;
+        }
+        out << '"';
+    }
+
+    static constexpr int CPU_PROCESS = 1;
+    static constexpr int GPU_PROCESS = 2;
+
+    void write(const io::fs::path& path) {
+        std::ofstream out{ path };
+        if(!out.good()) throw std::runtime_error{ "unable to write trace to " + path.string() };
+        out.precision(3);
+        out << std::fixed;
+
+        out << R"({"displayTimeUnit":"ms","traceEvents":[)" << '\n';
+        out << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"CPU"}},)" << '\n';
+        out << R"({"name":"process_name","ph":"M","pid":2,"args":{"name":"GPU"}},)" << '\n';
+        out << R"({"name":"thread_name","ph":"M","pid":2,"tid":1,"args":{"name":"graphics queue"}})";
+
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock{ reg.mutex };
+        uint64_t overwritten = 0;
+        std::vector<Event> events;
+        for(auto& thread : reg.threads){
+            if(auto name = thread->name.load(std::memory_order_relaxed)){
+                out << ",\n" << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << thread->id << R"(,"args":{"name":)";
+                writeString(out, name);
+                out << "}}";
+            }
+            for(auto i = 0u; i < MAX_CHUNKS_PER_THREAD; i++){
+                auto chunk = &thread->chunks[i];
+
+                // copied first, a chunk the owner recycled meanwhile is skipped rather than written torn
+                auto generation = chunk->generation.load(std::memory_order_acquire);
+                auto count = chunk->count.load(std::memory_order_acquire);
+                events.assign(chunk->events.begin(), chunk->events.begin() + count);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(chunk->generation.load(std::memory_order_relaxed) != generation) continue;
+
+                for(auto& event : events){
+                    auto gpu = event.track == Track::Gpu;
+                    out << ",\n" << R"({"name":)";
+                    writeString(out, event.name);
+                    out << R"(,"cat":)";
+                    writeString(out, event.category);
+                    out << R"(,"ph":")" << event.phase << R"(","ts":)" << static_cast<double>(event.start) / 1000.0;
+                    if(event.phase == 'X'){
+                        out << R"(,"dur":)" << static_cast<double>(event.duration) / 1000.0;
+                    }else if(event.phase == 'i'){
+                        out << R"(,"s":"t")";
+                    }
+                    out << R"(,"pid":)" << (gpu ? GPU_PROCESS : CPU_PROCESS) << R"(,"tid":)" << (gpu ? 1 : thread->id) << '}';
+                }
+            }
+            overwritten += thread->overwritten.load(std::memory_order_relaxed);
+        }
+        out << "\n]}\n";
+
+        if(overwritten > 0){
+            spdlog::info("trace buffers wrapped, the oldest {} events were overwritten", overwritten);
+        }
+        spdlog::info("trace written to {}", path.string());
+    }
+}
@@ -0,0 +1,263 @@
+#include "Transform.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRANSFORM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace transform {
+
+    // instances per job, a multiple of the widest kernel so only the last chunk takes the scalar tail
+    static constexpr size_t PARALLEL_GRAIN = 8192;
+
+    // rotation * scale columns and translation of one instance, column major like glm
+    static void scalarInstance(const Instances& in, size_t i, const float* p, float* mvp, float* model){
+        float x = in.qx[i], y = in.qy[i], z = in.qz[i], w = in.qw[i];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+
+        float m[16]{
+            (1 - 2 * (yy + zz)) * in.sx[i], 2 * (xy + wz) * in.sx[i], 2 * (xz - wy) * in.sx[i], 0,
+            2 * (xy - wz) * in.sy[i], (1 - 2 * (xx + zz)) * in.sy[i], 2 * (yz + wx) * in.sy[i], 0,
+            2 * (xz + wy) * in.sz[i], 2 * (yz - wx) * in.sz[i], (1 - 2 * (xx + yy)) * in.sz[i], 0,
+            in.tx[i], in.ty[i], in.tz[i], 1
+        };
+
+        for(int column = 0; mvp && column < 4; column++){
+            for(int row = 0; row < 4; row++){
+                mvp[column * 4 + row] = p[row] * m[column * 4] + p[4 + row] * m[column * 4 + 1]
+                                      + p[8 + row] * m[column * 4 + 2] + p[12 + row] * m[column * 4 + 3];
+            }
+        }
+        if(model){
+            std::copy(m, m + 16, model);
+        }
+    }
+
+    static void scalarKernel(const Instances& in, size_t first, size_t last, const float* p, float* mvps, float* models){
+        for(auto i = first; i < last; i++){
+            scalarInstance(in, i, p, mvps ? mvps + i * 16 : nullptr, models ? models + i * 16 : nullptr);
+        }
+    }
+
+#ifdef TRANSFORM_X86
+    static size_t sseKernel(const Instances& in, size_t first, size_t last, const float* p, float* mvps, float* models){
+        const auto count = first + ((last - first) & ~size_t{3});
+        const auto one = _mm_set1_ps(1);
+        const auto two = _mm_set1_ps(2);
+        const auto zero = _mm_setzero_ps();
+
+        for(auto i = first; i < count; i += 4){
+            auto x = _mm_loadu_ps(&in.qx[i]), y = _mm_loadu_ps(&in.qy[i]), z = _mm_loadu_ps(&in.qz[i]), w = _mm_loadu_ps(&in.qw[i]);
+            auto sx = _mm_loadu_ps(&in.sx[i]), sy = _mm_loadu_ps(&in.sy[i]), sz = _mm_loadu_ps(&in.sz[i]);
+            auto xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+            auto xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+            auto wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+            __m128 m[16];
+            m[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+            m[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+            m[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+            m[3] = zero;
+            m[4] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+            m[5] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+            m[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+            m[7] = zero;
+            m[8] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+            m[9] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+            m[10] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+            m[11] = zero;
+            m[12] = _mm_loadu_ps(&in.tx[i]);
+            m[13] = _mm_loadu_ps(&in.ty[i]);
+            m[14] = _mm_loadu_ps(&in.tz[i]);
+            m[15] = one;
+
+            // registers hold one element of four instances, transpose to four instances of four elements
+            auto store = [i](__m128* elements, float* dst){
+                for(int group = 0; group < 16; group += 4){
+                    _MM_TRANSPOSE4_PS(elements[group], elements[group + 1], elements[group + 2], elements[group + 3]);
+                    for(int lane = 0; lane < 4; lane++){
+                        _mm_storeu_ps(dst + (i + lane) * 16 + group, elements[group + lane]);
+                    }
+                }
+            };
+
+            if(mvps){
+                __m128 mvp[16];
+                for(int column = 0; column < 3; column++){
+                    for(int row = 0; row < 4; row++){
+                        mvp[column * 4 + row] = _mm_add_ps(_mm_add_ps(
+                                  _mm_mul_ps(_mm_set1_ps(p[row]), m[column * 4])
+                                , _mm_mul_ps(_mm_set1_ps(p[4 + row]), m[column * 4 + 1]))
+                                , _mm_mul_ps(_mm_set1_ps(p[8 + row]), m[column * 4 + 2]));
+                    }
+                }
+                for(int row = 0; row < 4; row++){
+                    mvp[12 + row] = _mm_add_ps(_mm_add_ps(
+                              _mm_mul_ps(_mm_set1_ps(p[row]), m[12])
+                            , _mm_mul_ps(_mm_set1_ps(p[4 + row]), m[13]))
+                            , _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[8 + row]), m[14]), _mm_set1_ps(p[12 + row])));
+                }
+                store(mvp, mvps);
+            }
+            if(models) store(m, models);
+        }
+        return count;
+    }
+
+    TARGET_AVX2 static void transpose8(__m256* r){
+        auto t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        auto t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        auto t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+        auto t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+        auto s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        auto s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        auto s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        auto s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+        r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+        r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+        r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+        r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+        r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+        r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+        r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    }
+
+    // registers hold one element of eight instances, each instance is written as two 8 float halves
+    TARGET_AVX2 static void store8(__m256* elements, float* dst){
+        transpose8(elements);
+        transpose8(elements + 8);
+        for(int lane = 0; lane < 8; lane++){
+            _mm256_storeu_ps(dst + lane * 16, elements[lane]);
+            _mm256_storeu_ps(dst + lane * 16 + 8, elements[8 + lane]);
+        }
+    }
+
+    TARGET_AVX2 static size_t avx2Kernel(const Instances& in, size_t first, size_t last, const float* p, float* mvps, float* models){
+        const auto count = first + ((last - first) & ~size_t{7});
+        const auto one = _mm256_set1_ps(1);
+        const auto two = _mm256_set1_ps(2);
+        const auto zero = _mm256_setzero_ps();
+
+        __m256 vp[16];
+        for(int e = 0; e < 16; e++){
+            vp[e] = _mm256_set1_ps(p[e]);
+        }
+
+        for(auto i = first; i < count; i += 8){
+            auto x = _mm256_loadu_ps(&in.qx[i]), y = _mm256_loadu_ps(&in.qy[i]), z = _mm256_loadu_ps(&in.qz[i]), w = _mm256_loadu_ps(&in.qw[i]);
+            auto sx = _mm256_loadu_ps(&in.sx[i]), sy = _mm256_loadu_ps(&in.sy[i]), sz = _mm256_loadu_ps(&in.sz[i]);
+            auto x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+            auto xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+            auto xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+            auto wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+            __m256 m[16];
+            m[0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+            m[1] = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+            m[2] = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+            m[3] = zero;
+            m[4] = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+            m[5] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+            m[6] = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+            m[7] = zero;
+            m[8] = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+            m[9] = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+            m[10] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+            m[11] = zero;
+            m[12] = _mm256_loadu_ps(&in.tx[i]);
+            m[13] = _mm256_loadu_ps(&in.ty[i]);
+            m[14] = _mm256_loadu_ps(&in.tz[i]);
+            m[15] = one;
+
+            if(mvps){
+                __m256 mvp[16];
+                for(int column = 0; column < 4; column++){
+                    for(int row = 0; row < 4; row++){
+                        auto sum = column == 3 ? vp[12 + row] : _mm256_mul_ps(vp[8 + row], m[column * 4 + 2]);
+                        if(column == 3) sum = _mm256_fmadd_ps(vp[8 + row], m[14], sum);
+                        sum = _mm256_fmadd_ps(vp[4 + row], m[column * 4 + 1], sum);
+                        mvp[column * 4 + row] = _mm256_fmadd_ps(vp[row], m[column * 4], sum);
+                    }
+                }
+                store8(mvp, mvps + i * 16);
+            }
+            if(models) store8(m, models + i * 16);
+        }
+        return count;
+    }
+#endif
+
+    Isa detect(){
+#ifdef TRANSFORM_X86
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::Avx2;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = info[2] & (1 << 27);
+        bool avx = info[2] & (1 << 28);
+        bool fma = info[2] & (1 << 12);
+        if(osxsave && avx && fma && (_xgetbv(0) & 6) == 6){
+            __cpuidex(info, 7, 0);
+            if(info[1] & (1 << 5)) return Isa::Avx2;
+        }
+#endif
+        return Isa::Sse;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    const char* name(Isa isa){
+        switch(isa){
+            case Isa::Avx2: return "avx2";
+            case Isa::Sse: return "sse";
+            default: return "scalar";
+        }
+    }
+
+    void compute(const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models){
+        static const Isa isa = detect();
+        compute(isa, instances, viewProjection, mvps, models);
+    }
+
+    static void computeRange(Isa isa, const Instances& instances, const float* p, float* mvps, float* models, size_t first, size_t last){
+        auto done = first;
+#ifdef TRANSFORM_X86
+        if(isa == Isa::Avx2){
+            done = avx2Kernel(instances, first, last, p, mvps, models);
+        }else if(isa == Isa::Sse){
+            done = sseKernel(instances, first, last, p, mvps, models);
+        }
+#endif
+        scalarKernel(instances, done, last, p, mvps, models);
+    }
+
+    void compute(Isa isa, const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models){
+        computeRange(isa, instances, reinterpret_cast<const float*>(&viewProjection), reinterpret_cast<float*>(mvps)
+                     , reinterpret_cast<float*>(models), 0, instances.size());
+    }
+
+    void compute(jobs::Scheduler& scheduler, const Instances& instances, const glm::mat4& viewProjection, glm::mat4* mvps, glm::mat4* models){
+        static const Isa isa = detect();
+        auto p = reinterpret_cast<const float*>(&viewProjection);
+        auto mvpOut = reinterpret_cast<float*>(mvps);
+        auto modelOut = reinterpret_cast<float*>(models);
+        scheduler.parallelFor(0, instances.size(), PARALLEL_GRAIN, [&](size_t first, size_t last){
+            computeRange(isa, instances, p, mvpOut, modelOut, first, last);
+        });
+    }
+}
@@ -1,6 +1,25 @@
 #include "VulkanCube.h"
 
+#ifndef VULKAN_CUBE_SHADER_DIR
+#define VULKAN_CUBE_SHADER_DIR "shaders"
+#endif
+
+static constexpr uint32_t MAX_MATERIALS = 16;
+static constexpr VkExtent2D MATERIAL_TEXTURE_EXTENT{ 512, 512 };
+static constexpr uint32_t MAX_MATERIAL_TEXTURES = 4;
+
+static const std::string IDLE_CPU_METRIC = "on_demand.idle_cpu_percent";
+static const std::string IDLE_SECONDS_METRIC = "on_demand.idle_seconds";
+
 void VulkanCube::init() {
+    trace::setThreadName("main");
+    deletionQueue.makeActive();
+    // lays down depth first so the colour pass shades each pixel once, pays off once fragments cost more than geometry
+    depthPrePass = std::getenv("VULKAN_CUBE_DEPTH_PREPASS") != nullptr;
+    // dynamic rendering is used where supported, render pass objects let a depth pre-pass stay on tile as a subpass
+    dynamicRendering = std::getenv("VULKAN_CUBE_RENDER_PASSES") == nullptr;
+    // kiosk and preview deployments only draw when something changed, a static scene leaves CPU and GPU idle
+    onDemand = std::getenv("VULKAN_CUBE_ON_DEMAND") != nullptr;
     initGlfw();
     initVulkan();
 }
@@ -13,45 +32,169 @@ void VulkanCube::run() {
 
 void VulkanCube::mainLoop() {
     while(!glfwWindowShouldClose(window)){
-        glfwPollEvents();
-        drawFrame();
-        std::this_thread::sleep_for(ONE_SECOND);
-        vkDeviceWaitIdle(device);
+        applyCubeTexture();
+        if(onDemand){
+            waitForRedraw();
+            if(glfwWindowShouldClose(window)) break;
+            drawFrame();
+        }else{
+            glfwPollEvents();
+            drawFrame();
+            std::this_thread::sleep_for(ONE_SECOND);
+        }
+    }
+}
+
+/**
+ * Once the streamer has uploaded everything it will of the cube's texture, its finest resident level
+ * is blitted into a layer of the material table and becomes the cube material's albedo. Runs between
+ * frames, the blit waits on the queue and allocates, and the streamed copy is released afterwards.
+ * Formats that can't be blitted, like block compressed ones, leave the cube untextured.
+ */
+void VulkanCube::applyCubeTexture() {
+    if(!cubeTexture || !textureStreamer.idle() || !cubeTexture->usable()) return;
+
+    TRACE_FUNCTION();
+    try{
+        auto material = materials.get(cubeMaterial);
+        material.albedoLayer = materials.addTexture(cubeTexture->image, cubeTexture->residentLevel);
+        materials.set(cubeMaterial, material);
+        commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
+            materials.update(commandBuffer);
+        });
+        requestRedraw();
+    }catch(const std::runtime_error& error){
+        spdlog::warn("cube stays untextured: {}", error.what());
+    }
+    cubeTexture.reset();
+}
+
+void VulkanCube::requestRedraw() {
+    redrawRequested = true;
+    glfwPostEmptyEvent();
+}
+
+/**
+ * Blocks in glfwWaitEventsTimeout until a redraw is requested, by a window event or requestRedraw()
+ * from any thread, or the window is closed. Texture uploads in progress only advance with frames so
+ * they keep the loop drawing until they are done. The CPU time the process spends while waiting is
+ * published as a share of the time waited, which a static scene should keep near zero.
+ */
+void VulkanCube::waitForRedraw() {
+    glfwPollEvents();
+    if(!textureStreamer.idle()) return;
+
+    TRACE_SCOPE("wait for redraw");
+    auto waitStart = std::chrono::steady_clock::now();
+    auto cpuStart = std::clock();
+    while(!redrawRequested.exchange(false) && !glfwWindowShouldClose(window)){
+        glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+
+        auto waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+        auto cpu = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        auto& registry = metrics::registry();
+        registry.set(IDLE_CPU_METRIC, 100.0 * (idleCpuSeconds + cpu) / std::max(idleSeconds + waited, 1e-9));
+        registry.set(IDLE_SECONDS_METRIC, idleSeconds + waited);
     }
+    idleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+    idleCpuSeconds += static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
 }
 
 void VulkanCube::drawFrame() {
+    TRACE_SCOPE("frame");
+    allocations::Scope frameAllocations;
+    auto& frame = frames[frameNumber % MAX_FRAMES_IN_FLIGHT];
+    {
+        TRACE_SCOPE("wait frame fence");
+        vkWaitForFences(device, 1, &frame.inFlight.handle, VK_TRUE, UINT64_MAX);
+    }
+    frame.arena.reset();
+
+    // waiting on this frame's fence retired every frame up to the one that last used it
+    if(frameNumber >= MAX_FRAMES_IN_FLIGHT){
+        deletionQueue.retire(frameNumber - MAX_FRAMES_IN_FLIGHT);
+    }
+    deletionQueue.beginFrame(frameNumber);
+
+    device.updateMemoryBudget();
+    textureStreamer.update(frame.arena);
+    commandCache.beginFrame();
+
     uint32_t imageIndex;
-    auto result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAcquired, VK_NULL_HANDLE, &imageIndex);
-    assert(result == VK_SUCCESS);
+    {
+        TRACE_SCOPE("acquire image");
+        // the swapchain isn't recreated, the window can't be resized so it doesn't go out of date, a
+        // suboptimal image still presents correctly and anything else is fatal
+        auto result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, frame.imageAcquired, VK_NULL_HANDLE, &imageIndex);
+        if(result != VK_SUBOPTIMAL_KHR) ASSERT(result);
+    }
+
+    // command buffers and uniforms are per swapchain image, an image may still be in use by an older frame
+    if(imagesInFlight[imageIndex] != VK_NULL_HANDLE){
+        {
+            TRACE_SCOPE("wait image fence");
+            vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        }
+        profiler.collect(imageIndex);
+    }
+    imagesInFlight[imageIndex] = frame.inFlight;
+    auto commandBuffer = recordCommandBuffer(imageIndex);
 
     VkPipelineStageFlags waitStages[]{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &imageAcquired.handle;
+    submitInfo.pWaitSemaphores = &frame.imageAcquired.handle;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+    submitInfo.pCommandBuffers = &commandBuffer;
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &renderingFinished.handle;
+    submitInfo.pSignalSemaphores = &frame.renderingFinished.handle;
 
-    vkQueueSubmit(device.queues.graphics, 1, &submitInfo, VK_NULL_HANDLE);
+    vkResetFences(device, 1, &frame.inFlight.handle);
+    {
+        TRACE_SCOPE("submit");
+        ASSERT(vkQueueSubmit(device.queues.graphics, 1, &submitInfo, frame.inFlight));
+    }
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &renderingFinished.handle;
+    presentInfo.pWaitSemaphores = &frame.renderingFinished.handle;
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapChain.swapChain;
     presentInfo.pImageIndices = &imageIndex;
 
-    vkQueuePresentKHR(device.queues.present, &presentInfo);
+    {
+        TRACE_SCOPE("present");
+        auto result = vkQueuePresentKHR(device.queues.present, &presentInfo);
+        if(result != VK_SUBOPTIMAL_KHR) ASSERT(result);
+    }
+
+    // steady state frames must not touch the heap, builds that count allocations stop at the first one that does
+    if(allocations::counting() && frameNumber >= STEADY_STATE_FRAME && frameAllocations.allocations() > 0){
+        spdlog::critical("frame {} made {} heap allocations", frameNumber, frameAllocations.allocations());
+        std::abort();
+    }
+
+    frameNumber++;
+    if(frameNumber % STATS_REPORT_INTERVAL == 0){
+        reportStats();
+    }
+}
 
+void VulkanCube::reportStats() {
+    profiler.report();
+    metrics::registry().report();
 }
 
 void VulkanCube::stop() {
+    vkDeviceWaitIdle(device);
+    reportStats();
+    if(auto tracePath = std::getenv("VULKAN_CUBE_TRACE")){
+        trace::write(tracePath);
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -59,10 +202,26 @@ void VulkanCube::stop() {
 void VulkanCube::initGlfw(){
     if(!glfwInit()) throw std::runtime_error{"Failed to init GFLW!"};
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    // everything is sized for WIDTH x HEIGHT and the swapchain is never recreated, a resize would leave it out of date
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
     GLFWmonitor* monitor = nullptr;
     window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Cube", monitor, nullptr);
 
+    // window state that changes what is on screen, or exposes it, asks an on demand loop for a frame
+    glfwSetWindowUserPointer(window, this);
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* window){
+        static_cast<VulkanCube*>(glfwGetWindowUserPointer(window))->requestRedraw();
+    });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int, int){
+        static_cast<VulkanCube*>(glfwGetWindowUserPointer(window))->requestRedraw();
+    });
+    glfwSetWindowIconifyCallback(window, [](GLFWwindow* window, int iconified){
+        if(!iconified){
+            static_cast<VulkanCube*>(glfwGetWindowUserPointer(window))->requestRedraw();
+        }
+    });
+
     uint32_t requiredExtensionCount;
     auto requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionCount);
     instanceExtensionsAndValidationLayers.extensions = std::vector<const char*>(requiredExtensions, requiredExtensions + requiredExtensionCount);
@@ -74,19 +233,23 @@ void VulkanCube::initGlfw(){
 }
 
 void VulkanCube::initVulkan() {
+    TRACE_FUNCTION();
+    loadShaders();
     createInstance();
     createDebugMessenger();
     createSurface();
     pickPhysicalDevice();
     createDevice();
     createSwapChain();
-    createRenderPass();
-    createFrameBuffer();
+    createRenderGraphs();
+    createCommandPool();
+    createMaterials();
     createPipelineLayout();
     createDescriptorPool();
     createGraphicsPipeline();
-    createCommandPool();
     createMesh();
+    createProfiler();
+    createTextureStreamer();
     createCamera();
     createDescriptorSet();
     createCommandBuffer();
@@ -94,6 +257,7 @@ void VulkanCube::initVulkan() {
 }
 
 void VulkanCube::createInstance() {
+    TRACE_FUNCTION();
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.apiVersion = VK_API_VERSION_1_2;
@@ -106,14 +270,17 @@ void VulkanCube::createInstance() {
 }
 
 void VulkanCube::createDebugMessenger() {
+    TRACE_FUNCTION();
     debug = VulkanDebug{instance};
 }
 
 void VulkanCube::createSurface() {
+    TRACE_FUNCTION();
     surface = VulkanSurface{ instance, window};
 }
 
 void VulkanCube::pickPhysicalDevice() {
+    TRACE_FUNCTION();
     auto pDevices = enumerate<VkPhysicalDevice>([&](uint32_t* size, VkPhysicalDevice* pDevice){
        return vkEnumeratePhysicalDevices(instance, size, pDevice);
     });
@@ -132,11 +299,44 @@ void VulkanCube::pickPhysicalDevice() {
 }
 
 void VulkanCube::createDevice() {
+    TRACE_FUNCTION();
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
     VkPhysicalDeviceFeatures features{};
+    features.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
     deviceExtensionsAndValidationLayers.extensions.push_back("VK_KHR_swapchain");
     if(device.extensionSupported("VK_KHR_portability_subset")){
         deviceExtensionsAndValidationLayers.extensions.push_back("VK_KHR_portability_subset");
     }
+    if(device.extensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)){
+        deviceExtensionsAndValidationLayers.extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    if(device.extensionSupported(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)){
+        auto getTimeDomains = instanceProc<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>("vkGetPhysicalDeviceCalibrateableTimeDomainsEXT", instance);
+        auto timeDomains = enumerate<VkTimeDomainEXT>([&](uint32_t* count, VkTimeDomainEXT* domains){
+            return getTimeDomains(device, count, domains);
+        });
+        auto calibrateable = [&](VkTimeDomainEXT domain){
+            return std::find(begin(timeDomains), end(timeDomains), domain) != end(timeDomains);
+        };
+        if(calibrateable(VK_TIME_DOMAIN_DEVICE_EXT) && calibrateable(GpuProfiler::HOST_TIME_DOMAIN)){
+            deviceExtensionsAndValidationLayers.extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
+    }
+    // records straight against image views, no render pass or framebuffer objects to keep in sync with the swapchain
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    if(dynamicRendering && device.extensionSupported(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)){
+        VkPhysicalDeviceFeatures2 supported2{};
+        supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported2.pNext = &dynamicRenderingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &supported2);
+    }
+    dynamicRendering = dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+    if(dynamicRendering){
+        deviceExtensionsAndValidationLayers.extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    }
     if constexpr (debugMode){
         // Required for backward compatibility
         deviceExtensionsAndValidationLayers.validationLayers.push_back("VK_LAYER_KHRONOS_validation");
@@ -145,10 +345,16 @@ void VulkanCube::createDevice() {
                                deviceExtensionsAndValidationLayers.extensions,
                                deviceExtensionsAndValidationLayers.validationLayers,
                                surface,
-                               VK_QUEUE_GRAPHICS_BIT);
+                               VK_QUEUE_GRAPHICS_BIT,
+                               dynamicRendering ? &dynamicRenderingFeatures : nullptr);
+    spdlog::info("recording with {}", dynamicRendering ? "dynamic rendering" : "render pass objects");
+    if(device.hasResizableBar()){
+        spdlog::info("resizable BAR enabled, host written buffers live in device local memory");
+    }
 }
 
 void VulkanCube::createSwapChain(){
+    TRACE_FUNCTION();
     swapChain = VulkanSwapChain{ device, surface, WIDTH, HEIGHT };
     clearColors.resize(swapChain.imageCount());
     for(int i = 0;i < clearColors.size(); i++){
@@ -158,74 +364,141 @@ void VulkanCube::createSwapChain(){
 
 
 void VulkanCube::createMesh() {
-    auto cubeVertices = primitives::cube();
-    VkDeviceSize size = sizeof(cubeVertices.vertices[0]) * cubeVertices.vertices.size();
-
-    VulkanBuffer stagingBuffer = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                                     size);
-
-    stagingBuffer.copy(cubeVertices.vertices.data(), size);
+    TRACE_FUNCTION();
+    const io::fs::path cookedCube = "../../resources/meshes/cube.vcm";
+    if(io::fs::exists(cookedCube)){
+        cooked::MeshFile meshFile{ cookedCube };
+        if(meshFile.meshCount() == 0) throw std::runtime_error{ cookedCube.string() + " contains no meshes" };
+        auto& vertices = meshFile.vertices(0);
+        auto& indices = meshFile.indices(0);
+        cube = uploadMesh(vertices.uncompressedSize, indices.uncompressedSize, [&](char* vertexData, char* indexData){
+            meshFile.decode(vertices, vertexData);
+            meshFile.decode(indices, indexData);
+        });
+    }else{
+        auto mesh = primitives::cube();
+        VkDeviceSize vertexSize = sizeof(mesh.vertices[0]) * mesh.vertices.size();
+        VkDeviceSize indexSize = sizeof(mesh.indices[0]) * mesh.indices.size();
+        cube = uploadMesh(vertexSize, indexSize, [&](char* vertexData, char* indexData){
+            std::memcpy(vertexData, mesh.vertices.data(), vertexSize);
+            std::memcpy(indexData, mesh.indices.data(), indexSize);
+        });
+    }
+}
 
-    this->cube.vertices = device.createBuffer( VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                               size);
+VulkanMesh VulkanCube::uploadMesh(VkDeviceSize vertexSize, VkDeviceSize indexSize, const std::function<void(char*, char*)>& fill) {
+    TRACE_FUNCTION();
+    auto vertexCount = vertexSize / sizeof(Vertex);
+    VkDeviceSize positionSize = depthPrePass ? sizeof(glm::vec4) * vertexCount : 0;
+    VulkanBuffer stagingBuffer = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly, vertexSize + indexSize + positionSize);
+
+    auto staging = static_cast<char*>(stagingBuffer.map());
+    fill(staging, staging + vertexSize);
+    if(depthPrePass){
+        auto vertices = reinterpret_cast<const Vertex*>(staging);
+        auto positions = reinterpret_cast<glm::vec4*>(staging + vertexSize + indexSize);
+        for(auto i = 0u; i < vertexCount; i++){
+            positions[i] = vertices[i].position;
+        }
+    }
+    stagingBuffer.unmap();
+
+    VulkanMesh mesh;
+    mesh.vertices = device.createBuffer( VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                         MemoryUsage::GpuOnly,
+                                         vertexSize);
+    mesh.indices = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                                        , MemoryUsage::GpuOnly, indexSize);
+    mesh.size = vertexSize;
+    if(depthPrePass){
+        mesh.positions = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                                             , MemoryUsage::GpuOnly, positionSize);
+    }
 
     commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
-        VkBufferCopy region{ 0, 0, size };
-       vkCmdCopyBuffer(commandBuffer, stagingBuffer, this->cube.vertices, 1, &region);
-    });
-
-    size = sizeof(cubeVertices.indices[0]) * cubeVertices.indices.size();
-    stagingBuffer = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                                     size);
+        VkBufferCopy vertexRegion{ 0, 0, vertexSize };
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, mesh.vertices, 1, &vertexRegion);
 
-    this->cube.indices = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
-                                            , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, size);
+        VkBufferCopy indexRegion{ vertexSize, 0, indexSize };
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, *mesh.indices, 1, &indexRegion);
 
-    commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
-       VkBufferCopy region{ 0, 0, size};
-        vkCmdCopyBuffer(commandBuffer, stagingBuffer, *this->cube.indices, 1, &region);
+        if(mesh.positions){
+            VkBufferCopy positionRegion{ vertexSize + indexSize, 0, positionSize };
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, *mesh.positions, 1, &positionRegion);
+        }
     });
-}
 
-void VulkanCube::createRenderPass() {
-    std::vector<VkAttachmentDescription> attachments;
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = swapChain.format;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    attachments.push_back(colorAttachment);
-
-    std::vector<VkAttachmentReference> references(1);
-    references[0].attachment = 0;
-    references[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    std::vector<VkSubpassDescription> subpasses(1);
-    subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpasses[0].colorAttachmentCount = COUNT(references);
-    subpasses[0].pColorAttachments = references.data();
-
-
-    renderPass = VulkanRenderPass{ device, attachments, subpasses};
+    return mesh;
 }
 
-void VulkanCube::createFrameBuffer() {
-    framebuffers.resize(swapChain.imageCount());
+void VulkanCube::createRenderGraphs() {
+    TRACE_FUNCTION();
+    // D16 is always supported, the others keep more precision when the device has them
+    depthFormat = device.findSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM }
+                                             , VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    if(depthFormat == VK_FORMAT_UNDEFINED) throw std::runtime_error{ "no depth attachment format supported" };
+
+    // set 0 is the material table, set 1 the image's camera
+    auto bindCube = [this](VkCommandBuffer commandBuffer, uint32_t image){
+        VkDescriptorSet sets[]{ materials.descriptorSet(), descriptorSets[image].descriptorSet };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(cubeMaterial), &cubeMaterial);
+    };
 
-    for(auto i = 0; i < framebuffers.size(); i++){
-        framebuffers[i] = VulkanFramebuffer{ device, renderPass, {swapChain.imageViews[i] }, WIDTH, HEIGHT };
+    // one graph per swapchain image like the cached command buffers, each with its own depth buffer
+    for(auto i = 0u; i < swapChain.imageCount(); i++){
+        RenderGraph graph{ device, dynamicRendering };
+
+        // the image is only acquired once colour output waits on its semaphore
+        auto backbuffer = graph.importImage("backbuffer", swapChain.images[i], swapChain.imageViews[i], { swapChain.format, { WIDTH, HEIGHT } }
+                                            , { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 }, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        auto depth = graph.createImage("depth", { depthFormat, { WIDTH, HEIGHT } });
+
+        VkClearValue clearColor{};
+        clearColor.color = clearColors[i];
+        VkClearValue clearDepth{};
+        clearDepth.depthStencil = { 1.0f, 0 };
+
+        if(depthPrePass){
+            graph.addPass("depth pre-pass", RenderGraph::Queue::Graphics, [&](auto& pass){
+                pass.write(depth, RenderGraph::Usage::DepthAttachment).clear(depth, clearDepth);
+            }, [this, i, bindCube](VkCommandBuffer commandBuffer){
+                bindCube(commandBuffer, i);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline.pipeline);
+                VkDeviceSize offset = 0;
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &cube.positions->buffer, &offset);
+                vkCmdBindIndexBuffer(commandBuffer, cube.indices->buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(commandBuffer, cube.indices->size/sizeof(uint32_t), 1, 0, 0, 0);
+            });
+        }
+
+        // after a pre-pass the colour pass only tests depth, read only lets the hardware skip depth writes
+        graph.addPass("forward", RenderGraph::Queue::Graphics, [&](auto& pass){
+            pass.write(backbuffer, RenderGraph::Usage::ColorAttachment).clear(backbuffer, clearColor);
+            if(depthPrePass){
+                pass.read(depth, RenderGraph::Usage::DepthRead);
+            }else{
+                pass.write(depth, RenderGraph::Usage::DepthAttachment).clear(depth, clearDepth);
+            }
+        }, [this, i, bindCube](VkCommandBuffer commandBuffer){
+            bindCube(commandBuffer, i);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.pipeline);
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &cube.vertices.buffer, &offset);
+            vkCmdBindIndexBuffer(commandBuffer, cube.indices->buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(commandBuffer, cube.indices->size/sizeof(uint32_t), 1, 0, 0, 0);
+        });
+
+        graph.compile();
+        renderGraphs.push_back(std::move(graph));
     }
+    auto& stats = renderGraphs.front().stats();
+    spdlog::info("render graph: {} passes, {} barriers, {} transient bytes in {} allocated", stats.passes - stats.culledPasses
+                 , stats.barriers, stats.transientBytes, stats.allocatedBytes);
 }
 
 void VulkanCube::createPipelineLayout() {
+    TRACE_FUNCTION();
    std::vector<VkDescriptorSetLayoutBinding> bindings;
    VkDescriptorSetLayoutBinding cameraBinding{};
    cameraBinding.binding = 0;
@@ -242,7 +515,18 @@ void VulkanCube::createPipelineLayout() {
 
     vkCreateDescriptorSetLayout(device, &createInfo, nullptr, &descriptorSetLayout);
 
-    pipelineLayout = VulkanPipelineLayout{ device, {descriptorSetLayout} };
+    pipelineLayout = VulkanPipelineLayout{ device, { materials.descriptorSetLayout(), descriptorSetLayout }
+                                           , { {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MaterialTable::Id)} } };
+}
+
+// the cube keeps its vertex colours, its material samples white until applyCubeTexture() gives it the streamed albedo
+void VulkanCube::createMaterials() {
+    TRACE_FUNCTION();
+    materials = MaterialTable{ device, MAX_MATERIALS, MATERIAL_TEXTURE_EXTENT, MAX_MATERIAL_TEXTURES };
+    cubeMaterial = materials.add({});
+    commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
+        materials.update(commandBuffer);
+    });
 }
 void VulkanCube::createsPipeline() {
 
@@ -250,6 +534,7 @@ void VulkanCube::createsPipeline() {
 }
 
 void VulkanCube::createDescriptorPool() {
+    TRACE_FUNCTION();
     const auto maxSets = swapChain.imageCount();
 
     std::vector<VkDescriptorPoolSize> poolSizes{
@@ -261,6 +546,7 @@ void VulkanCube::createDescriptorPool() {
 }
 
 void VulkanCube::createDescriptorSet() {
+    TRACE_FUNCTION();
     std::vector<VkDescriptorSetLayout> layouts(swapChain.imageCount(), descriptorSetLayout);
     descriptorSets = descriptorPool.allocate(layouts);
 
@@ -281,10 +567,19 @@ void VulkanCube::createDescriptorSet() {
     }
 }
 
+void VulkanCube::loadShaders() {
+    TRACE_FUNCTION();
+    shaderLoads = fileReader.read({
+        { io::fs::path{ VULKAN_CUBE_SHADER_DIR } / "cube.vert.spv" },
+        { io::fs::path{ VULKAN_CUBE_SHADER_DIR } / "material.frag.spv" }
+    });
+}
+
 void VulkanCube::createGraphicsPipeline() {
-    auto vertexShaderModule = VulkanShaderModule{ device, "../../resources/shaders/cube.vert.spv"};
-    auto fragmentShaderModule = VulkanShaderModule{ device, "../../resources/shaders/cube.frag.spv"};
-    std::vector<VkPipelineShaderStageCreateInfo> shaderStages = initializers::vertexShaderStages(device, {
+    TRACE_FUNCTION();
+    auto vertexShaderModule = VulkanShaderModule{ device, shaderLoads[0].get() };
+    auto fragmentShaderModule = VulkanShaderModule{ device, shaderLoads[1].get() };
+    auto shaderStages = initializers::vertexShaderStages(device, {
             { vertexShaderModule, VK_SHADER_STAGE_VERTEX_BIT},
             { fragmentShaderModule,  VK_SHADER_STAGE_FRAGMENT_BIT}
     });
@@ -296,7 +591,14 @@ void VulkanCube::createGraphicsPipeline() {
     VkPipelineViewportStateCreateInfo viewportState = initializers::viewportState( initializers::viewport(WIDTH, HEIGHT), initializers::scissor({WIDTH, HEIGHT}));
     VkPipelineRasterizationStateCreateInfo rasterState = initializers::rasterizationState();
     VkPipelineMultisampleStateCreateInfo multisampleState = initializers::multisampleState();
-    VkPipelineDepthStencilStateCreateInfo depthStencilState = initializers::depthStencilState();
+    /*
+     * After a pre-pass only the nearest fragment of each pixel passes, and depth is already written.
+     * Less or equal rather than equal, the two pipelines fetch position differently and equal is only
+     * safe while the compiled shader keeps gl_Position invariant, less or equal holds either way.
+     */
+    VkPipelineDepthStencilStateCreateInfo depthStencilState = depthPrePass
+            ? initializers::depthStencilState(VK_TRUE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL)
+            : initializers::depthStencilState();
     VkPipelineColorBlendStateCreateInfo colorBlendState = initializers::colorBlendState();
     VkPipelineDynamicStateCreateInfo  dynamicState = initializers::dynamicState();
 
@@ -313,78 +615,126 @@ void VulkanCube::createGraphicsPipeline() {
     pipelineCreateInfo.pColorBlendState = &colorBlendState;
     pipelineCreateInfo.pDynamicState = &dynamicState;
     pipelineCreateInfo.layout = pipelineLayout;
-    pipelineCreateInfo.renderPass = renderPass;
-    pipelineCreateInfo.subpass = 0;
+    // graphs built the same way have compatible render passes or the same attachment formats, the first serves them all
+    pipelineCreateInfo.pNext = renderGraphs.front().renderingInfo("forward");
+    pipelineCreateInfo.renderPass = renderGraphs.front().renderPass("forward");
+    pipelineCreateInfo.subpass = renderGraphs.front().subpass("forward");
     pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineCreateInfo.basePipelineIndex = -1;
 
     VkPipeline pipeline;
     ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
     graphicsPipeline = VulkanPipeline{device, pipeline};
+
+    if(!depthPrePass) return;
+
+    /*
+     * The pre-pass runs the same vertex shader, which declares gl_Position invariant, so both passes
+     * compute the same depth. It only fetches the packed position stream, the shader's other inputs alias the
+     * position and feed outputs nothing reads without a fragment stage.
+     */
+    std::vector<VkVertexInputBindingDescription> positionBindings{ { 0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX } };
+    auto positionAttributes = Vertex::attributes();
+    for(auto& attribute : positionAttributes){
+        attribute.offset = 0;
+    }
+    VkPipelineVertexInputStateCreateInfo positionInputState = initializers::vertexInputState(positionBindings, positionAttributes);
+    VkPipelineDepthStencilStateCreateInfo depthOnlyState = initializers::depthStencilState();
+    VkPipelineColorBlendStateCreateInfo noColorState = initializers::colorBlendState();
+    noColorState.attachmentCount = 0;
+    noColorState.pAttachments = nullptr;
+
+    pipelineCreateInfo.stageCount = 1;
+    pipelineCreateInfo.pVertexInputState = &positionInputState;
+    pipelineCreateInfo.pDepthStencilState = &depthOnlyState;
+    pipelineCreateInfo.pColorBlendState = &noColorState;
+    pipelineCreateInfo.pNext = renderGraphs.front().renderingInfo("depth pre-pass");
+    pipelineCreateInfo.renderPass = renderGraphs.front().renderPass("depth pre-pass");
+    pipelineCreateInfo.subpass = renderGraphs.front().subpass("depth pre-pass");
+
+    ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+    depthPipeline = VulkanPipeline{device, pipeline};
 }
 
 void VulkanCube::createCommandPool() {
+    TRACE_FUNCTION();
     commandPool = VulkanCommandPool{ device, *device.queueFamilyIndex.graphics };
 }
 
 void VulkanCube::createCommandBuffer() {
-    const uint32_t numCommandBuffers = swapChain.imageCount();
-    commandBuffers = commandPool.allocate(numCommandBuffers);
-
-    for(auto i = 0; i < numCommandBuffers; i++){
-        auto commandBuffer = commandBuffers[i];
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-        VkClearValue clearValue{};
-        clearValue.color = clearColors[i];
-        VkClearValue clearValues[1]{ clearValue};
-
-        VkRenderPassBeginInfo beginRenderPass{};
-        beginRenderPass.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        beginRenderPass.renderPass = renderPass;
-        beginRenderPass.framebuffer = framebuffers[i];
-        beginRenderPass.renderArea  = { {0, 0}, {WIDTH, HEIGHT}};
-        beginRenderPass.clearValueCount = 1;
-        beginRenderPass.pClearValues = clearValues;
-
-        vkCmdBeginRenderPass(commandBuffer, &beginRenderPass, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i].descriptorSet, 0,nullptr);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.pipeline);
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &cube.vertices.buffer, &cube.vertices.size);
-        vkCmdBindIndexBuffer(commandBuffer, cube.indices->buffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(commandBuffer, cube.indices->size/sizeof(uint32_t), 1, 0, 0, 0);
-
-        vkCmdEndRenderPass(commandBuffer);
-        vkEndCommandBuffer(commandBuffer);
-    }
+    TRACE_FUNCTION();
+    commandCache = CommandCache{ device, *device.queueFamilyIndex.graphics, swapChain.imageCount(), VK_COMMAND_BUFFER_LEVEL_PRIMARY };
+}
 
+// the image's command buffer is recorded again only when something its passes bind has changed
+VkCommandBuffer VulkanCube::recordCommandBuffer(uint32_t imageIndex) {
+    TRACE_FUNCTION();
+    auto key = StateHash{}
+            .add(graphicsPipeline.pipeline)
+            .add(depthPipeline.pipeline)
+            .add(descriptorSets[imageIndex].descriptorSet)
+            .add(materials.descriptorSet())
+            .add(cubeMaterial)
+            .add(cube.vertices.buffer)
+            .add(cube.indices->buffer)
+            .add(cube.positions ? cube.positions->buffer : VK_NULL_HANDLE)
+            .add(cube.indices->size)
+            .value();
+
+    return commandCache.get(imageIndex, 0, key, [&](VkCommandBuffer commandBuffer){
+        profiler.begin(commandBuffer, imageIndex);
+        {
+            auto renderPassScope = profiler.pass(commandBuffer, imageIndex, "render pass");
+            renderGraphs[imageIndex].execute(commandBuffer);
+        }
+    });
 }
 
 void VulkanCube::createSyncObjects() {
+    TRACE_FUNCTION();
     VkSemaphoreCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkSemaphore  semaphore;
-    vkCreateSemaphore(device, &createInfo, nullptr, &semaphore);
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for(auto& frame : frames){
+        VkSemaphore  semaphore;
+        vkCreateSemaphore(device, &createInfo, nullptr, &semaphore);
+        frame.imageAcquired = VulkanSemaphore{ device, semaphore};
 
-    imageAcquired = VulkanSemaphore{ device, semaphore};
+        vkCreateSemaphore(device, &createInfo, nullptr, &semaphore);
+        frame.renderingFinished = VulkanSemaphore{ device, semaphore};
 
-    vkCreateSemaphore(device, &createInfo, nullptr, &semaphore);
-    renderingFinished = VulkanSemaphore{ device, semaphore};
+        VkFence fence;
+        ASSERT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+        frame.inFlight = VulkanFence{ device, fence };
+    }
+    imagesInFlight.resize(swapChain.imageCount(), VK_NULL_HANDLE);
 }
 
 void VulkanCube::createCamera() {
+    TRACE_FUNCTION();
     camera.resize(swapChain.imageCount());
-    VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-
-    if(!device.supportsMemoryType(flags)){
-        flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    }
     for(auto & cam : camera) {
-        cam.buffer = device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, flags, Camera::size);
+        cam.buffer = device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu, Camera::size);
     }
 }
 
+void VulkanCube::createTextureStreamer() {
+    TRACE_FUNCTION();
+    textureStreamer = TextureStreamer{ device, TEXTURE_BUDGET };
+    textureStreamer.profile(profiler, swapChain.imageCount());
 
+    const io::fs::path cubeTexturePath = "../../resources/textures/cube.ktx2";
+    if(io::fs::exists(cubeTexturePath)){
+        cubeTexture = textureStreamer.load(cubeTexturePath);
+    }
+}
+
+// one query pool per cached command buffer plus one for texture uploads
+void VulkanCube::createProfiler() {
+    TRACE_FUNCTION();
+    profiler = GpuProfiler{ device, swapChain.imageCount() + 1, *device.queueFamilyIndex.graphics };
+}
@@ -0,0 +1,3 @@
+#include "VulkanDeletionQueue.h"
+
+DeletionQueue* DeletionQueue::active = nullptr;
@@ -0,0 +1,243 @@
+#include "VulkanTexture.h"
+#include <cmath>
+#include <optional>
+
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+TextureStreamer::TextureStreamer(VulkanDevice& device, VkDeviceSize budget, VkDeviceSize bytesPerUpdate)
+: device(&device)
+, budget(budget)
+, bytesPerUpdate(bytesPerUpdate)
+{
+    commandPool = VulkanCommandPool{ device, *device.queueFamilyIndex.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT };
+    commandBuffer = commandPool.allocate().front();
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence handle;
+    ASSERT(vkCreateFence(device, &fenceInfo, nullptr, &handle));
+    fence = VulkanFence{ device, handle };
+}
+
+std::shared_ptr<Texture> TextureStreamer::load(const io::fs::path& path) {
+    Upload upload;
+    upload.source = ktx2::File{ path };
+    auto& source = upload.source;
+
+    auto extent = source.extent();
+    auto fullChain = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+    constexpr VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    auto features = device->getFormatProperties(source.format()).optimalTilingFeatures;
+    upload.generateMips = !source.hasMipChain() && fullChain > 1 && (features & blitFeatures) == blitFeatures;
+
+    auto levelCount = upload.generateMips ? fullChain : source.levelCount();
+    auto levelBytes = [&](uint32_t level){
+        return upload.generateMips ? std::max<VkDeviceSize>(1, source.levelSize(0) >> (2 * level)) : source.levelSize(level);
+    };
+
+    releaseExpired();
+    VkDeviceSize bytes = 0;
+    for(auto level = 0u; level < levelCount; level++){
+        bytes += levelBytes(level);
+    }
+    // generated chains are blitted down from level 0 so they can not drop it
+    while(!upload.generateMips && allocatedBytes + bytes > budget && upload.skippedLevels + 1 < levelCount){
+        bytes -= levelBytes(upload.skippedLevels);
+        upload.skippedLevels++;
+    }
+    if(allocatedBytes + bytes > budget){
+        throw std::runtime_error{ fmt::format("{} needs {} bytes even at its coarsest levels, {} of the {} byte texture budget are in use"
+                                              , path.string(), bytes, allocatedBytes, budget) };
+    }
+    if(upload.skippedLevels > 0){
+        spdlog::info("{}: dropped {} mip levels to stay within the texture budget", path.string(), upload.skippedLevels);
+    }
+
+    VkImageCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    createInfo.imageType = VK_IMAGE_TYPE_2D;
+    createInfo.format = source.format();
+    createInfo.extent = source.extent(upload.skippedLevels);
+    createInfo.mipLevels = levelCount - upload.skippedLevels;
+    createInfo.arrayLayers = 1;
+    createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // transfer source for generated mips and for blitting resident levels into other images
+    createInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    auto texture = std::make_shared<Texture>();
+    texture->image = device->createImage(createInfo, MemoryUsage::GpuOnly);
+    texture->residentLevel = texture->image.mipLevels;
+
+    auto samplerInfo = initializers::samplerCreateInfo(static_cast<float>(texture->image.mipLevels));
+    VkSampler sampler;
+    ASSERT(vkCreateSampler(*device, &samplerInfo, nullptr, &sampler));
+    texture->sampler = VulkanSampler{ *device, sampler };
+
+    allocations.push_back({ texture, texture->image.size });
+    allocatedBytes += texture->image.size;
+
+    upload.texture = texture;
+    upload.nextLevel = upload.generateMips ? 0 : texture->image.mipLevels - 1;
+    pending.push_back(std::move(upload));
+
+    return texture;
+}
+
+void TextureStreamer::update(FrameArena& arena) {
+    if(uploadInFlight){
+        if(vkGetFenceStatus(*device, fence) != VK_SUCCESS) return;
+
+        for(auto& [texture, level] : inFlight){
+            texture->residentLevel = level;
+            createView(*texture);
+        }
+        inFlight.clear();
+        if(profiler){
+            profiler->collect(profilerPool);
+        }
+        vkResetFences(*device, 1, &fence.handle);
+        uploadInFlight = false;
+    }
+    releaseExpired();
+    if(pending.empty()) return;
+    TRACE_SCOPE("record texture uploads");
+
+    struct Copy{
+        Upload* upload;
+        uint32_t level;
+        VkDeviceSize offset;
+    };
+    ArenaVector<Copy> copies{ arena };
+    VkDeviceSize stagingBytes = 0;
+
+    // round robin over pending textures so every texture gets its coarse levels before anyone gets fine ones
+    auto progressed = true;
+    while(progressed && stagingBytes < bytesPerUpdate){
+        progressed = false;
+        for(auto& upload : pending){
+            if(upload.done) continue;
+            if(stagingBytes >= bytesPerUpdate) break;
+
+            auto offset = (stagingBytes + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+            copies.push_back({ &upload, upload.nextLevel, offset });
+            stagingBytes = offset + upload.source.levelSize(upload.nextLevel + upload.skippedLevels);
+
+            if(upload.generateMips || upload.nextLevel == 0){
+                upload.done = true;
+            }else{
+                upload.nextLevel--;
+            }
+            progressed = true;
+        }
+    }
+
+    if(staging.size < stagingBytes){
+        staging = device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly, stagingBytes);
+        stagingData = static_cast<char*>(staging.map());
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    std::optional<GpuProfiler::Scope> uploadScope;
+    if(profiler){
+        profiler->begin(commandBuffer, profilerPool);
+        uploadScope.emplace(profiler->scope(commandBuffer, profilerPool, "texture upload"));
+    }
+
+    for(auto& copy : copies){
+        auto& upload = *copy.upload;
+        auto& image = upload.texture->image;
+        auto sourceLevel = copy.level + upload.skippedLevels;
+        std::memcpy(stagingData + copy.offset, upload.source.levelData(sourceLevel), upload.source.levelSize(sourceLevel));
+
+        auto levels = upload.generateMips ? image.mipLevels : 1;
+        auto barrier = initializers::imageMemoryBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                        , 0, VK_ACCESS_TRANSFER_WRITE_BIT
+                                                        , {VK_IMAGE_ASPECT_COLOR_BIT, copy.level, levels, 0, 1});
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = copy.offset;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, copy.level, 0, 1};
+        region.imageExtent = upload.source.extent(sourceLevel);
+        vkCmdCopyBufferToImage(commandBuffer, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        if(upload.generateMips){
+            generateMipChain(commandBuffer, image);
+        }else{
+            barrier = initializers::imageMemoryBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                       , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                       , {VK_IMAGE_ASPECT_COLOR_BIT, copy.level, 1, 0, 1});
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        inFlight.emplace_back(upload.texture, copy.level);
+    }
+    uploadScope.reset();
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    ASSERT(vkQueueSubmit(device->queues.graphics, 1, &submitInfo, fence));
+    uploadInFlight = true;
+
+    // level data has been copied out of the mappings, finished sources can be unmapped now
+    pending.erase(std::remove_if(begin(pending), end(pending), [](auto& upload){ return upload.done; }), end(pending));
+}
+
+void TextureStreamer::releaseExpired() {
+    auto expired = std::partition(begin(allocations), end(allocations), [](auto& allocation){ return !allocation.texture.expired(); });
+    for(auto itr = expired; itr != end(allocations); itr++){
+        allocatedBytes -= itr->size;
+    }
+    allocations.erase(expired, end(allocations));
+}
+
+void TextureStreamer::createView(Texture& texture) {
+    auto& image = texture.image;
+    auto createInfo = initializers::imageViewCreateInfo(image, image.format, {VK_IMAGE_ASPECT_COLOR_BIT, texture.residentLevel, image.mipLevels - texture.residentLevel, 0, 1});
+
+    VkImageView view;
+    ASSERT(vkCreateImageView(*device, &createInfo, nullptr, &view));
+    texture.view = VulkanImageView{ *device, view };
+    texture.version++;
+}
+
+void TextureStreamer::generateMipChain(VkCommandBuffer commandBuffer, const VulkanImage& image) {
+    auto width = static_cast<int32_t>(image.extent.width);
+    auto height = static_cast<int32_t>(image.extent.height);
+
+    for(auto level = 1u; level < image.mipLevels; level++){
+        auto barrier = initializers::imageMemoryBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                        , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT
+                                                        , {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1});
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit blit{};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[1] = { width, height, 1 };
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[1] = { width, height, 1 };
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier = initializers::imageMemoryBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                   , VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                   , {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1});
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    auto barrier = initializers::imageMemoryBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                                    , VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT
+                                                    , {VK_IMAGE_ASPECT_COLOR_BIT, image.mipLevels - 1, 1, 0, 1});
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
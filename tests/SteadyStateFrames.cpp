@@ -0,0 +1,51 @@
+#include "common.h"
+#include "Allocations.h"
+#include "Arena.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+/**
+ * Runs the CPU side of several hundred frames, the trace scopes and GPU events drawFrame and the
+ * profiler record, the frame arena and the metrics it publishes, and fails if a steady state frame
+ * allocates. Frames record more scopes than the renderer's so the trace crosses hundreds of chunk
+ * boundaries and wraps its ring, growth anywhere in recording shows up long before the renderer
+ * would hit it. Needs a build that counts allocations.
+ */
+
+static constexpr uint64_t FRAMES = 600;
+static constexpr uint32_t PASSES = 256;     // scopes per frame, 600 frames of them wrap the trace ring
+
+static const std::string FRAME_METRIC = "steady_state.frame";
+
+int main(){
+    if(!allocations::counting()){
+        spdlog::error("built without VULKAN_CUBE_COUNT_ALLOCATIONS, nothing to check");
+        return 1;
+    }
+    trace::setThreadName("main");
+    FrameArena arena;
+
+    for(uint64_t frame = 0; frame < FRAMES; frame++){
+        allocations::Scope frameAllocations;
+        {
+            TRACE_SCOPE("frame");
+            arena.reset();
+            ArenaVector<uint32_t> draws{ arena };
+            for(auto pass = 0u; pass < PASSES; pass++){
+                TRACE_SCOPE("pass");
+                draws.push_back(pass);
+            }
+            auto start = trace::now();
+            for(auto pass = 0u; pass < PASSES; pass++){
+                trace::complete("gpu pass", "gpu", start, start + pass, trace::Track::Gpu);
+            }
+            metrics::registry().set(FRAME_METRIC, static_cast<double>(frame));
+        }
+        if(frame >= STEADY_STATE_FRAME && frameAllocations.allocations() > 0){
+            spdlog::error("frame {} made {} heap allocations", frame, frameAllocations.allocations());
+            return 1;
+        }
+    }
+    spdlog::info("{} frames without steady state allocations", FRAMES);
+    return 0;
+}
@@ -0,0 +1,934 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include "common.h"
+#include "VulkanInstance.h"
+#include "VulkanDevice.h"
+#include "VulkanRenderPass.h"
+#include "VulkanFramebuffer.h"
+#include "VulkanPipelineLayout.h"
+#include "VulkanPipeline.h"
+#include "VulkanCommandBuffer.h"
+#include "VulkanShaderModule.h"
+#include "Initializers.h"
+#include "GpuProfiler.h"
+#include "Transform.h"
+#include "Culling.h"
+#include "OcclusionCuller.h"
+#include "DrawList.h"
+#include "MaterialTable.h"
+#include "CommandCache.h"
+#include "primitives.h"
+
+/**
+ * Headless throughput benchmark. Renders a grid of cubes into offscreen images on whatever
+ * device is present and sweeps object count, draw mode and frames in flight, each configuration
+ * is reported as frames/s, CPU ms (command recording + submit) and GPU ms per frame. The culled
+ * mode draws per object like per-object but only what survives CPU frustum culling, which runs
+ * every frame and is included in CPU ms. The occlusion mode culls on the GPU instead, frustum and
+ * Hi-Z occlusion tests in compute feed vkCmdDrawIndexedIndirectCount, its CPU ms is recording only.
+ * The sorted mode builds a sort-key draw list every frame and submits it, CPU ms includes the sort.
+ * The cached mode culls like culled but records the draws into secondary command buffers per
+ * bucket of objects, a bucket is recorded again only when what is visible in it changes.
+ * Every mode shades through a material table indexed per instance, one material is recoloured per
+ * frame so its update is part of CPU and GPU time.
+ *
+ * usage: VulkanCubeBench [--objects 1,100,1000] [--modes per-object,instanced,indirect,culled,occlusion,sorted,cached]
+ *                        [--frames-in-flight 1,2,3] [--frames 500] [--warmup 50]
+ *                        [--csv out.csv] [--json out.json] [--baseline baseline.csv] [--tolerance 0.1]
+ *
+ * A baseline is a csv written by an earlier run, the exit code is 1 if any configuration it shares
+ * with this run is worse than the baseline by more than tolerance. Timings only compare on the same
+ * machine and driver so no baseline is committed, nothing is gated unless a run is given one.
+ */
+
+#ifndef BENCH_SHADER_DIR
+#define BENCH_SHADER_DIR "shaders"
+#endif
+
+enum class DrawMode{ PerObject, Instanced, Indirect, Culled, Occlusion, Sorted, Cached };
+
+static const std::map<std::string, DrawMode> DRAW_MODES{
+        { "per-object", DrawMode::PerObject },
+        { "instanced", DrawMode::Instanced },
+        { "indirect", DrawMode::Indirect },
+        { "culled", DrawMode::Culled },
+        { "occlusion", DrawMode::Occlusion },
+        { "sorted", DrawMode::Sorted },
+        { "cached", DrawMode::Cached }
+};
+
+std::string toString(DrawMode mode){
+    for(auto& [name, value] : DRAW_MODES){
+        if(value == mode) return name;
+    }
+    return "unknown";
+}
+
+struct Config{
+    uint32_t objects;
+    DrawMode mode;
+    uint32_t framesInFlight;
+
+    [[nodiscard]]
+    std::string key() const {
+        return std::to_string(objects) + "," + toString(mode) + "," + std::to_string(framesInFlight);
+    }
+};
+
+struct Result{
+    Config config;
+    uint32_t frames = 0;
+    double fps = 0;
+    double cpuMs = 0;
+    double gpuMs = 0;
+};
+
+struct Options{
+    std::vector<uint32_t> objects{ 1, 100, 1000, 10000 };
+    std::vector<DrawMode> modes{ DrawMode::PerObject, DrawMode::Instanced, DrawMode::Indirect, DrawMode::Culled, DrawMode::Occlusion, DrawMode::Sorted, DrawMode::Cached };
+    std::vector<uint32_t> framesInFlight{ 1, 2, 3 };
+    uint32_t frames = 500;
+    uint32_t warmup = 50;
+    std::optional<io::fs::path> csv;
+    std::optional<io::fs::path> json;
+    std::optional<io::fs::path> baseline;
+    double tolerance = 0.1;
+
+    static std::vector<std::string> split(const std::string& list){
+        std::vector<std::string> items;
+        std::istringstream tokens{ list };
+        std::string item;
+        while(std::getline(tokens, item, ',')){
+            if(!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    static std::vector<uint32_t> numbers(const std::string& list){
+        std::vector<uint32_t> values;
+        for(auto& item : split(list)){
+            values.push_back(static_cast<uint32_t>(std::stoul(item)));
+        }
+        return values;
+    }
+
+    static Options parse(int argc, char** argv){
+        Options options;
+        for(int i = 1; i < argc; i++){
+            std::string arg = argv[i];
+            if(i + 1 >= argc) throw std::runtime_error{ "missing value for " + arg };
+            std::string value = argv[++i];
+
+            if(arg == "--objects"){
+                options.objects = numbers(value);
+            }else if(arg == "--modes"){
+                options.modes.clear();
+                for(auto& name : split(value)){
+                    auto itr = DRAW_MODES.find(name);
+                    if(itr == DRAW_MODES.end()) throw std::runtime_error{ "unknown draw mode " + name };
+                    options.modes.push_back(itr->second);
+                }
+            }else if(arg == "--frames-in-flight"){
+                options.framesInFlight = numbers(value);
+            }else if(arg == "--frames"){
+                options.frames = static_cast<uint32_t>(std::stoul(value));
+            }else if(arg == "--warmup"){
+                options.warmup = static_cast<uint32_t>(std::stoul(value));
+            }else if(arg == "--csv"){
+                options.csv = value;
+            }else if(arg == "--json"){
+                options.json = value;
+            }else if(arg == "--baseline"){
+                options.baseline = value;
+            }else if(arg == "--tolerance"){
+                options.tolerance = std::stod(value);
+            }else{
+                throw std::runtime_error{ "unknown option " + arg };
+            }
+        }
+        if(options.frames == 0) throw std::runtime_error{ "--frames must be at least 1" };
+        auto positive = [](const std::vector<uint32_t>& values){
+            return !values.empty() && std::find(begin(values), end(values), 0u) == end(values);
+        };
+        if(!positive(options.objects)) throw std::runtime_error{ "--objects must list counts of at least 1" };
+        if(!positive(options.framesInFlight)) throw std::runtime_error{ "--frames-in-flight must list counts of at least 1" };
+        return options;
+    }
+};
+
+class Bench{
+public:
+    static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    static constexpr float FAR_PLANE = 10.0f;
+    static constexpr uint32_t MATERIALS = 256;
+    static constexpr uint32_t TEXTURES = 4;
+    static constexpr uint32_t TEXTURE_SIZE = 64;
+    static constexpr uint32_t BUCKET_OBJECTS = 256;
+
+    Bench(){
+        createInstance();
+        pickPhysicalDevice();
+        createDevice();
+        pickDepthFormat();
+        createRenderPass();
+        createMaterials();
+        createPipeline();
+        commandPool = VulkanCommandPool{ device, *device.queueFamilyIndex.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT };
+        createMesh();
+    }
+
+    [[nodiscard]]
+    bool supports(DrawMode mode) const {
+        switch(mode){
+            case DrawMode::Indirect:
+                return device.enabledFeatures.drawIndirectFirstInstance;
+            case DrawMode::Occlusion:
+                return device.enabledFeatures.drawIndirectFirstInstance && drawIndirectCount;
+            default:
+                return true;
+        }
+    }
+
+    Result run(const Config& config, uint32_t warmup, uint32_t frameCount){
+        auto instances = createInstances(config.objects);
+        auto materialIndices = createMaterialIndices(config.objects);
+        auto bounds = createBounds(config.objects);
+        auto frustum = culling::Frustum::extract(viewProjection);
+        std::vector<uint32_t> visible;
+        VulkanBuffer drawCommands;
+        if(config.mode == DrawMode::Indirect){
+            drawCommands = createDrawCommands(config.objects);
+        }
+
+        std::vector<Frame> frames(config.framesInFlight);
+        std::vector<VkImageView> depthViews;
+        auto commandBuffers = commandPool.allocate(config.framesInFlight);
+        for(auto i = 0u; i < frames.size(); i++){
+            createFrame(frames[i]);
+            frames[i].commandBuffer = commandBuffers[i];
+            depthViews.push_back(frames[i].depthView);
+        }
+
+        OcclusionCuller occlusion;
+        if(config.mode == DrawMode::Occlusion){
+            occlusion = OcclusionCuller{ device, BENCH_SHADER_DIR, { WIDTH, HEIGHT }, depthViews, config.objects, indexCount };
+            std::vector<glm::vec4> spheres(config.objects);
+            for(auto i = 0u; i < config.objects; i++){
+                spheres[i] = { bounds.x[i], bounds.y[i], bounds.z[i], bounds.radius[i] };
+            }
+            occlusion.setObjects(spheres);
+        }
+
+        DrawList drawList;
+        DrawList::Id pipelineId = 0, descriptorSetId = 0, geometryId = 0;
+        if(config.mode == DrawMode::Sorted){
+            pipelineId = drawList.addPipeline(graphicsPipeline.pipeline);
+            descriptorSetId = drawList.addDescriptorSet({ pipelineLayout, 0, materials.descriptorSet() });
+            geometryId = drawList.addGeometry({ { vertices.buffer, instances, materialIndices }, indices.buffer });
+        }
+
+        CommandCache commandCache;
+        if(config.mode == DrawMode::Cached){
+            commandCache = CommandCache{ device, *device.queueFamilyIndex.graphics, config.framesInFlight };
+        }
+
+        GpuProfiler profiler{ device, config.framesInFlight, *device.queueFamilyIndex.graphics };
+        auto graphicsQueue = device.queues.graphics;
+        double cpuMs = 0;
+
+        auto render = [&](uint32_t count){
+            for(auto frameIndex = 0u; frameIndex < count; frameIndex++){
+                auto slot = frameIndex % config.framesInFlight;
+                auto& frame = frames[slot];
+                vkWaitForFences(device, 1, &frame.inFlight.handle, VK_TRUE, UINT64_MAX);
+                profiler.collect(slot);
+                vkResetFences(device, 1, &frame.inFlight.handle);
+
+                auto start = std::chrono::steady_clock::now();
+                recolour(frameIndex);
+                if(config.mode == DrawMode::Cached){
+                    commandCache.beginFrame();
+                }
+                if(config.mode == DrawMode::Culled || config.mode == DrawMode::Cached){
+                    culling::cull(jobs, frustum, bounds, visible);
+                }
+                if(config.mode == DrawMode::Sorted){
+                    drawList.clear();
+                    for(auto i = 0u; i < config.objects; i++){
+                        auto clip = viewProjection * glm::vec4(bounds.x[i], bounds.y[i], bounds.z[i], 1);
+                        drawList.add(pipelineId, descriptorSetId, geometryId, clip.w / FAR_PLANE, { indexCount, 1, 0, 0, i });
+                    }
+                    drawList.sort(jobs);
+                }
+                record(frame, slot, config, instances, materialIndices, drawCommands, visible, occlusion, drawList, commandCache, profiler);
+
+                VkSubmitInfo submitInfo{};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &frame.commandBuffer;
+                ASSERT(vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlight));
+                cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            vkDeviceWaitIdle(device);
+            for(auto slot = 0u; slot < config.framesInFlight; slot++){
+                profiler.collect(slot);
+            }
+        };
+
+        render(warmup);
+
+        // fresh profiler so warmup frames don't end up in the GPU numbers
+        profiler = GpuProfiler{ device, config.framesInFlight, *device.queueFamilyIndex.graphics };
+        cpuMs = 0;
+        auto start = std::chrono::steady_clock::now();
+        render(frameCount);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if(config.mode == DrawMode::Occlusion){
+            auto drawn = occlusion.drawCounts();
+            spdlog::info("occlusion culling drew {} + {} of {} objects in the last frame", drawn[0], drawn[1], config.objects);
+        }
+        if(config.mode == DrawMode::Sorted){
+            auto& counters = drawList.counters();
+            spdlog::info("sorted submission of {} draws bound {} pipelines, {} descriptor sets and {} geometries, {} binds avoided"
+                         , counters.draws, counters.pipelineBinds, counters.descriptorSetBinds, counters.geometryBinds, counters.bindsAvoided);
+        }
+        if(config.mode == DrawMode::Cached){
+            auto& stats = commandCache.stats();
+            spdlog::info("cached recording re-recorded {} and reused {} buckets in the last frame", stats.recorded, stats.reused);
+        }
+
+        vkFreeCommandBuffers(device, commandPool, COUNT(commandBuffers), commandBuffers.data());
+
+        Result result{ config, frameCount };
+        result.fps = frameCount / elapsed;
+        result.cpuMs = cpuMs / frameCount;
+        auto gpu = profiler.stats().find("frame");
+        result.gpuMs = gpu != profiler.stats().end() ? gpu->second.average() : 0;
+        return result;
+    }
+
+private:
+    struct Frame{
+        VulkanImage target;
+        VulkanImageView targetView;
+        VulkanImage depth;
+        VulkanImageView depthView;
+        VulkanFramebuffer framebuffer;
+        VulkanFence inFlight;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+
+    void createInstance(){
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.apiVersion = VK_API_VERSION_1_2;
+        appInfo.pApplicationName = "Vulkan Cube Bench";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        instance = VulkanInstance{ appInfo, {} };
+    }
+
+    void pickPhysicalDevice(){
+        auto pDevices = enumerate<VkPhysicalDevice>([&](uint32_t* size, VkPhysicalDevice* pDevice){
+            return vkEnumeratePhysicalDevices(instance, size, pDevice);
+        });
+        if(pDevices.empty()) throw std::runtime_error{ "no vulkan device found" };
+
+        auto best = std::max_element(begin(pDevices), end(pDevices), [](auto a, auto b){
+            return VulkanDevice{ a }.score() < VulkanDevice{ b }.score();
+        });
+        device = VulkanDevice{ *best };
+        spdlog::info("selected device: {}", device.name());
+    }
+
+    void createDevice(){
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
+        VkPhysicalDeviceFeatures features{};
+        features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        features.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+        std::vector<const char*> extensions;
+        if(device.extensionSupported("VK_KHR_portability_subset")){
+            extensions.push_back("VK_KHR_portability_subset");
+        }
+        if(device.extensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)){
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        // vkCmdDrawIndexedIndirectCount is core in 1.2 but still optional, the occlusion mode needs it
+        VkPhysicalDeviceVulkan12Features supported12{};
+        supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        auto vulkan12 = device.getProperties().apiVersion >= VK_API_VERSION_1_2;
+        if(vulkan12){
+            VkPhysicalDeviceFeatures2 supported2{};
+            supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            supported2.pNext = &supported12;
+            vkGetPhysicalDeviceFeatures2(device, &supported2);
+        }
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.drawIndirectCount = supported12.drawIndirectCount;
+
+        device.createLogicalDevice(features, extensions, {}, VK_NULL_HANDLE, VK_QUEUE_GRAPHICS_BIT, vulkan12 ? &features12 : nullptr);
+        drawIndirectCount = features12.drawIndirectCount == VK_TRUE;
+        if(!features.drawIndirectFirstInstance){
+            spdlog::warn("drawIndirectFirstInstance is not supported, indirect draws are skipped");
+        }
+        if(!drawIndirectCount){
+            spdlog::warn("drawIndirectCount is not supported, occlusion culling is skipped");
+        }
+    }
+
+    // the occlusion culler reduces the depth buffer in a compute shader, it has to be sampled as well as rendered to
+    void pickDepthFormat(){
+        depthFormat = device.findSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }
+                                                 , VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+        if(depthFormat == VK_FORMAT_UNDEFINED) throw std::runtime_error{ "no sampled depth format supported" };
+    }
+
+    void createRenderPass(){
+        renderPass = createRenderPass(false);
+        resumePass = createRenderPass(true);
+    }
+
+    /**
+     * resume continues into what an earlier pass left in the attachments, the occlusion mode splits
+     * the frame around the depth pyramid build. The passes are compatible, the pipeline and the
+     * framebuffers work with both.
+     */
+    VulkanRenderPass createRenderPass(bool resume){
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = COLOR_FORMAT;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = resume ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        // depth ends up read only so the pyramid build can sample it
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = depthFormat;
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = resume ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = resume ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+        std::vector<VkSubpassDescription> subpasses(1);
+        subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[0].colorAttachmentCount = 1;
+        subpasses[0].pColorAttachments = &colorReference;
+        subpasses[0].pDepthStencilAttachment = &depthReference;
+
+        // the previous frame rendering into the same images, or reducing its depth, has to finish first
+        std::vector<VkSubpassDependency> dependencies(2);
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                                        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // depth is reduced into the occlusion pyramid right after the pass
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        return VulkanRenderPass{ device, { colorAttachment, depthAttachment }, subpasses, dependencies };
+    }
+
+    // checkerboards of different frequencies over materials of different hues
+    void createMaterials(){
+        materials = MaterialTable{ device, MATERIALS, { TEXTURE_SIZE, TEXTURE_SIZE }, TEXTURES };
+
+        std::vector<uint8_t> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+        for(auto texture = 0u; texture < TEXTURES; texture++){
+            auto cell = TEXTURE_SIZE >> (texture + 1);
+            for(auto y = 0u; y < TEXTURE_SIZE; y++){
+                for(auto x = 0u; x < TEXTURE_SIZE; x++){
+                    auto value = static_cast<uint8_t>((x / cell + y / cell) % 2 ? 255 : 96);
+                    std::memset(&texels[(y * TEXTURE_SIZE + x) * 4], value, 4);
+                }
+            }
+            materials.addTexture(texels);
+        }
+
+        for(auto i = 0u; i < MATERIALS; i++){
+            MaterialTable::Material material;
+            material.baseColor = hue(static_cast<float>(i) / MATERIALS);
+            material.albedoLayer = i % (TEXTURES + 1);
+            materials.add(material);
+        }
+    }
+
+    static glm::vec4 hue(float h){
+        auto channel = [h](float offset){
+            return std::clamp(std::abs(std::fmod(h * 6.0f + offset, 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+        };
+        return { channel(0.0f), channel(4.0f), channel(2.0f), 1.0f };
+    }
+
+    // a material edit per frame, what the table uploads is that one material
+    void recolour(uint32_t frameIndex){
+        auto id = frameIndex % materials.size();
+        auto material = materials.get(id);
+        material.baseColor = hue(static_cast<float>(frameIndex % 360) / 360.0f);
+        materials.set(id, material);
+    }
+
+    void createPipeline(){
+        pipelineLayout = VulkanPipelineLayout{ device, { materials.descriptorSetLayout() }, { {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)} } };
+
+        auto vertexShaderModule = VulkanShaderModule{ device, io::fs::path{ BENCH_SHADER_DIR } / "bench.vert.spv" };
+        auto fragmentShaderModule = VulkanShaderModule{ device, io::fs::path{ BENCH_SHADER_DIR } / "material.frag.spv" };
+        auto shaderStages = initializers::vertexShaderStages(device, {
+                { vertexShaderModule, VK_SHADER_STAGE_VERTEX_BIT},
+                { fragmentShaderModule,  VK_SHADER_STAGE_FRAGMENT_BIT}
+        });
+
+        // per instance model matrix, one vec4 attribute per column, and material index
+        auto vertexBindings = Vertex::binding();
+        vertexBindings.push_back({ 1, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE });
+        vertexBindings.push_back({ 2, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_INSTANCE });
+        auto attributes = Vertex::attributes();
+        for(uint32_t column = 0; column < 4; column++){
+            attributes.push_back({ 4 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT, column * static_cast<uint32_t>(sizeof(glm::vec4)) });
+        }
+        attributes.push_back({ 8, 2, VK_FORMAT_R32_UINT, 0 });
+
+        VkPipelineVertexInputStateCreateInfo inputState = initializers::vertexInputState(vertexBindings, attributes);
+        VkPipelineInputAssemblyStateCreateInfo assemblyState = initializers::inputAssemblyState();
+        VkPipelineViewportStateCreateInfo viewportState = initializers::viewportState( initializers::viewport(WIDTH, HEIGHT), initializers::scissor({WIDTH, HEIGHT}));
+        VkPipelineRasterizationStateCreateInfo rasterState = initializers::rasterizationState();
+        VkPipelineMultisampleStateCreateInfo multisampleState = initializers::multisampleState();
+        VkPipelineDepthStencilStateCreateInfo depthStencilState = initializers::depthStencilState();
+        VkPipelineColorBlendStateCreateInfo colorBlendState = initializers::colorBlendState();
+        VkPipelineDynamicStateCreateInfo  dynamicState = initializers::dynamicState();
+
+        VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+        pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineCreateInfo.stageCount = COUNT(shaderStages);
+        pipelineCreateInfo.pStages = shaderStages.data();
+        pipelineCreateInfo.pVertexInputState = &inputState;
+        pipelineCreateInfo.pInputAssemblyState = &assemblyState;
+        pipelineCreateInfo.pViewportState = &viewportState;
+        pipelineCreateInfo.pRasterizationState = &rasterState;
+        pipelineCreateInfo.pMultisampleState = &multisampleState;
+        pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+        pipelineCreateInfo.pColorBlendState = &colorBlendState;
+        pipelineCreateInfo.pDynamicState = &dynamicState;
+        pipelineCreateInfo.layout = pipelineLayout;
+        pipelineCreateInfo.renderPass = renderPass;
+        pipelineCreateInfo.subpass = 0;
+        pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineCreateInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+        graphicsPipeline = VulkanPipeline{ device, pipeline };
+    }
+
+    void createMesh(){
+        // white, the materials colour it
+        auto mesh = primitives::cube(glm::vec3(1));
+        VkDeviceSize vertexSize = sizeof(mesh.vertices[0]) * mesh.vertices.size();
+        VkDeviceSize indexSize = sizeof(mesh.indices[0]) * mesh.indices.size();
+        indexCount = COUNT(mesh.indices);
+
+        VulkanBuffer stagingBuffer = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::CpuOnly, vertexSize + indexSize);
+        auto staging = static_cast<char*>(stagingBuffer.map());
+        std::memcpy(staging, mesh.vertices.data(), vertexSize);
+        std::memcpy(staging + vertexSize, mesh.indices.data(), indexSize);
+        stagingBuffer.unmap();
+
+        vertices = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly, vertexSize);
+        indices = device.createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MemoryUsage::GpuOnly, indexSize);
+
+        commandPool.oneTime(device.queues.graphics, [&](VkCommandBuffer commandBuffer){
+            VkBufferCopy vertexRegion{ 0, 0, vertexSize };
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertices, 1, &vertexRegion);
+
+            VkBufferCopy indexRegion{ vertexSize, 0, indexSize };
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, indices, 1, &indexRegion);
+        });
+    }
+
+    // objects are laid out on a cubic grid that fills the view
+    static glm::vec3 gridPosition(uint32_t objects, uint32_t i, float& size){
+        auto side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(objects))));
+        auto spacing = 2.0f / static_cast<float>(side);
+        size = spacing * 0.4f;
+        return {
+            -1.0f + spacing * (0.5f + static_cast<float>(i % side)),
+            -1.0f + spacing * (0.5f + static_cast<float>(i / side % side)),
+            -1.0f + spacing * (0.5f + static_cast<float>(i / (side * side)))
+        };
+    }
+
+    VulkanBuffer createInstances(uint32_t objects){
+        transform::Instances grid;
+        grid.resize(objects);
+        for(auto i = 0u; i < objects; i++){
+            float size;
+            auto position = gridPosition(objects, i, size);
+            grid.tx[i] = position.x;
+            grid.ty[i] = position.y;
+            grid.tz[i] = position.z;
+            grid.sx[i] = grid.sy[i] = grid.sz[i] = size;
+        }
+
+        auto buffer = device.createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::CpuToGpu, sizeof(glm::mat4) * objects);
+        transform::compute(jobs, grid, viewProjection, nullptr, static_cast<glm::mat4*>(buffer.map()));
+        buffer.unmap();
+        return buffer;
+    }
+
+    // neighbouring objects get different materials
+    VulkanBuffer createMaterialIndices(uint32_t objects){
+        auto buffer = device.createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::CpuToGpu, sizeof(uint32_t) * objects);
+        auto ids = static_cast<uint32_t*>(buffer.map());
+        for(auto i = 0u; i < objects; i++){
+            ids[i] = i % materials.size();
+        }
+        buffer.unmap();
+        return buffer;
+    }
+
+    // bounding spheres of the grid's cubes, a unit cube scaled by size has radius size * sqrt(3) / 2
+    static culling::Spheres createBounds(uint32_t objects){
+        culling::Spheres bounds;
+        bounds.resize(objects);
+        for(auto i = 0u; i < objects; i++){
+            float size;
+            auto position = gridPosition(objects, i, size);
+            bounds.x[i] = position.x;
+            bounds.y[i] = position.y;
+            bounds.z[i] = position.z;
+            bounds.radius[i] = size * 0.8660254f;
+        }
+        return bounds;
+    }
+
+    VulkanBuffer createDrawCommands(uint32_t objects){
+        auto buffer = device.createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::CpuToGpu, sizeof(VkDrawIndexedIndirectCommand) * objects);
+        auto commands = static_cast<VkDrawIndexedIndirectCommand*>(buffer.map());
+        for(auto i = 0u; i < objects; i++){
+            commands[i] = { indexCount, 1, 0, 0, i };
+        }
+        buffer.unmap();
+        return buffer;
+    }
+
+    void createFrame(Frame& frame){
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = COLOR_FORMAT;
+        imageInfo.extent = { WIDTH, HEIGHT, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        frame.target = device.createImage(imageInfo, MemoryUsage::GpuOnly);
+
+        auto viewInfo = initializers::imageViewCreateInfo(frame.target.image, COLOR_FORMAT, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+        VkImageView view;
+        ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &view));
+        frame.targetView = VulkanImageView{ device, view };
+
+        imageInfo.format = depthFormat;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        frame.depth = device.createImage(imageInfo, MemoryUsage::GpuOnly);
+
+        viewInfo = initializers::imageViewCreateInfo(frame.depth.image, depthFormat, { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 });
+        VkImageView depthView;
+        ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &depthView));
+        frame.depthView = VulkanImageView{ device, depthView };
+        frame.framebuffer = VulkanFramebuffer{ device, renderPass, { view, depthView }, WIDTH, HEIGHT };
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        VkFence fence;
+        ASSERT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+        frame.inFlight = VulkanFence{ device, fence };
+    }
+
+    void record(Frame& frame, uint32_t slot, const Config& config, VkBuffer instances, VkBuffer materialIndices, VkBuffer drawCommands
+                , const std::vector<uint32_t>& visible, OcclusionCuller& occlusion, DrawList& drawList, CommandCache& commandCache
+                , GpuProfiler& profiler){
+        auto commandBuffer = frame.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        profiler.begin(commandBuffer, slot);
+        {
+            auto frameScope = profiler.pass(commandBuffer, slot, "frame");
+            materials.update(commandBuffer);
+
+            if(config.mode == DrawMode::Occlusion){
+                occlusion.cullFirst(commandBuffer, viewProjection);
+            }
+
+            VkClearValue clearValues[2]{};
+            clearValues[0].color = { {0, 0, 0, 1} };
+            clearValues[1].depthStencil = { 1.0f, 0 };
+
+            VkRenderPassBeginInfo beginRenderPass{};
+            beginRenderPass.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            beginRenderPass.renderPass = renderPass;
+            beginRenderPass.framebuffer = frame.framebuffer;
+            beginRenderPass.renderArea = { {0, 0}, {WIDTH, HEIGHT} };
+            beginRenderPass.clearValueCount = 2;
+            beginRenderPass.pClearValues = clearValues;
+
+            auto bindGeometry = [&](VkCommandBuffer target){
+                vkCmdBindPipeline(target, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline.pipeline);
+                vkCmdPushConstants(target, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProjection);
+                VkDescriptorSet materialSet = materials.descriptorSet();
+                vkCmdBindDescriptorSets(target, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &materialSet, 0, nullptr);
+
+                VkBuffer vertexBuffers[]{ vertices.buffer, instances, materialIndices };
+                VkDeviceSize offsets[]{ 0, 0, 0 };
+                vkCmdBindVertexBuffers(target, 0, 3, vertexBuffers, offsets);
+                vkCmdBindIndexBuffer(target, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            };
+
+            // cached draws come from secondary command buffers, each binds its own state
+            auto contents = config.mode == DrawMode::Cached ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+            vkCmdBeginRenderPass(commandBuffer, &beginRenderPass, contents);
+            // the draw list binds what its draws need itself
+            if(config.mode == DrawMode::Sorted){
+                vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProjection);
+            }else if(config.mode != DrawMode::Cached){
+                bindGeometry(commandBuffer);
+            }
+
+            switch(config.mode){
+                case DrawMode::PerObject:
+                    for(auto i = 0u; i < config.objects; i++){
+                        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, i);
+                    }
+                    break;
+                case DrawMode::Instanced:
+                    vkCmdDrawIndexed(commandBuffer, indexCount, config.objects, 0, 0, 0);
+                    break;
+                case DrawMode::Indirect:
+                    if(device.enabledFeatures.multiDrawIndirect){
+                        vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, 0, config.objects, sizeof(VkDrawIndexedIndirectCommand));
+                    }else{
+                        for(auto i = 0u; i < config.objects; i++){
+                            vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, i * sizeof(VkDrawIndexedIndirectCommand), 1, 0);
+                        }
+                    }
+                    break;
+                case DrawMode::Culled:
+                    for(auto i : visible){
+                        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, i);
+                    }
+                    break;
+                case DrawMode::Occlusion:
+                    occlusion.draw(commandBuffer, 0);
+                    break;
+                case DrawMode::Sorted:
+                    drawList.submit(commandBuffer);
+                    break;
+                case DrawMode::Cached:{
+                    // visible is ascending, so each bucket's objects are one run of it
+                    VkCommandBufferInheritanceInfo inheritance{};
+                    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+                    inheritance.renderPass = renderPass;
+                    inheritance.framebuffer = frame.framebuffer;
+
+                    std::vector<VkCommandBuffer> buckets;
+                    for(size_t first = 0; first < visible.size();){
+                        auto bucket = visible[first] / BUCKET_OBJECTS;
+                        auto last = first;
+                        while(last < visible.size() && visible[last] / BUCKET_OBJECTS == bucket) last++;
+
+                        auto key = StateHash{}
+                                .add(graphicsPipeline.pipeline)
+                                .add(instances)
+                                .add(materialIndices)
+                                .add(viewProjection)
+                                .add(visible.data() + first, (last - first) * sizeof(uint32_t))
+                                .value();
+                        buckets.push_back(commandCache.get(slot, bucket, key, [&](VkCommandBuffer secondary){
+                            bindGeometry(secondary);
+                            for(auto i = first; i < last; i++){
+                                vkCmdDrawIndexed(secondary, indexCount, 1, 0, 0, visible[i]);
+                            }
+                        }, &inheritance));
+                        first = last;
+                    }
+                    if(!buckets.empty()){
+                        vkCmdExecuteCommands(commandBuffer, COUNT(buckets), buckets.data());
+                    }
+                    break;
+                }
+            }
+
+            vkCmdEndRenderPass(commandBuffer);
+
+            // what the previous frame's depth hid but this frame's doesn't is drawn on top
+            if(config.mode == DrawMode::Occlusion){
+                occlusion.buildPyramid(commandBuffer, slot);
+                occlusion.cullSecond(commandBuffer, viewProjection);
+
+                beginRenderPass.renderPass = resumePass;
+                vkCmdBeginRenderPass(commandBuffer, &beginRenderPass, VK_SUBPASS_CONTENTS_INLINE);
+                bindGeometry(commandBuffer);
+                occlusion.draw(commandBuffer, 1);
+                vkCmdEndRenderPass(commandBuffer);
+            }
+        }
+        vkEndCommandBuffer(commandBuffer);
+    }
+
+    VulkanInstance instance;
+    VulkanDevice device;
+    VulkanRenderPass renderPass;
+    VulkanRenderPass resumePass;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    bool drawIndirectCount = false;
+    MaterialTable materials;
+    VulkanPipelineLayout pipelineLayout;
+    VulkanPipeline graphicsPipeline;
+    VulkanCommandPool commandPool;
+    VulkanBuffer vertices;
+    VulkanBuffer indices;
+    uint32_t indexCount = 0;
+    jobs::Scheduler jobs;
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, FAR_PLANE)
+                               * glm::lookAt(glm::vec3(0, 0, 3.5f), glm::vec3(0), glm::vec3(0, 1, 0));
+};
+
+void writeCsv(const io::fs::path& path, const std::vector<Result>& results){
+    std::ofstream fout{ path };
+    if(!fout.good()) throw std::runtime_error{ "unable to write results to " + path.string() };
+
+    fout << "objects,mode,frames_in_flight,frames,fps,cpu_ms,gpu_ms\n";
+    for(auto& result : results){
+        fout << result.config.key() << ',' << result.frames << ',' << result.fps
+             << ',' << result.cpuMs << ',' << result.gpuMs << '\n';
+    }
+}
+
+void writeJson(const io::fs::path& path, const std::vector<Result>& results){
+    std::ofstream fout{ path };
+    if(!fout.good()) throw std::runtime_error{ "unable to write results to " + path.string() };
+
+    fout << "[\n";
+    for(auto i = 0u; i < results.size(); i++){
+        auto& result = results[i];
+        fout << "  {\"objects\": " << result.config.objects
+             << ", \"mode\": \"" << toString(result.config.mode) << '"'
+             << ", \"frames_in_flight\": " << result.config.framesInFlight
+             << ", \"frames\": " << result.frames
+             << ", \"fps\": " << result.fps
+             << ", \"cpu_ms\": " << result.cpuMs
+             << ", \"gpu_ms\": " << result.gpuMs << '}'
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    fout << "]\n";
+}
+
+std::map<std::string, Result> readBaseline(const io::fs::path& path){
+    std::ifstream fin{ path };
+    if(!fin.good()) throw std::runtime_error{ "unable to read baseline " + path.string() };
+
+    std::map<std::string, Result> baseline;
+    std::string line;
+    std::getline(fin, line);    // header
+    while(std::getline(fin, line)){
+        auto fields = Options::split(line);
+        if(fields.size() != 7) continue;
+        Result result{};
+        result.fps = std::stod(fields[4]);
+        result.cpuMs = std::stod(fields[5]);
+        result.gpuMs = std::stod(fields[6]);
+        baseline[fields[0] + "," + fields[1] + "," + fields[2]] = result;
+    }
+    return baseline;
+}
+
+// lower fps or higher frame times than baseline by more than tolerance are regressions
+uint32_t compare(const std::vector<Result>& results, const std::map<std::string, Result>& baseline, double tolerance){
+    uint32_t regressions = 0;
+    auto check = [&](const std::string& key, const char* metric, double value, double reference, bool higherIsBetter){
+        if(reference <= 0) return;
+        auto change = (value - reference) / reference;
+        if(higherIsBetter ? change < -tolerance : change > tolerance){
+            spdlog::error("regression {}: {} {:.3f} vs baseline {:.3f} ({:+.1f}%)", key, metric, value, reference, change * 100);
+            regressions++;
+        }
+    };
+    for(auto& result : results){
+        auto key = result.config.key();
+        auto itr = baseline.find(key);
+        if(itr == baseline.end()) continue;
+        check(key, "fps", result.fps, itr->second.fps, true);
+        check(key, "cpu ms", result.cpuMs, itr->second.cpuMs, false);
+        check(key, "gpu ms", result.gpuMs, itr->second.gpuMs, false);
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv){
+    try{
+        auto options = Options::parse(argc, argv);
+        Bench bench;
+
+        std::vector<Result> results;
+        for(auto objects : options.objects){
+            for(auto mode : options.modes){
+                if(!bench.supports(mode)) continue;
+                for(auto framesInFlight : options.framesInFlight){
+                    auto result = bench.run({ objects, mode, framesInFlight }, options.warmup, options.frames);
+                    spdlog::info("{} objects, {}, {} frames in flight: {:.1f} fps, cpu {:.3f} ms, gpu {:.3f} ms"
+                                 , objects, toString(mode), framesInFlight, result.fps, result.cpuMs, result.gpuMs);
+                    results.push_back(result);
+                }
+            }
+        }
+
+        if(options.csv) writeCsv(*options.csv, results);
+        if(options.json) writeJson(*options.json, results);
+
+        if(options.baseline){
+            auto regressions = compare(results, readBaseline(*options.baseline), options.tolerance);
+            if(regressions > 0){
+                spdlog::error("{} regressions against {}", regressions, options.baseline->string());
+                return 1;
+            }
+        }
+    }catch(const std::exception& error){
+        spdlog::error(error.what());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <cstdio>
+#include <algorithm>
+#include <sstream>
+#include <map>
+#include <tuple>
+#include <spdlog/spdlog.h>
+#include "cooked.h"
+
+/**
+ * Minimal Wavefront OBJ reader (v, vt, vn, f), polygons are triangulated as fans
+ */
+Mesh loadObj(const io::fs::path& path, const glm::vec3& color){
+    std::ifstream fin{ path.string() };
+    if(!fin) throw std::runtime_error{ "unable to open " + path.string() };
+
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::map<std::tuple<int, int, int>, uint32_t> vertexIndex;
+    Mesh mesh;
+
+    size_t lineNumber = 0;
+    // OBJ indices count from 1, negative ones back from the last element read so far, 0 is never valid
+    auto resolve = [&](int index, size_t size, const char* element){
+        auto resolved = index < 0 ? static_cast<int64_t>(size) + index : static_cast<int64_t>(index) - 1;
+        if(index == 0 || resolved < 0 || resolved >= static_cast<int64_t>(size)){
+            throw std::runtime_error{ fmt::format("{}:{}: face references {} {}, {} are defined", path.string(), lineNumber, element, index, size) };
+        }
+        return static_cast<int>(resolved);
+    };
+
+    std::string line;
+    while(std::getline(fin, line)){
+        lineNumber++;
+        std::istringstream tokens{ line };
+        std::string type;
+        tokens >> type;
+        if(type == "v"){
+            glm::vec4 p{0, 0, 0, 1};
+            tokens >> p.x >> p.y >> p.z;
+            positions.push_back(p);
+        }else if(type == "vn"){
+            glm::vec3 n{};
+            tokens >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        }else if(type == "vt"){
+            glm::vec2 uv{};
+            tokens >> uv.x >> uv.y;
+            uvs.push_back(uv);
+        }else if(type == "f"){
+            std::vector<uint32_t> face;
+            std::string corner;
+            while(tokens >> corner){
+                int p = 0, t = 0, n = 0;
+                if(std::sscanf(corner.c_str(), "%d/%d/%d", &p, &t, &n) != 3
+                    && std::sscanf(corner.c_str(), "%d//%d", &p, &n) != 2
+                    && std::sscanf(corner.c_str(), "%d/%d", &p, &t) != 2){
+                    std::sscanf(corner.c_str(), "%d", &p);
+                }
+                auto key = std::make_tuple(resolve(p, positions.size(), "position")
+                                          , t ? resolve(t, uvs.size(), "texture coordinate") : -1
+                                          , n ? resolve(n, normals.size(), "normal") : -1);
+                auto [itr, inserted] = vertexIndex.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+                if(inserted){
+                    Vertex vertex{};
+                    vertex.position = positions.at(std::get<0>(key));
+                    vertex.normals = std::get<2>(key) >= 0 ? normals.at(std::get<2>(key)) : glm::vec3{0};
+                    vertex.color = color;
+                    vertex.uv = std::get<1>(key) >= 0 ? uvs.at(std::get<1>(key)) : glm::vec2{0};
+                    mesh.vertices.push_back(vertex);
+                }
+                face.push_back(itr->second);
+            }
+            for(size_t i = 2; i < face.size(); i++){
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+    }
+    return mesh;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    auto compression = cooked::Compression::None;
+    auto lz4 = std::find(begin(args), end(args), "--lz4");
+    if(lz4 != end(args)){
+        compression = cooked::Compression::LZ4;
+        args.erase(lz4);
+    }
+
+    if(args.size() < 2){
+        std::cerr << "usage: VulkanCubeCooker [--lz4] <output.vcm> <input.obj | cube>...\n";
+        return 1;
+    }
+
+    try {
+        std::vector<Mesh> meshes;
+        for(auto i = 1u; i < args.size(); i++){
+            if(args[i] == "cube"){
+                meshes.push_back(primitives::cube());
+            }else{
+                meshes.push_back(loadObj(args[i], {1, 0, 0}));
+            }
+            spdlog::info("{}: {} vertices, {} indices", args[i], meshes.back().vertices.size(), meshes.back().indices.size());
+        }
+        cooked::write(args[0], meshes, compression);
+        spdlog::info("wrote {} meshes to {}", meshes.size(), args[0]);
+    }catch(const std::exception& error){
+        spdlog::error("{}", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,593 @@
+#include <benchmark/benchmark.h>
+#include "VulkanCube.h"
+#include "Transform.h"
+#include "Scene.h"
+#include "Jobs.h"
+#include "Culling.h"
+#include "Bvh.h"
+#include "DrawList.h"
+
+/**
+ * CPU microbenchmarks for the engine's hot paths. Benchmarks that need a device (Resource::flush,
+ * descriptor set allocation) run on whatever ICD is present, lavapipe is enough, and are skipped
+ * when there is none.
+ */
+
+namespace {
+
+    struct Context{
+        VulkanInstance instance;
+        VulkanDevice device;
+    };
+
+    Context* context(){
+        static std::unique_ptr<Context> shared = []() -> std::unique_ptr<Context> {
+            try{
+                auto ctx = std::make_unique<Context>();
+                VkApplicationInfo appInfo{};
+                appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+                appInfo.apiVersion = VK_API_VERSION_1_2;
+                appInfo.pApplicationName = "Vulkan Cube Microbench";
+                ctx->instance = VulkanInstance{ appInfo, {} };
+
+                auto pDevices = enumerate<VkPhysicalDevice>([&](uint32_t* size, VkPhysicalDevice* pDevice){
+                    return vkEnumeratePhysicalDevices(ctx->instance, size, pDevice);
+                });
+                if(pDevices.empty()) return nullptr;
+                ctx->device = VulkanDevice{ pDevices.front() };
+                ctx->device.createLogicalDevice({}, {});
+                return ctx;
+            }catch(const std::runtime_error& error){
+                spdlog::warn("no vulkan device, device benchmarks are skipped: {}", error.what());
+                return nullptr;
+            }
+        }();
+        return shared.get();
+    }
+
+    template<size_t Matrices>
+    struct Payload{
+        glm::mat4 matrices[Matrices];
+    };
+
+}
+
+static void BM_PrimitivesCube(benchmark::State& state){
+    auto count = state.range(0);
+    for(auto _ : state){
+        for(auto i = 0; i < count; i++){
+            auto mesh = primitives::cube({1, 0, 0});
+            benchmark::DoNotOptimize(mesh.vertices.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_PrimitivesCube)->RangeMultiplier(8)->Range(1, 512);
+
+// pure helper overhead, the provider only reports a count and fills the output
+static void BM_Enumerate(benchmark::State& state){
+    auto size = static_cast<uint32_t>(state.range(0));
+    auto provider = [size](uint32_t* count, VkExtensionProperties* properties){
+        if(properties){
+            for(auto i = 0u; i < *count; i++) properties[i].specVersion = i;
+        }
+        *count = size;
+        return VK_SUCCESS;
+    };
+    for(auto _ : state){
+        auto objects = enumerate<VkExtensionProperties>(provider);
+        benchmark::DoNotOptimize(objects.data());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Enumerate)->RangeMultiplier(4)->Range(1, 1024);
+
+static void BM_Get(benchmark::State& state){
+    auto size = static_cast<uint32_t>(state.range(0));
+    auto provider = [size](uint32_t* count, VkQueueFamilyProperties* properties){
+        if(properties){
+            for(auto i = 0u; i < *count; i++) properties[i].queueCount = i;
+        }
+        *count = size;
+    };
+    for(auto _ : state){
+        auto objects = get<VkQueueFamilyProperties>(provider);
+        benchmark::DoNotOptimize(objects.data());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Get)->RangeMultiplier(4)->Range(1, 1024);
+
+// same query into inline storage, no heap allocation up to 16 results
+static void BM_GetSmallVector(benchmark::State& state){
+    auto size = static_cast<uint32_t>(state.range(0));
+    auto provider = [size](uint32_t* count, VkQueueFamilyProperties* properties){
+        if(properties){
+            for(auto i = 0u; i < *count; i++) properties[i].queueCount = i;
+        }
+        *count = size;
+    };
+    for(auto _ : state){
+        auto objects = get<VkQueueFamilyProperties, SmallVector<VkQueueFamilyProperties, 16>>(provider);
+        benchmark::DoNotOptimize(objects.data());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_GetSmallVector)->RangeMultiplier(4)->Range(1, 1024);
+
+// a frame's worth of transient lists from the arena, reset like a frame whose fence signalled
+static void BM_FrameArena(benchmark::State& state){
+    auto lists = static_cast<size_t>(state.range(0));
+    FrameArena arena;
+    for(auto _ : state){
+        arena.reset();
+        for(size_t i = 0; i < lists; i++){
+            ArenaVector<VkImageMemoryBarrier> barriers{ arena };
+            barriers.reserve(8);
+            barriers.resize(8);
+            benchmark::DoNotOptimize(barriers.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(lists));
+}
+BENCHMARK(BM_FrameArena)->RangeMultiplier(8)->Range(1, 512);
+
+static void BM_EnumerateInstanceExtensions(benchmark::State& state){
+    for(auto _ : state){
+        auto extensions = VulkanInstance::getExtensions();
+        benchmark::DoNotOptimize(extensions.data());
+    }
+}
+BENCHMARK(BM_EnumerateInstanceExtensions);
+
+template<typename T>
+static void BM_ResourceFlush(benchmark::State& state){
+    auto ctx = context();
+    if(!ctx){
+        state.SkipWithError("no vulkan device");
+        return;
+    }
+    Resource<T> resource{};
+    resource.buffer = ctx->device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::CpuToGpu, Resource<T>::size);
+    for(auto _ : state){
+        resource.flush();
+    }
+    state.SetBytesProcessed(state.iterations() * Resource<T>::size);
+}
+BENCHMARK_TEMPLATE(BM_ResourceFlush, mvp);
+BENCHMARK_TEMPLATE(BM_ResourceFlush, Payload<16>);
+BENCHMARK_TEMPLATE(BM_ResourceFlush, Payload<256>);
+BENCHMARK_TEMPLATE(BM_ResourceFlush, Payload<1024>);
+
+static void BM_DescriptorPoolAllocate(benchmark::State& state){
+    auto ctx = context();
+    if(!ctx){
+        state.SkipWithError("no vulkan device");
+        return;
+    }
+    auto count = static_cast<uint32_t>(state.range(0));
+    auto& device = ctx->device;
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    VkDescriptorSetLayout layout;
+    ASSERT(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout));
+
+    VulkanDescriptorPool pool{ device, count, { {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, count} }, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT };
+    std::vector<VkDescriptorSetLayout> layouts(count, layout);
+    for(auto _ : state){
+        auto sets = pool.allocate(layouts);
+        benchmark::DoNotOptimize(sets.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+}
+BENCHMARK(BM_DescriptorPoolAllocate)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_PipelineStateInitializers(benchmark::State& state){
+    auto bindings = Vertex::binding();
+    auto attributes = Vertex::attributes();
+    for(auto _ : state){
+        auto inputState = initializers::vertexInputState(bindings, attributes);
+        auto assemblyState = initializers::inputAssemblyState();
+        auto viewportState = initializers::viewportState( initializers::viewport(WIDTH, HEIGHT), initializers::scissor({WIDTH, HEIGHT}));
+        auto rasterState = initializers::rasterizationState();
+        auto multisampleState = initializers::multisampleState();
+        auto depthStencilState = initializers::depthStencilState();
+        auto colorBlendState = initializers::colorBlendState();
+        auto dynamicState = initializers::dynamicState();
+        benchmark::DoNotOptimize(inputState);
+        benchmark::DoNotOptimize(assemblyState);
+        benchmark::DoNotOptimize(viewportState);
+        benchmark::DoNotOptimize(rasterState);
+        benchmark::DoNotOptimize(multisampleState);
+        benchmark::DoNotOptimize(depthStencilState);
+        benchmark::DoNotOptimize(colorBlendState);
+        benchmark::DoNotOptimize(dynamicState);
+    }
+}
+BENCHMARK(BM_PipelineStateInitializers);
+
+static void BM_ViewportStateInitializer(benchmark::State& state){
+    auto count = static_cast<size_t>(state.range(0));
+    std::vector<VkViewport> viewports(count, initializers::viewport(WIDTH, HEIGHT));
+    std::vector<VkRect2D> scissors(count, initializers::scissor({WIDTH, HEIGHT}));
+    for(auto _ : state){
+        auto viewportState = initializers::viewportState(viewports, scissors);
+        benchmark::DoNotOptimize(viewportState);
+    }
+}
+BENCHMARK(BM_ViewportStateInitializer)->RangeMultiplier(4)->Range(1, 16);
+
+static void BM_DynamicStateInitializer(benchmark::State& state){
+    std::vector<VkDynamicState> dynamicStates(static_cast<size_t>(state.range(0)), VK_DYNAMIC_STATE_VIEWPORT);
+    for(auto _ : state){
+        auto dynamicState = initializers::dynamicState(dynamicStates);
+        benchmark::DoNotOptimize(dynamicState);
+    }
+}
+BENCHMARK(BM_DynamicStateInitializer)->RangeMultiplier(2)->Range(1, 8);
+
+static void BM_ImageBarrierInitializer(benchmark::State& state){
+    auto count = static_cast<size_t>(state.range(0));
+    std::vector<VkImageMemoryBarrier> barriers(count);
+    for(auto _ : state){
+        for(auto i = 0u; i < count; i++){
+            barriers[i] = initializers::imageMemoryBarrier(VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                                            , 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+        benchmark::DoNotOptimize(barriers.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+BENCHMARK(BM_ImageBarrierInitializer)->RangeMultiplier(8)->Range(1, 512);
+
+// model matrices for a grid of objects composed with a shared view projection, as a frame update would
+static void BM_TransformBatch(benchmark::State& state){
+    auto count = static_cast<size_t>(state.range(0));
+    auto viewProjection = glm::perspective(glm::radians(45.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f)
+                          * glm::lookAt(glm::vec3(0, 0, 5), glm::vec3(0), glm::vec3(0, 1, 0));
+    std::vector<glm::vec3> positions(count);
+    for(auto i = 0u; i < count; i++){
+        positions[i] = glm::vec3(static_cast<float>(i % 32), static_cast<float>(i / 32 % 32), static_cast<float>(i / 1024));
+    }
+    std::vector<glm::mat4> transforms(count);
+    for(auto _ : state){
+        for(auto i = 0u; i < count; i++){
+            auto model = glm::scale(glm::translate(glm::mat4(1), positions[i]), glm::vec3(0.5f));
+            transforms[i] = viewProjection * model;
+        }
+        benchmark::DoNotOptimize(transforms.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+BENCHMARK(BM_TransformBatch)->RangeMultiplier(8)->Range(64, 32768);
+
+// the batch kernel on SoA instances, one run per instruction set the CPU supports
+static void BM_TransformKernel(benchmark::State& state, transform::Isa isa){
+    if(isa > transform::detect()){
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    auto count = static_cast<size_t>(state.range(0));
+    transform::Instances instances;
+    instances.resize(count);
+    for(auto i = 0u; i < count; i++){
+        instances.tx[i] = static_cast<float>(i % 32);
+        instances.ty[i] = static_cast<float>(i / 32 % 32);
+        instances.tz[i] = static_cast<float>(i / 1024);
+        instances.sx[i] = instances.sy[i] = instances.sz[i] = 0.5f;
+    }
+    auto viewProjection = glm::perspective(glm::radians(45.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f)
+                          * glm::lookAt(glm::vec3(0, 0, 5), glm::vec3(0), glm::vec3(0, 1, 0));
+    std::vector<glm::mat4> mvps(count);
+    for(auto _ : state){
+        transform::compute(isa, instances, viewProjection, mvps.data());
+        benchmark::DoNotOptimize(mvps.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+BENCHMARK_CAPTURE(BM_TransformKernel, scalar, transform::Isa::Scalar)->RangeMultiplier(8)->Range(64, 1 << 20);
+BENCHMARK_CAPTURE(BM_TransformKernel, sse, transform::Isa::Sse)->RangeMultiplier(8)->Range(64, 1 << 20);
+BENCHMARK_CAPTURE(BM_TransformKernel, avx2, transform::Isa::Avx2)->RangeMultiplier(8)->Range(64, 1 << 20);
+
+// moves state.range(0) leaf nodes of a 1M node scene (1k roots with 1k children each) per update
+static void BM_SceneUpdate(benchmark::State& state){
+    constexpr uint32_t roots = 1000;
+    constexpr uint32_t children = 1000;
+    Scene scene;
+    std::vector<Scene::Handle> leaves;
+    leaves.reserve(roots * children);
+    Scene::Bounds unit{ glm::vec3(-0.5f), glm::vec3(0.5f) };
+    for(auto r = 0u; r < roots; r++){
+        auto root = scene.create(Scene::Handle{}, glm::translate(glm::mat4(1), glm::vec3(r, 0, 0)));
+        for(auto c = 0u; c < children; c++){
+            leaves.push_back(scene.create(root, glm::translate(glm::mat4(1), glm::vec3(0, c, 0)), 0, unit));
+        }
+    }
+    scene.update();
+
+    auto moving = static_cast<size_t>(state.range(0));
+    auto stride = leaves.size() / moving;
+    float offset = 0;
+    for(auto _ : state){
+        offset += 0.01f;
+        for(size_t i = 0; i < moving; i++){
+            scene.setLocal(leaves[i * stride], glm::translate(glm::mat4(1), glm::vec3(offset, i % children, 0)));
+        }
+        scene.update();
+        benchmark::DoNotOptimize(scene.worlds.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(moving));
+}
+BENCHMARK(BM_SceneUpdate)->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+// scheduling overhead of an empty parallel for split into state.range(0) chunks
+static void BM_ParallelFor(benchmark::State& state){
+    static jobs::Scheduler scheduler;
+    auto chunks = static_cast<size_t>(state.range(0));
+    std::atomic<size_t> visited = 0;
+    for(auto _ : state){
+        scheduler.parallelFor(0, chunks, 1, [&](size_t first, size_t last){
+            visited.fetch_add(last - first, std::memory_order_relaxed);
+        });
+    }
+    benchmark::DoNotOptimize(visited.load());
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(chunks));
+}
+BENCHMARK(BM_ParallelFor)->RangeMultiplier(8)->Range(8, 4096)->UseRealTime();
+
+// the batch kernel spread over the job system's workers
+static void BM_TransformParallel(benchmark::State& state){
+    static jobs::Scheduler scheduler;
+    auto count = static_cast<size_t>(state.range(0));
+    transform::Instances instances;
+    instances.resize(count);
+    for(auto i = 0u; i < count; i++){
+        instances.tx[i] = static_cast<float>(i % 32);
+        instances.ty[i] = static_cast<float>(i / 32 % 32);
+        instances.tz[i] = static_cast<float>(i / 1024);
+    }
+    auto viewProjection = glm::perspective(glm::radians(45.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f);
+    std::vector<glm::mat4> mvps(count);
+    for(auto _ : state){
+        transform::compute(scheduler, instances, viewProjection, mvps.data());
+        benchmark::DoNotOptimize(mvps.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+BENCHMARK(BM_TransformParallel)->RangeMultiplier(8)->Range(1 << 14, 1 << 20)->UseRealTime();
+
+// 1M bounding volumes scattered around a camera at the origin so roughly a quarter survive
+template<typename Volumes>
+static Volumes cullingVolumes(size_t count){
+    Volumes volumes;
+    volumes.resize(count);
+    uint32_t seed = 1;
+    auto random = [&]{
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) * 200.0f - 100.0f;
+    };
+    for(size_t i = 0; i < count; i++){
+        volumes.x[i] = random();
+        volumes.y[i] = random();
+        volumes.z[i] = random();
+        if constexpr (std::is_same_v<Volumes, culling::Spheres>){
+            volumes.radius[i] = 0.5f;
+        }else{
+            volumes.ex[i] = volumes.ey[i] = volumes.ez[i] = 0.5f;
+        }
+    }
+    return volumes;
+}
+
+static culling::Frustum cullingFrustum(){
+    return culling::Frustum::extract(glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f)
+                                     * glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)));
+}
+
+// frustum culling kernel on SoA volumes, one run per instruction set the CPU supports
+template<typename Volumes>
+static void cullKernel(benchmark::State& state, transform::Isa isa){
+    if(isa > transform::detect()){
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    auto count = static_cast<size_t>(state.range(0));
+    auto volumes = cullingVolumes<Volumes>(count);
+    auto frustum = cullingFrustum();
+    std::vector<uint32_t> visible(count);
+    size_t survivors = 0;
+    for(auto _ : state){
+        survivors = culling::cull(isa, frustum, volumes, visible.data());
+        benchmark::DoNotOptimize(visible.data());
+        benchmark::ClobberMemory();
+    }
+    state.counters["visible"] = static_cast<double>(survivors);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+static void BM_CullSpheres(benchmark::State& state, transform::Isa isa){
+    cullKernel<culling::Spheres>(state, isa);
+}
+
+static void BM_CullBoxes(benchmark::State& state, transform::Isa isa){
+    cullKernel<culling::Boxes>(state, isa);
+}
+BENCHMARK_CAPTURE(BM_CullSpheres, scalar, transform::Isa::Scalar)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CullSpheres, sse, transform::Isa::Sse)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CullSpheres, avx2, transform::Isa::Avx2)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CullBoxes, scalar, transform::Isa::Scalar)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CullBoxes, sse, transform::Isa::Sse)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_CullBoxes, avx2, transform::Isa::Avx2)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+
+// culling spread over the job system's workers, including the compaction of the chunks
+static void BM_CullParallel(benchmark::State& state){
+    static jobs::Scheduler scheduler;
+    auto volumes = cullingVolumes<culling::Spheres>(static_cast<size_t>(state.range(0)));
+    auto frustum = cullingFrustum();
+    std::vector<uint32_t> visible;
+    for(auto _ : state){
+        culling::cull(scheduler, frustum, volumes, visible);
+        benchmark::DoNotOptimize(visible.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullParallel)->RangeMultiplier(8)->Range(1 << 14, 1 << 20)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+// static boxes scattered like cullingVolumes, the scene size BVH queries are meant for
+static std::vector<Bvh::Bounds> bvhBoxes(size_t count){
+    auto volumes = cullingVolumes<culling::Boxes>(count);
+    std::vector<Bvh::Bounds> boxes(count);
+    for(size_t i = 0; i < count; i++){
+        glm::vec3 center{ volumes.x[i], volumes.y[i], volumes.z[i] };
+        boxes[i] = { center - glm::vec3(0.5f), center + glm::vec3(0.5f) };
+    }
+    return boxes;
+}
+
+static void BM_BvhBuild(benchmark::State& state, bool parallel){
+    static jobs::Scheduler scheduler;
+    auto boxes = bvhBoxes(static_cast<size_t>(state.range(0)));
+    Bvh bvh;
+    for(auto _ : state){
+        if(parallel){
+            bvh.build(scheduler, boxes);
+        }else{
+            bvh.build(boxes);
+        }
+    }
+    state.counters["nodes"] = static_cast<double>(bvh.nodeCount());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_BvhBuild, serial, false)->Arg(1 << 20)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_BvhBuild, parallel, true)->Arg(1 << 20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// moves state.range(0) of 1M objects per frame and refits only the paths above them
+static void BM_BvhRefit(benchmark::State& state){
+    constexpr size_t count = 1 << 20;
+    auto boxes = bvhBoxes(count);
+    Bvh bvh;
+    bvh.build(boxes);
+    auto movingCount = static_cast<size_t>(state.range(0));
+    std::vector<uint32_t> moving(movingCount);
+    for(size_t i = 0; i < movingCount; i++){
+        moving[i] = static_cast<uint32_t>(i * (count / movingCount));
+    }
+    float offset = 0.01f;
+    for(auto _ : state){
+        offset = -offset;
+        for(auto object : moving){
+            boxes[object].min.x += offset;
+            boxes[object].max.x += offset;
+        }
+        bvh.refit(boxes, moving);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BvhRefit)->RangeMultiplier(10)->Range(10, 100000)->Unit(benchmark::kMicrosecond);
+
+static void BM_BvhRefitFull(benchmark::State& state){
+    auto boxes = bvhBoxes(1 << 20);
+    Bvh bvh;
+    bvh.build(boxes);
+    for(auto _ : state){
+        bvh.refit(boxes);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(boxes.size()));
+}
+BENCHMARK(BM_BvhRefitFull)->Unit(benchmark::kMillisecond);
+
+// hierarchical culling of the boxes BM_Cull tests one by one
+static void BM_BvhCull(benchmark::State& state){
+    auto boxes = bvhBoxes(static_cast<size_t>(state.range(0)));
+    Bvh bvh;
+    bvh.build(boxes);
+    auto frustum = cullingFrustum();
+    std::vector<uint32_t> visible;
+    for(auto _ : state){
+        visible.clear();
+        bvh.cull(frustum, visible);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.counters["visible"] = static_cast<double>(visible.size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BvhCull)->RangeMultiplier(8)->Range(1 << 14, 1 << 20)->Unit(benchmark::kMicrosecond);
+
+// picking rays from the camera through the scene
+static void BM_BvhRaycast(benchmark::State& state){
+    auto boxes = bvhBoxes(1 << 20);
+    Bvh bvh;
+    bvh.build(boxes);
+    std::vector<Bvh::Ray> rays(1024);
+    for(size_t i = 0; i < rays.size(); i++){
+        auto angle = static_cast<float>(i) * 0.1f;
+        rays[i].direction = glm::normalize(glm::vec3(std::cos(angle), std::sin(angle * 0.7f), -1.0f));
+    }
+    size_t ray = 0;
+    for(auto _ : state){
+        benchmark::DoNotOptimize(bvh.raycast(rays[ray++ % rays.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BvhRaycast);
+
+// objects overlapping a box of state.range(0) units around the origin
+static void BM_BvhQuery(benchmark::State& state){
+    auto boxes = bvhBoxes(1 << 20);
+    Bvh bvh;
+    bvh.build(boxes);
+    auto half = static_cast<float>(state.range(0)) * 0.5f;
+    Bvh::Bounds box{ glm::vec3(-half), glm::vec3(half) };
+    std::vector<uint32_t> objects;
+    for(auto _ : state){
+        objects.clear();
+        bvh.query(box, objects);
+        benchmark::DoNotOptimize(objects.data());
+    }
+    state.counters["objects"] = static_cast<double>(objects.size());
+}
+BENCHMARK(BM_BvhQuery)->RangeMultiplier(4)->Range(1, 64)->Unit(benchmark::kMicrosecond);
+
+// a frame's worth of draws over a few pipelines and materials, sorted by state then depth
+static void BM_DrawListSort(benchmark::State& state){
+    static jobs::Scheduler scheduler;
+    auto count = static_cast<uint32_t>(state.range(0));
+    DrawList drawList;
+    for(auto i = 0; i < 8; i++) drawList.addPipeline(VK_NULL_HANDLE);
+    for(auto i = 0; i < 64; i++) drawList.addDescriptorSet({});
+    for(auto i = 0; i < 256; i++) drawList.addGeometry({});
+    uint32_t seed = 1;
+    auto random = [&]{
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    for(auto _ : state){
+        state.PauseTiming();
+        drawList.clear();
+        for(uint32_t i = 0; i < count; i++){
+            auto depth = static_cast<float>(random()) / static_cast<float>(1u << 24);
+            drawList.add(random() % 8, random() % 64, random() % 256, depth, {});
+        }
+        state.ResumeTiming();
+        drawList.sort(scheduler);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DrawListSort)->RangeMultiplier(8)->Range(1 << 10, 1 << 20)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();